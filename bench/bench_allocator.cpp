@@ -0,0 +1,36 @@
+#include <benchmark/benchmark.h>
+#include "../include/Eidos/tensor.hpp"
+#include "../include/Eidos/allocator.h"
+
+// Strided sweeps over a large buffer touch a new 4KB page on almost every access, which is
+// where huge pages reduce TLB misses. Run with and without huge pages (the argument) and
+// compare; "huge_page_bytes" reports what the allocator placed on huge pages and
+// "resident_huge_bytes" what the kernel actually backed with them.
+static void BM_StridedSweep(benchmark::State& state) {
+    bool huge = state.range(0) != 0;
+    if (huge) {
+        Allocator::enable_huge_pages();
+    }
+    Tensor tensor(1, 4096, 4096); // 64MB
+    tensor.set_random();
+    if (huge) {
+        Allocator::disable_huge_pages();
+    }
+
+    const size_t stride = 4096 / sizeof(float) + 16; // One page and a cache line apart
+    const float* data = tensor.data();
+    size_t size = tensor.size();
+    for (auto _ : state) {
+        float sum = 0.0f;
+        for (size_t start = 0; start < stride; start += 64) {
+            for (size_t i = start; i < size; i += stride) {
+                sum += data[i];
+            }
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    AllocationStats stats = Allocator::stats();
+    state.counters["huge_page_bytes"] = static_cast<double>(stats.huge_page_bytes);
+    state.counters["resident_huge_bytes"] = static_cast<double>(Allocator::resident_huge_page_bytes());
+}
+BENCHMARK(BM_StridedSweep)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,220 @@
+#include <benchmark/benchmark.h>
+#include "../include/Eidos/tensor.hpp"
+#include "../include/Eidos/layers/conv_layer.h"
+#include "../include/Eidos/layers/fused_conv_layer.h"
+#include "../include/Eidos/activation_fns.h"
+
+// Convolution benchmarks on a 28x28 feature map with 32 input and 64 output channels,
+// the shape of the second block of the MNIST CNN. Arguments are the kernel size and stride.
+
+namespace {
+    Tensor random_input(int batch, int channels, int size) {
+        Tensor input(batch, channels, size, size);
+        input.set_random();
+        return input;
+    }
+
+    void report_flops(benchmark::State& state, const Tensor& output, int channels, int kernel_size) {
+        // One multiply-add per kernel tap, input channel and output element
+        double flops = 2.0 * output.size() * channels * kernel_size * kernel_size;
+        state.counters["GFLOPS"] = benchmark::Counter(flops * state.iterations() / 1e9, benchmark::Counter::kIsRate);
+    }
+}
+
+static void BM_Conv2DForward(benchmark::State& state) {
+    int kernel_size = state.range(0);
+    int stride = state.range(1);
+    Conv2D conv(32, 64, kernel_size, stride, kernel_size / 2);
+    Tensor input = random_input(8, 32, 28);
+    Tensor output;
+    for (auto _ : state) {
+        output = conv.forward(input);
+        benchmark::DoNotOptimize(output.data());
+    }
+    report_flops(state, output, 32, kernel_size);
+}
+BENCHMARK(BM_Conv2DForward)->Args({3, 1})->Args({3, 2})->Args({5, 1})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Inference with each algorithm, from a thin first layer (1 input channel) to a wide one.
+// Arguments are the input channels, kernel size, stride and ConvAlgorithm.
+static void BM_Conv2DAlgorithm(benchmark::State& state) {
+    int channels = state.range(0);
+    int kernel_size = state.range(1);
+    Conv2D conv(channels, 64, kernel_size, state.range(2), kernel_size / 2);
+    conv.set_algorithm(static_cast<ConvAlgorithm>(state.range(3)));
+    conv.set_training(false);
+    Tensor input = random_input(8, channels, 28);
+    Tensor output;
+    for (auto _ : state) {
+        output = conv.forward(input);
+        benchmark::DoNotOptimize(output.data());
+    }
+    report_flops(state, output, channels, kernel_size);
+}
+
+constexpr int gemm = static_cast<int>(ConvAlgorithm::Gemm);
+constexpr int winograd = static_cast<int>(ConvAlgorithm::Winograd);
+constexpr int direct = static_cast<int>(ConvAlgorithm::Direct);
+constexpr int fft = static_cast<int>(ConvAlgorithm::Fft);
+
+BENCHMARK(BM_Conv2DAlgorithm)
+    ->ArgsProduct({{1, 8, 32}, {3}, {1}, {gemm, winograd, direct}})
+    ->ArgsProduct({{1, 3, 8}, {3, 5, 7}, {1, 2}, {gemm, direct}})
+    ->ArgsProduct({{32}, {1}, {1}, {gemm, direct}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Inference with large kernels on large images, such as a first layer on 256x256 images from the
+// ImageLoader. Arguments are the image size, input channels, kernel size and ConvAlgorithm.
+static void BM_Conv2DLargeKernel(benchmark::State& state) {
+    int size = state.range(0);
+    int channels = state.range(1);
+    int kernel_size = state.range(2);
+    Conv2D conv(channels, 32, kernel_size, 1, kernel_size / 2);
+    conv.set_algorithm(static_cast<ConvAlgorithm>(state.range(3)));
+    conv.set_training(false);
+    Tensor input = random_input(4, channels, size);
+    Tensor output;
+    for (auto _ : state) {
+        output = conv.forward(input);
+        benchmark::DoNotOptimize(output.data());
+    }
+    report_flops(state, output, channels, kernel_size);
+}
+
+BENCHMARK(BM_Conv2DLargeKernel)
+    ->ArgsProduct({{32, 64, 128, 256}, {3, 16}, {5, 7, 11}, {gemm, fft}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Forward and backward passes of the same layers
+static void BM_Conv2DLargeKernelTraining(benchmark::State& state) {
+    int size = state.range(0);
+    int channels = state.range(1);
+    int kernel_size = state.range(2);
+    Conv2D conv(channels, 32, kernel_size, 1, kernel_size / 2);
+    conv.set_algorithm(static_cast<ConvAlgorithm>(state.range(3)));
+    Tensor input = random_input(4, channels, size);
+    Tensor grad_output = conv.forward(input);
+    grad_output.set_random();
+    for (auto _ : state) {
+        conv.forward(input);
+        Tensor grad_input = conv.backward(grad_output);
+        benchmark::DoNotOptimize(grad_input.data());
+    }
+}
+BENCHMARK(BM_Conv2DLargeKernelTraining)
+    ->ArgsProduct({{64, 256}, {3, 16}, {7, 11}, {gemm, fft}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Inference on a 256x256 feature map, as loaded by ImageLoader, with 32 input and 32 output
+// channels. Arguments are the ConvAlgorithm and whether the pass is tiled from the cache sizes (1)
+// or computed as a single tile (0).
+static void BM_Conv2DLargeMap(benchmark::State& state) {
+    Conv2D conv(32, 32, 3, 1, 1);
+    conv.set_algorithm(static_cast<ConvAlgorithm>(state.range(0)));
+    if (state.range(1) == 0) {
+        conv.set_tiling({1 << 20, 1 << 20, 1 << 20});
+    }
+    conv.set_training(false);
+    Tensor input = random_input(2, 32, 256);
+    Tensor output;
+    for (auto _ : state) {
+        output = conv.forward(input);
+        benchmark::DoNotOptimize(output.data());
+    }
+    report_flops(state, output, 32, 3);
+}
+BENCHMARK(BM_Conv2DLargeMap)
+    ->Args({gemm, 0})->Args({gemm, 1})->Args({winograd, 0})->Args({winograd, 1})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Inference in fp32 (GEMM) and int8 on the shape of BM_Conv2DForward and on a 256x256 map.
+// Arguments are the map size and ConvAlgorithm.
+static void BM_Conv2DInt8(benchmark::State& state) {
+    int size = state.range(0);
+    Conv2D conv(32, 64, 3, 1, 1);
+    conv.set_algorithm(static_cast<ConvAlgorithm>(state.range(1)));
+    conv.set_training(false);
+    Tensor input = random_input(size > 64 ? 2 : 8, 32, size);
+    Tensor output;
+    for (auto _ : state) {
+        output = conv.forward(input);
+        benchmark::DoNotOptimize(output.data());
+    }
+    report_flops(state, output, 32, 3);
+}
+constexpr int int8 = static_cast<int>(ConvAlgorithm::Int8);
+BENCHMARK(BM_Conv2DInt8)
+    ->Args({28, gemm})->Args({28, int8})->Args({256, gemm})->Args({256, int8})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Inference of a depthwise convolution over 64 channels with each algorithm.
+// Arguments are the kernel size, stride and ConvAlgorithm.
+static void BM_DepthwiseConv2D(benchmark::State& state) {
+    int kernel_size = state.range(0);
+    DepthwiseConv2D conv(64, kernel_size, state.range(1), kernel_size / 2);
+    conv.set_algorithm(static_cast<ConvAlgorithm>(state.range(2)));
+    conv.set_training(false);
+    Tensor input = random_input(8, 64, 28);
+    Tensor output;
+    for (auto _ : state) {
+        output = conv.forward(input);
+        benchmark::DoNotOptimize(output.data());
+    }
+    report_flops(state, output, 1, kernel_size);
+}
+BENCHMARK(BM_DepthwiseConv2D)
+    ->ArgsProduct({{3, 5}, {1, 2}, {gemm, direct}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// A 3x3 convolution from 32 to 64 channels as one dense Conv2D (0), or depthwise-separable (1):
+// a DepthwiseConv2D followed by a 1x1 Conv2D
+static void BM_SeparableConv2D(benchmark::State& state) {
+    Conv2D dense(32, 64, 3, 1, 1);
+    DepthwiseConv2D depthwise(32, 3, 1, 1);
+    Conv2D pointwise(32, 64, 1);
+    for (Layer* layer : std::initializer_list<Layer*>{&dense, &depthwise, &pointwise}) {
+        layer->set_training(false);
+    }
+    Tensor input = random_input(8, 32, 28);
+    Tensor output;
+    for (auto _ : state) {
+        output = state.range(0) ? pointwise.forward(depthwise.forward(input)) : dense.forward(input);
+        benchmark::DoNotOptimize(output.data());
+    }
+}
+BENCHMARK(BM_SeparableConv2D)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Inference of a Conv2D -> ReLU -> MaxPooling2D block, as separate layers (0) or as one FusedConv2D (1)
+static void BM_Conv2DFused(benchmark::State& state) {
+    Conv2D conv(32, 64, 3, 1, 1);
+    ReLU relu;
+    Layer& activation = relu;
+    MaxPooling2D pool(2, 2);
+    FusedConv2D fused(conv, relu, &pool);
+    conv.set_training(false);
+    Tensor input = random_input(8, 32, 28);
+    Tensor output;
+    for (auto _ : state) {
+        output = state.range(0) ? fused.forward(input) : pool.forward(activation.forward(conv.forward(input)));
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.counters["GFLOPS"] = benchmark::Counter(2.0 * 8 * 64 * 28 * 28 * 32 * 9 * state.iterations() / 1e9,
+                                                  benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_Conv2DFused)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_Conv2DBackward(benchmark::State& state) {
+    int kernel_size = state.range(0);
+    int stride = state.range(1);
+    Conv2D conv(32, 64, kernel_size, stride, kernel_size / 2);
+    Tensor input = random_input(8, 32, 28);
+    Tensor grad_output = conv.forward(input);
+    grad_output.set_random();
+    for (auto _ : state) {
+        conv.forward(input);
+        Tensor grad_input = conv.backward(grad_output);
+        benchmark::DoNotOptimize(grad_input.data());
+    }
+    report_flops(state, grad_output, 32, kernel_size);
+}
+BENCHMARK(BM_Conv2DBackward)->Args({3, 1})->Args({3, 2})->Unit(benchmark::kMillisecond)->UseRealTime();
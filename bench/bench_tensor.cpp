@@ -0,0 +1,85 @@
+#include <benchmark/benchmark.h>
+#include "../include/Eidos/tensor.hpp"
+#include "../include/Eidos/arena.h"
+
+// Tensor arithmetic benchmarks. Every iteration allocates from an arena, so the bytes it
+// allocates are reported next to the time as the "bytes_per_iter" counter.
+
+namespace {
+    Tensor random_tensor(size_t size) {
+        Tensor tensor(1, 16, size, size);
+        tensor.set_random();
+        return tensor;
+    }
+
+    void report_bytes(benchmark::State& state, const Arena& arena, const Tensor& sample) {
+        state.counters["bytes_per_iter"] = static_cast<double>(arena.bytes_allocated());
+        state.SetBytesProcessed(state.iterations() * sample.size() * sizeof(float));
+    }
+}
+
+// a * s + b evaluated one operation at a time, as every operator used to copy its operand:
+// two full temporaries and two passes over memory
+static void BM_CompoundEager(benchmark::State& state) {
+    Tensor a = random_tensor(state.range(0));
+    Tensor b = random_tensor(state.range(0));
+    Arena arena;
+    Arena::Scope scope(arena);
+    for (auto _ : state) {
+        arena.reset();
+        Tensor scaled = a;
+        scaled *= 0.5f;
+        Tensor result = scaled;
+        result += b;
+        benchmark::DoNotOptimize(result.data());
+    }
+    report_bytes(state, arena, a);
+}
+BENCHMARK(BM_CompoundEager)->Arg(32)->Arg(128);
+
+// The same expression through TensorExpression: one allocation and one fused loop
+static void BM_CompoundFused(benchmark::State& state) {
+    Tensor a = random_tensor(state.range(0));
+    Tensor b = random_tensor(state.range(0));
+    Arena arena;
+    Arena::Scope scope(arena);
+    for (auto _ : state) {
+        arena.reset();
+        Tensor result = a * 0.5f + b;
+        benchmark::DoNotOptimize(result.data());
+    }
+    report_bytes(state, arena, a);
+}
+BENCHMARK(BM_CompoundFused)->Arg(32)->Arg(128);
+
+// A longer chain, where the eager version would need one temporary per operator
+static void BM_ChainFused(benchmark::State& state) {
+    Tensor a = random_tensor(state.range(0));
+    Tensor b = random_tensor(state.range(0));
+    Tensor c = random_tensor(state.range(0));
+    Arena arena;
+    Arena::Scope scope(arena);
+    for (auto _ : state) {
+        arena.reset();
+        Tensor result = (a - b) * 2.0f + c / 4.0f - 1.0f;
+        benchmark::DoNotOptimize(result.data());
+    }
+    report_bytes(state, arena, a);
+}
+BENCHMARK(BM_ChainFused)->Arg(32)->Arg(128);
+
+// Accumulating into an existing tensor evaluates in place without allocating
+static void BM_AccumulateFused(benchmark::State& state) {
+    Tensor a = random_tensor(state.range(0));
+    Tensor b = random_tensor(state.range(0));
+    Tensor total(1, 16, state.range(0), state.range(0));
+    Arena arena;
+    Arena::Scope scope(arena);
+    for (auto _ : state) {
+        arena.reset();
+        total += a * 0.5f - b;
+        benchmark::DoNotOptimize(total.data());
+    }
+    report_bytes(state, arena, a);
+}
+BENCHMARK(BM_AccumulateFused)->Arg(32)->Arg(128);
@@ -0,0 +1,46 @@
+#include <benchmark/benchmark.h>
+#include <thread>
+#include <vector>
+#include "../include/Eidos/tensor.hpp"
+#include "../include/Eidos/thread_pool.h"
+#include "../include/Eidos/layers/pooling_layer.h"
+
+// The cost of starting a parallel loop, against the threads the layers used to start and join on
+// every call. Small feature maps are where it used to dominate.
+
+static void BM_SpawnThreads(benchmark::State& state) {
+    int num_threads = std::thread::hardware_concurrency();
+    for (auto _ : state) {
+        std::vector<std::thread> threads;
+        for (int thd = 0; thd < num_threads; ++thd) {
+            threads.emplace_back([] {});
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+}
+BENCHMARK(BM_SpawnThreads)->Unit(benchmark::kMicrosecond)->UseRealTime();
+
+static void BM_PoolParallelFor(benchmark::State& state) {
+    ThreadPool& pool = ThreadPool::global();
+    std::vector<int> values(pool.num_threads());
+    for (auto _ : state) {
+        pool.parallel_for(0, pool.num_threads(), [&](int i) { values[i] += i; });
+        benchmark::DoNotOptimize(values.data());
+    }
+}
+BENCHMARK(BM_PoolParallelFor)->Unit(benchmark::kMicrosecond)->UseRealTime();
+
+// Max pooling of a small 8x8 map with 64 channels, a batch of 8
+static void BM_MaxPoolingSmall(benchmark::State& state) {
+    MaxPooling2D pool(2, 2);
+    Tensor input(8, 64, 8, 8);
+    input.set_random();
+    Tensor output;
+    for (auto _ : state) {
+        output = pool.forward(input);
+        benchmark::DoNotOptimize(output.data());
+    }
+}
+BENCHMARK(BM_MaxPoolingSmall)->Unit(benchmark::kMicrosecond)->UseRealTime();
@@ -32,7 +32,7 @@ int main() {
     PrintLoss print_loss(2);
     SaveModel save_model(model, "myModel.bin");
 
-    model.Train(data, 20, &loss_fn, &optimizer, {&print_loss, &save_model});
+    model.Train(data, 20, &loss_fn, &optimizer, {&print_loss, &save_model}, 32);
 
     model.Serialize("myModel.bin");
     
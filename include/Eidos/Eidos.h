@@ -10,6 +10,7 @@
 #include "console.hpp"
 #include "csvparser.h"
 #include "debugger.hpp"
+#include "threading.h"
 
 #include "optimizer.h"
 #include "callback.h"
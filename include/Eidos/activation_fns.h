@@ -36,6 +36,11 @@ public:
     Eigen::MatrixXf backward(const Eigen::MatrixXf& grad_output) override;
 
     std::string get_name() const override { return "ReLU"; }
+    Layer* clone() const override { return new ReLU(*this); }
+    bool is_elementwise() const override { return true; }
+    void forward_inplace(Eigen::Ref<Eigen::ArrayXf> values) override;
+    void backward_inplace(Eigen::Ref<Eigen::ArrayXf> grad) override;
+    void apply_inplace(Eigen::Ref<Eigen::ArrayXf> values) const override;
     static ReLU* deserialize(std::ifstream& fromFileStream) {
         return new ReLU();
     }
@@ -78,6 +83,11 @@ public:
     Eigen::MatrixXf backward(const Eigen::MatrixXf& grad_output) override;
 
     std::string get_name() const override { return "LeakyReLU"; }
+    Layer* clone() const override { return new LeakyReLU(*this); }
+    bool is_elementwise() const override { return true; }
+    void forward_inplace(Eigen::Ref<Eigen::ArrayXf> values) override;
+    void backward_inplace(Eigen::Ref<Eigen::ArrayXf> grad) override;
+    void apply_inplace(Eigen::Ref<Eigen::ArrayXf> values) const override;
 
     void serialize(std::ofstream& toFileStream) const override {
         toFileStream.write((char*)&alpha, sizeof(float));
@@ -127,6 +137,11 @@ class Sigmoid: public Activation {
     Eigen::MatrixXf backward(const Eigen::MatrixXf& grad_output) override;
 
     std::string get_name() const override { return "Sigmoid"; }
+    Layer* clone() const override { return new Sigmoid(*this); }
+    bool is_elementwise() const override { return true; }
+    void forward_inplace(Eigen::Ref<Eigen::ArrayXf> values) override;
+    void backward_inplace(Eigen::Ref<Eigen::ArrayXf> grad) override;
+    void apply_inplace(Eigen::Ref<Eigen::ArrayXf> values) const override;
     static Sigmoid* deserialize(std::ifstream& fromFileStream) {
         return new Sigmoid();
     }
@@ -165,6 +180,9 @@ class Softmax: public Activation {
     Eigen::MatrixXf backward(const Eigen::MatrixXf& grad_output) override;
 
     std::string get_name() const override { return "Softmax"; }
+
+    Layer* clone() const override { return new Softmax(*this); }
+
     static Softmax* deserialize(std::ifstream& fromFileStream) {
         return new Softmax();
     }
@@ -209,6 +227,11 @@ class Tanh: public Activation {
     Eigen::MatrixXf backward(const Eigen::MatrixXf& grad_output) override;
 
     std::string get_name() const override { return "Tanh"; }
+    Layer* clone() const override { return new Tanh(*this); }
+    bool is_elementwise() const override { return true; }
+    void forward_inplace(Eigen::Ref<Eigen::ArrayXf> values) override;
+    void backward_inplace(Eigen::Ref<Eigen::ArrayXf> grad) override;
+    void apply_inplace(Eigen::Ref<Eigen::ArrayXf> values) const override;
     static Tanh* deserialize(std::ifstream& fromFileStream) {
         return new Tanh();
     }
@@ -2,6 +2,7 @@
 #define ACTIVATIONS_H
 
 #include <Eigen/Dense>
+#include <stdexcept>
 #include "layer.h"
 #include "tensor.hpp"
 
@@ -39,22 +40,77 @@ public:
      */
     virtual Eigen::MatrixXf backward(const Eigen::MatrixXf& grad_output) = 0;
 
+    /**
+     * @brief Whether the activation is applied independently to every element.
+     *
+     * Element-wise activations are evaluated over the whole tensor buffer in a single
+     * sweep instead of channel by channel. Activations that couple elements (e.g. Softmax)
+     * must keep the default of false.
+     *
+     * @return true if the activation is element-wise, false otherwise.
+     */
+    virtual bool is_elementwise() const { return false; }
+
+    // Element-wise activations run over the whole buffer, so they work in either layout
+    bool supports_layout(Layout layout) const override { return layout == Layout::NCHW || is_elementwise(); }
+
+    /**
+     * @brief Applies an element-wise activation in place, caching what the backward pass needs.
+     *
+     * The default evaluates forward(const Eigen::MatrixXf&) and copies the result back.
+     * Element-wise activations override this to write straight into the buffer.
+     *
+     * @param values The values to activate, overwritten with the activated values.
+     */
+    virtual void forward_inplace(Eigen::Ref<Eigen::ArrayXf> values) {
+        values = this->forward(values.matrix()).array();
+    }
+
+    /**
+     * @brief Applies an element-wise activation in place without caching anything for a backward pass.
+     *
+     * Used by fused inference operators (see FusedConv2D), which call it from several threads at once,
+     * so it must not touch any member. Element-wise activations override this, the default throws.
+     *
+     * @param values The values to activate, overwritten with the activated values.
+     * @throws std::logic_error if the activation does not support it.
+     */
+    virtual void apply_inplace([[maybe_unused]] Eigen::Ref<Eigen::ArrayXf> values) const {
+        throw std::logic_error(get_name() + " cannot be applied without caching its output.");
+    }
+
+    /**
+     * @brief Applies the backward pass of an element-wise activation in place.
+     *
+     * @param grad The gradient w.r.t. the output, overwritten with the gradient w.r.t. the input.
+     */
+    virtual void backward_inplace(Eigen::Ref<Eigen::ArrayXf> grad) {
+        grad = this->backward(grad.matrix()).array();
+    }
+
     /**
      * @brief Applies the forward activation function to the input tensor.
      *
-     * This function iterates over each depth slice of the input tensor and applies
-     * the forward activation function to each slice. The modified tensor is then returned.
+     * Element-wise activations are applied to the entire contiguous buffer at once,
+     * otherwise this iterates over each depth slice of the input tensor and applies
+     * the forward activation function to each slice.
      *
      * @param input The input tensor to which the activation function will be applied.
      * @return The tensor after applying the activation function.
      * 
-     * @note This function modifies the input tensor in-place.
      * @note This function is not required to be overridden in derived classes.
      */
     virtual Tensor forward(const Tensor& input) override {
-        cache_tensor.resize(input.depth(), input[0].rows(), input[0].cols());
-        Tensor result(input.depth(), input[0].rows(), input[0].cols());
-        for (int i = 0; i < input.depth(); ++i) {
+        if (is_elementwise()) {
+            // The whole buffer is treated as one array so the activation runs in a single pass
+            Tensor result = input;
+            forward_inplace(result.array());
+            return result;
+        }
+        Tensor result(input.batch(), input.depth(), input.rows(), input.cols());
+        // Allocated afresh every pass: a buffer kept from an earlier step may belong to an arena that was reset since
+        cache_tensor = Tensor(input.batch(), input.depth(), input.rows(), input.cols());
+        for (int i = 0; i < input.num_matrices(); ++i) {
             result[i] = this->forward(input[i]);
             cache_tensor[i] = cache_output;
         }
@@ -72,14 +128,48 @@ public:
      * @return A tensor containing the gradient of the loss with respect to the input of the activation function.
      */
     virtual Tensor backward(const Tensor& grad_output) override {
-        Tensor grad_input(grad_output.depth(), grad_output[0].rows(), grad_output[0].cols());
-        for (int i = 0; i < grad_output.depth(); ++i) {
+        if (is_elementwise()) {
+            // cache_output still holds the flat cache computed by the element-wise forward pass
+            Tensor grad_input = grad_output;
+            backward_inplace(grad_input.array());
+            return grad_input;
+        }
+        Tensor grad_input(grad_output.batch(), grad_output.depth(), grad_output.rows(), grad_output.cols());
+        for (int i = 0; i < grad_output.num_matrices(); ++i) {
             cache_output = cache_tensor[i];
             grad_input[i] = this->backward(grad_output[i]);
         }
         return grad_input;
     }
 
+    /**
+     * @brief Applies an element-wise activation directly to the buffer of an input that is no longer needed.
+     *
+     * @param input The input tensor, overwritten with the activated values.
+     * @return The same tensor, holding the activated values.
+     */
+    virtual Tensor forward(Tensor&& input) override {
+        if (!is_elementwise() || input.is_view()) {
+            return forward(static_cast<const Tensor&>(input));
+        }
+        forward_inplace(input.array());
+        return std::move(input);
+    }
+
+    /**
+     * @brief Computes the input gradient of an element-wise activation directly in the buffer of grad_output.
+     *
+     * @param grad_output The gradient w.r.t. the output, overwritten with the gradient w.r.t. the input.
+     * @return The same tensor, holding the gradient w.r.t. the input.
+     */
+    virtual Tensor backward(Tensor&& grad_output) override {
+        if (!is_elementwise() || grad_output.is_view()) {
+            return backward(static_cast<const Tensor&>(grad_output));
+        }
+        backward_inplace(grad_output.array());
+        return std::move(grad_output);
+    }
+
     std::string get_name() const override { return "Activation"; }
 
     void serialize(std::ofstream& toFileStream) const override {} // no parameters to serialize
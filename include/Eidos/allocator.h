@@ -0,0 +1,116 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <cstddef>
+#include <limits>
+#include <new>
+
+/**
+ * @struct AllocationStats
+ * @brief Counters kept by the Allocator, see Allocator::stats().
+ */
+struct AllocationStats {
+    size_t allocations = 0;          // Number of allocations made
+    size_t deallocations = 0;        // Number of allocations freed
+    size_t bytes_allocated = 0;      // Total bytes requested over all allocations
+    size_t bytes_in_use = 0;         // Bytes currently reserved, including rounding to huge pages
+    size_t peak_bytes_in_use = 0;    // Highest value of bytes_in_use
+    size_t huge_page_allocations = 0; // Allocations advised to use transparent huge pages
+    size_t huge_page_bytes = 0;      // Bytes currently reserved by those allocations
+};
+
+/**
+ * @class Allocator
+ * @brief The allocator behind tensor buffers and arena blocks.
+ *
+ * Every allocation is aligned to a 64-byte cache line, so a buffer never shares its first or last
+ * cache line with another one and vectorized loops start on a line boundary.
+ *
+ * With huge pages enabled (opt-in, Linux only), allocations of at least the threshold are aligned to
+ * and rounded up to 2MB, and the kernel is asked to back them with transparent huge pages through
+ * madvise(MADV_HUGEPAGE). One TLB entry then covers 2MB of a large weight or activation buffer instead
+ * of 4KB. Whether the kernel honours the advice depends on /sys/kernel/mm/transparent_hugepage/enabled
+ * being "madvise" or "always"; resident_huge_page_bytes() reports what the process actually got.
+ *
+ * All counters are updated atomically, so the allocator can be used from any thread.
+ */
+class Allocator {
+public:
+    static constexpr size_t alignment = 64;
+    static constexpr size_t huge_page_size = size_t(2) << 20;
+
+    /**
+     * @brief Allocates a 64-byte-aligned buffer, backed by huge pages if enabled and large enough.
+     *
+     * @param bytes The number of bytes requested.
+     * @return void* The buffer, to be released with deallocate().
+     * @throws std::bad_alloc if the system is out of memory.
+     */
+    static void* allocate(size_t bytes);
+
+    // Releases a buffer returned by allocate(). Null pointers are ignored.
+    static void deallocate(void* ptr);
+
+    /**
+     * @brief Opts in to transparent huge pages for allocations of at least threshold bytes.
+     *
+     * Only affects allocations made afterwards. Has no effect on platforms without madvise(MADV_HUGEPAGE).
+     *
+     * @param threshold The smallest allocation, in bytes, to place on huge pages.
+     */
+    static void enable_huge_pages(size_t threshold = huge_page_size);
+    static void disable_huge_pages();
+    static bool huge_pages_enabled();
+
+    /**
+     * @brief Advises the kernel to back an existing buffer with transparent huge pages.
+     *
+     * Used for buffers this allocator does not own, such as weight matrices allocated by Eigen. Only
+     * the whole pages inside the buffer are advised, and only 2MB-aligned ranges within them can become
+     * huge pages, so this helps buffers well above 2MB the most.
+     *
+     * @return true if the advice was given, false if the buffer is too small or it is not supported.
+     */
+    static bool advise_huge_pages(void* ptr, size_t bytes);
+
+    // Snapshot of the allocation counters
+    static AllocationStats stats();
+
+    // Resets the counters, except bytes in use, which keep tracking live buffers
+    static void reset_stats();
+
+    // Bytes of the process's anonymous memory the kernel backs with huge pages (Linux only, 0 elsewhere)
+    static size_t resident_huge_page_bytes();
+};
+
+/**
+ * @class AlignedAllocator
+ * @brief Standard allocator adapter over Allocator, for containers such as std::vector.
+ */
+template <typename T>
+class AlignedAllocator {
+public:
+    using value_type = T;
+
+    AlignedAllocator() noexcept = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) noexcept {}
+
+    T* allocate(size_t count) {
+        if (count > std::numeric_limits<size_t>::max() / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(Allocator::allocate(count * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, size_t) noexcept {
+        Allocator::deallocate(ptr);
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U>&) const noexcept { return false; }
+};
+
+#endif // ALLOCATOR_H
@@ -0,0 +1,141 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <vector>
+#include "memory_planner.h"
+#include "allocator.h"
+
+/**
+ * @class Arena
+ * @brief A bump allocator that hands out memory for the intermediate tensors of one training step.
+ *
+ * Allocation advances an offset inside a large block and never frees individual
+ * allocations. Everything is released at once by reset(), which makes the cost of
+ * an allocation a pointer increment instead of a malloc/free pair.
+ *
+ * When a block runs out a new one is appended. On reset the blocks are coalesced into a
+ * single block covering the total size, so after the first step a training loop runs
+ * out of one block without touching the system allocator.
+ *
+ * With planning enabled the arena also records when every allocation of a step is made and
+ * released. At the end of the first step a MemoryPlanner packs those lifetimes into one slab,
+ * and later steps with the same allocation sequence are served from fixed offsets in that slab
+ * without allocating at all. A step that deviates from the recorded sequence falls back to bump
+ * allocation for the rest of the step and the next step is recorded again.
+ *
+ * Blocks and the slab come from Allocator, so they are placed on huge pages when that is enabled.
+ *
+ * Tensors created while an arena is installed as the current arena of a thread (see Arena::Scope)
+ * take their buffer from that arena. Such tensors must not be used after the arena is reset.
+ */
+class Arena {
+public:
+    // Every allocation is aligned to a cache line, which also satisfies Eigen's vectorization
+    static constexpr size_t alignment = Allocator::alignment;
+    static constexpr size_t default_block_size = size_t(1) << 20;
+
+    /**
+     * @brief Constructs an arena. No memory is reserved until the first allocation.
+     *
+     * @param block_size The minimum size in bytes of each block requested from the system.
+     * @param planning Whether to plan a static slab layout from the first step (see MemoryPlanner).
+     */
+    explicit Arena(size_t block_size = default_block_size, bool planning = false);
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /**
+     * @brief Carves an aligned region out of the current block, adding a block if needed.
+     *
+     * @param bytes The number of bytes requested.
+     * @return void* Pointer to the start of the region, valid until the next reset().
+     */
+    void* allocate(size_t bytes);
+
+    /**
+     * @brief Allocates like allocate(bytes) and returns an id to report the release with.
+     *
+     * @param bytes The number of bytes requested.
+     * @param id Set to the id of the allocation, to be passed to release().
+     * @return void* Pointer to the start of the region, valid until the next reset().
+     */
+    void* allocate(size_t bytes, size_t& id);
+
+    /**
+     * @brief Reports that an allocation is no longer used. Memory is only reclaimed by reset(),
+     * but the release ends the allocation's lifetime for the memory planner. Ids from
+     * before the last reset are ignored.
+     */
+    void release(size_t id);
+
+    /**
+     * @brief Releases every allocation at once and coalesces the blocks into one.
+     * With planning enabled this also ends the step: a recorded step is turned into a slab plan.
+     */
+    void reset();
+
+    // Bytes handed out since the last reset, including alignment padding
+    size_t bytes_allocated() const { return bytes_allocated_; }
+
+    // Total bytes reserved from the system across all blocks and the planned slab
+    size_t capacity() const;
+
+    // Whether steps are currently served from a planned slab
+    bool is_planned() const { return mode_ == Mode::Replaying; }
+
+    // Size of the planned slab in bytes, 0 before the first plan
+    size_t slab_size() const { return slab_size_; }
+
+    // The arena installed on the calling thread, or nullptr if tensors should use the heap
+    static Arena* current();
+
+    /**
+     * @brief Installs an arena as the current arena of the calling thread for the lifetime of the scope.
+     */
+    class Scope {
+    public:
+        explicit Scope(Arena& arena);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Arena* previous_;
+    };
+
+private:
+    struct Block {
+        char* data;
+        size_t size;
+    };
+
+    // Bump: plain bump allocation. Recording: bump allocation while tracing lifetimes.
+    // Replaying: allocations are served from the planned slab.
+    enum class Mode { Bump, Recording, Replaying };
+
+    void add_block(size_t min_bytes);
+    void* bump(size_t bytes);
+    void free_blocks();
+    void build_slab();
+
+    size_t block_size_;
+    std::vector<Block> blocks_;
+    size_t active_ = 0;          // Index of the block currently being carved
+    size_t offset_ = 0;          // Offset of the next allocation inside the active block
+    size_t bytes_allocated_ = 0;
+
+    Mode mode_;
+    MemoryPlanner planner_;
+    char* slab_ = nullptr;
+    size_t slab_size_ = 0;
+    size_t next_id_ = 0;         // Id of the next allocation, never reused across steps
+    size_t step_first_id_ = 0;   // Id of the first allocation of the current step
+    size_t replay_events_ = 0;   // Allocation/release events seen so far in a replayed step
+    bool diverged_ = false;      // Whether the replayed step left the recorded sequence
+};
+
+#endif // ARENA_H
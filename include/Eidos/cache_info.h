@@ -0,0 +1,27 @@
+#ifndef CACHE_INFO_H
+#define CACHE_INFO_H
+
+#include <cstddef>
+
+/**
+ * @struct CacheSizes
+ * @brief Sizes in bytes of the data caches of the CPU.
+ *
+ * Kernels that block their loops (see Conv2D::Tiling) size their blocks from these, so the data a
+ * block works on stays in cache while it is reused.
+ */
+struct CacheSizes {
+    size_t l1; // Level 1 data cache, per core
+    size_t l2; // Level 2 cache, per core on most CPUs
+    size_t l3; // Last level cache, shared
+};
+
+/**
+ * @brief The cache sizes of the CPU, detected once on first use.
+ *
+ * They are read from sysconf on Linux and sysctl on macOS. Levels that cannot be detected take
+ * typical sizes (48 KiB, 1 MiB and 8 MiB).
+ */
+const CacheSizes& cache_sizes();
+
+#endif // CACHE_INFO_H
@@ -0,0 +1,78 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <Eigen/Dense>
+#include <complex>
+#include <vector>
+
+/**
+ * @class FFT2D
+ * @brief Two-dimensional fast Fourier transform of real planes, for one power-of-two size.
+ *
+ * The transform of a real (height x width) plane is Hermitian, so only its first width/2 + 1
+ * columns are kept: a spectrum is height * (width/2 + 1) complex values, row-major. Rows are
+ * transformed two at a time as the real and imaginary parts of one complex FFT. Columns are
+ * transformed all at once, each butterfly operating on whole spectrum rows.
+ *
+ * The twiddle factors and bit-reversal tables are computed at construction. The transforms
+ * are const and keep no state, so several threads can share one FFT2D.
+ */
+class FFT2D {
+public:
+    using Complex = std::complex<float>;
+
+    // Spectra of several planes, one per row
+    using Spectra = Eigen::Matrix<Complex, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+    FFT2D() = default;
+
+    /**
+     * @brief Prepares the transforms of (height x width) planes.
+     *
+     * @param height The number of rows, a power of two.
+     * @param width The number of columns, a power of two.
+     * @throws std::invalid_argument if a size is not a power of two.
+     */
+    FFT2D(int height, int width);
+
+    int height() const { return height_; }
+    int width() const { return width_; }
+    int spectrum_cols() const { return width_ / 2 + 1; }
+    int spectrum_size() const { return height_ * spectrum_cols(); }
+
+    /**
+     * @brief Transforms a real plane.
+     *
+     * @param plane The (height x width) plane, row-major.
+     * @param rows Only the first rows of the plane are read, the others are taken to be zero.
+     * @param spectrum Receives the height * (width/2 + 1) values of the spectrum.
+     */
+    void forward(const float* plane, int rows, Complex* spectrum) const;
+
+    /**
+     * @brief Transforms a spectrum back to a real plane, scaled by 1 / (height * width).
+     *
+     * @param spectrum The spectrum, overwritten with intermediate values.
+     * @param rows Only the first rows of the plane are computed.
+     * @param plane Receives the first rows of the (height x width) plane, row-major.
+     */
+    void inverse(Complex* spectrum, int rows, float* plane) const;
+
+    // Smallest power of two that is at least size
+    static int next_power_of_two(int size);
+
+private:
+    int height_ = 0;
+    int width_ = 0;
+    std::vector<Complex> row_twiddles;    // exp(-2 pi i k / width) for k < width/2
+    std::vector<Complex> column_twiddles; // exp(-2 pi i k / height) for k < height/2
+    std::vector<int> row_reversal;        // Bit-reversed index of each row element
+    std::vector<int> column_reversal;     // Bit-reversed index of each spectrum row
+
+    // In-place FFT of one contiguous sequence of width values
+    void transform_row(Complex* values, bool inverse) const;
+    // In-place FFT along the columns of a spectrum, over its height rows
+    void transform_columns(Complex* spectrum, bool inverse) const;
+};
+
+#endif // FFT_H
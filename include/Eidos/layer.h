@@ -3,6 +3,7 @@
 
 #include <Eigen/Dense>
 #include "tensor.hpp"
+#include "precision.h"
 #include <fstream>
 
 /**
@@ -38,6 +39,25 @@ public:
     */
     virtual Tensor backward(const Tensor& grad_output) = 0;
 
+    /*
+     * Forward propagation on an input the caller no longer needs.
+     * Layers that can compute their output in place override this to reuse the input
+     * buffer instead of allocating a new tensor. The default forwards to the const overload.
+     * Views are never mutated, overrides fall back to the const overload for them.
+     * 
+     * @param input: The input tensor, which may be modified and returned as the output
+     * @return: The output tensor after applying the layer's transformation
+    */
+    virtual Tensor forward(Tensor&& input) { return forward(static_cast<const Tensor&>(input)); }
+
+    /*
+     * Backward propagation on a gradient the caller no longer needs, see forward(Tensor&&).
+     * 
+     * @param grad_output: The gradient w.r.t. the output of this layer, which may be modified and returned
+     * @return: The gradient of the loss function w.r.t. the input of this layer
+    */
+    virtual Tensor backward(Tensor&& grad_output) { return backward(static_cast<const Tensor&>(grad_output)); }
+
     /**
      * @brief Checks if the layer has weights.
      * 
@@ -96,6 +116,30 @@ public:
      */
     virtual void set_training(bool training) {}
 
+    /**
+     * @brief Sets the precision used to store the layer's cached activations and inference weights.
+     * 
+     * Reduced precision (fp16/bf16) halves the memory and bandwidth of what is stored while all
+     * arithmetic still accumulates in fp32. Trainable weights and gradients stay in fp32.
+     * 
+     * @param precision The storage precision.
+     * 
+     * @note Should be overridden by layers that support reduced-precision storage, the default ignores it
+     */
+    virtual void set_precision([[maybe_unused]] Precision precision) {}
+
+    /**
+     * @brief Checks if the layer can consume and produce tensors in the given memory layout.
+     * 
+     * Layers that only see NCHW tensors keep the default. Layers with channels-last kernels
+     * (and element-wise layers, which do not care about the order) also accept NHWC, and
+     * produce their output in the layout of their input.
+     * 
+     * @param layout The memory layout of the input tensor.
+     * @return true if the layer handles the layout natively, false otherwise.
+     */
+    virtual bool supports_layout(Layout layout) const { return layout == Layout::NCHW; }
+
     /**
      * @brief Get the name of the layer.
      * 
@@ -112,6 +156,32 @@ public:
      */
     virtual std::string get_details() const { return ""; }
 
+    /**
+     * @brief Creates a copy of the layer with its own parameters, gradients and caches.
+     *
+     * Data-parallel training (see Model::Train) runs one copy of the layers per replica.
+     *
+     * @return Layer* A new layer owned by the caller, or nullptr if the layer cannot be copied.
+     *
+     * @note Should be overridden in derived classes that can be copied, the default returns nullptr
+     * and the model then trains on a single replica
+     */
+    virtual Layer* clone() const { return nullptr; }
+
+    /**
+     * @brief Makes the layer compute with the weights and biases of another layer of the same type and shape.
+     *
+     * Asynchronous training (see Model::TrainAsync) runs one copy of the layers per worker, which reads
+     * the model's parameters in place while its caches and gradients stay its own.
+     *
+     * @param owner The layer whose parameters are read, or nullptr to read the layer's own again.
+     * @return true if the layer reads the owner's parameters, or has none to read.
+     *
+     * @note Should be overridden by layers with parameters, the default only accepts layers without any
+     * and the model then copies the parameters into the copy before every batch
+     */
+    virtual bool share_parameters(const Layer* owner) { return owner == nullptr || (!has_weights() && !has_bias()); }
+
     /**
      * @brief Serializes the layer to the given output file stream.
      * 
@@ -8,5 +8,6 @@
 #include "layers/flatten_layer.h"
 #include "layers/conv_layer.h"
 #include "layers/pooling_layer.h"
+#include "layers/fused_conv_layer.h"
 
 #endif //LAYERS_H
\ No newline at end of file
@@ -3,8 +3,22 @@
 
 #include <Eigen/Dense>
 #include <vector>
+#include <cstdint>
 #include "../layer.h"
 #include "../tensor.hpp"
+#include "../fft.h"
+
+/**
+ * @enum ConvAlgorithm
+ * @brief How Conv2D computes its channels-first forward pass.
+ */
+enum class ConvAlgorithm {
+    Gemm,     // im2col + GEMM, works for every kernel size, stride and padding
+    Winograd, // Winograd F(2x2, 3x3), for 3x3 kernels with stride 1
+    Direct,   // Sliding-window kernels compiled for kernel sizes 1, 3, 5 and 7 with strides 1 and 2
+    Fft,      // Products of spectra over overlapping tiles of the input, for large kernels with stride 1
+    Int8      // int8 dot products with int32 accumulation, for inference with quantized weights and inputs
+};
 
 /**
  * @class Conv2D
@@ -18,25 +32,144 @@
  * @param kernel_size The size of the convolutional kernel (filter).
  * @param stride The stride of the convolution operation. Default is 1.
  * @param padding The amount of zero-padding added to the input data. Default is 0.
+ * @param groups The number of groups the channels are split into. Default is 1.
+ *
+ * With groups > 1, the input and output channels are split into that many groups and each output
+ * channel only reads the input channels of its group, which divides the weights and FLOPs by groups.
+ * Such a layer is saved as a "GroupedConv2D".
  */
 class Conv2D: public Layer {
+public:
+    // Accumulates the convolution of rows of one zero-bordered input plane with the K x K kernels (row-major,
+    // kernel_stride apart) of consecutive output channels into their planes (output_stride apart)
+    using DirectKernel = void (*)(const float* input, int row_stride, const float* kernels, int kernel_stride,
+                                  float* outputs, int output_stride, int channels, int H_out, int W_out);
+
+    // Scratch memory of one thread, kept between calls so it is reused from sample to sample
+    struct Workspace {
+        Tensor::Matrix columns;  // Blocks of im2col columns or Winograd input tiles, bordered input strips or an FFT tile
+        Tensor::Matrix products; // Winograd products before the output transform
+        FFT2D::Spectra spectra;  // Spectra of input, output and gradient tiles
+        std::vector<uint8_t> quantized; // Quantized input of a sample, see forward_sample_int8()
+    };
+
+    // Blocking of the GEMM and Winograd passes over large inputs, see set_tiling()
+    struct Tiling {
+        int rows;         // Output rows per strip
+        int in_channels;  // Input channels unfolded at a time, within a group
+        int out_channels; // Output channels per product, within a group
+    };
+
 private:
     std::vector<Eigen::MatrixXf> weights;    // Weights for each filter
     std::vector<Eigen::VectorXf> biases;     // Biases for each output channel
     std::vector<Eigen::MatrixXf> grad_weights; // Gradients of weights
     std::vector<Eigen::VectorXf> grad_biases;  // Gradients of biases
+    const Conv2D* shared = nullptr;            // Layer whose weights and biases are used instead of these, see share_parameters()
+
+    // The weights and biases the layer computes with, its own or those of the layer it shares them with
+    const std::vector<Eigen::MatrixXf>& source_weights() const { return shared ? shared->weights : weights; }
+    const std::vector<Eigen::VectorXf>& source_biases() const { return shared ? shared->biases : biases; }
 
     std::vector<int> input_shape;
     std::vector<int> output_shape;
     int kernel_size_;     // Size of the convolutional kernel
     int stride_;          // Stride for the convolution
     int padding_;         // Padding for the convolution
+    int groups_;          // Number of channel groups, each output channel reads the input channels of its group
 
     Tensor cache_input;         // Cached input for backward pass
 
-    Tensor applyPadding(const Tensor& input);
+    // Weights regrouped for the channels-last kernels, one (C_in x C_out) matrix per kernel offset ki * K + kj,
+    // zero where an input channel lies outside the output channel's group
+    std::vector<Eigen::MatrixXf> packed_weights;
+
+    // Filter bank as one (C_out x C_in/groups*K*K) matrix, column (c_in * K + ki) * K + kj holding tap (ki, kj) of
+    // channel c_in of the output channel's group. Group g is rows [g * C_out/groups, (g + 1) * C_out/groups).
+    Tensor::Matrix filter_matrix;
+
+    std::vector<Workspace> workspaces; // One per thread
+
+    ConvAlgorithm algorithm_;
+    bool training = true;
+    bool filters_stale = true; // Whether the packed filters must be rebuilt from the weights
+
+    // Direct kernel for this kernel size and stride (null if there is none), chosen once at construction
+    DirectKernel direct_kernel_;
+
+    // Winograd-domain filters, row xi * C_out + c_out holding element xi of G g G^T for every input channel
+    Tensor::Matrix winograd_filters;
+
+    // Transforms of the FFT tiles, and the conjugated spectrum of the kernel of input channel c_in in
+    // output channel c_out at row c_out * C_in + c_in
+    FFT2D fft;
+    FFT2D::Spectra filter_spectra;
+
+    // Filters quantized to int8, the scale of each output channel's filters and the per-tensor scale of the
+    // current input. The filters of each group are packed in blocks of int8_block output channels, for each
+    // kernel tap and 4 input channels: int8_block * 4 values, ordered for the kernel the CPU runs (see
+    // forward_sample_int8()). Missing channels are zeros.
+    std::vector<int8_t> int8_filters;
+    Eigen::VectorXf int8_scales;
+    Eigen::VectorXi int8_offsets; // 128 times the sum of each quantized filter, see forward_sample_int8()
+    float input_scale_ = 1.0f;
+
+    ConvAlgorithm default_algorithm_; // Chosen from the shape of the layer, for inputs too small for the FFT
+    bool auto_algorithm_ = true;      // Whether the algorithm follows the input size, until set_algorithm()
+
+    Tiling tiling_ = {1, 1, 1};
+    bool auto_tiling_ = true; // Whether the tiles follow the input size and cache sizes, until set_tiling()
+
     std::vector<int> calculateOutputShape() const;
 
+    // Channels-first (NCHW) passes are lowered to GEMMs of the filter bank and the unfolded input
+    void pack_filters();
+
+    // Unfolds channels [first_channel, first_channel + channels) of output rows [top, top + rows) of sample n into
+    // a row-major (channels*K*K x rows*W_out) matrix, and adds such a matrix back into the input gradient
+    void im2col(const Tensor& input, int n, float* columns, int first_channel, int channels, int top, int rows) const;
+    void col2im(const float* columns, int n, Tensor& grad_input, int first_channel, int channels, int top, int rows) const;
+
+    // Tiles for the current input and algorithm, sized from the cache sizes of the CPU
+    Tiling choose_tiling() const;
+
+    // Packs the filters for the selected algorithm. While training they are rebuilt on every
+    // forward pass, in inference they are kept until the weights may have changed.
+    void prepare_filters();
+    void transform_filters_winograd();
+    void transform_filters_fft();
+    void quantize_filters();
+
+    // Input channels of a group rounded up to a multiple of 4, and blocks of int8_block output channels per group
+    int int8_channels() const { return (input_shape[0] / groups_ + 3) / 4 * 4; }
+    int int8_blocks() const { return (static_cast<int>(weights.size()) / groups_ + int8_block - 1) / int8_block; }
+
+    // FFT tile height and width for the current input: powers of two, each tile giving (size - K + 1)
+    // outputs along each side
+    std::pair<int, int> fft_tile_size() const;
+    bool use_fft(int height, int width) const;
+
+    // Channels-first forward of one sample with each algorithm, see forward_sample()
+    void forward_sample_gemm(const Tensor& input, int n, float* output, Workspace& workspace) const;
+    void forward_sample_winograd(const Tensor& input, int n, float* output, Workspace& workspace) const;
+    void forward_sample_direct(const Tensor& input, int n, float* output, Workspace& workspace) const;
+    void forward_sample_fft(const Tensor& input, int n, float* output, Workspace& workspace) const;
+    void forward_sample_int8(const Tensor& input, int n, float* output, Workspace& workspace) const;
+    Tensor backward_fft(const Tensor& grad_output);
+
+    // 1x1 kernels with stride 1 and no padding need no unfolding, the input already is the column matrix
+    bool is_pointwise() const { return kernel_size_ == 1 && stride_ == 1 && padding_ == 0; }
+
+    // Channels-last (NHWC) kernels, padding is handled by skipping the taps that fall outside the input
+    void pack_weights();
+    Tensor forward_channels_last(const Tensor& input);
+    Tensor backward_channels_last(const Tensor& grad_output);
+
+protected:
+    // Weights and biases, in the order serialize() writes them
+    void write_parameters(std::ofstream& toFileStream) const;
+    void read_parameters(std::ifstream& fromFileStream);
+
 public:
     /**
      * @class ConvolutionalLayer
@@ -50,9 +183,11 @@ public:
      * @param kernel_size The size of the convolutional kernel (filter).
      * @param stride The stride of the convolution operation. Default is 1.
      * @param padding The amount of zero-padding added to the input data. Default is 0.
+     * @param groups The number of channel groups. Default is 1.
+     * @throws std::invalid_argument if groups does not divide both channel counts.
      */
     Conv2D(int input_channels, int output_channels, 
-                        int kernel_size, int stride = 1, int padding = 0);
+                        int kernel_size, int stride = 1, int padding = 0, int groups = 1);
 
     ~Conv2D() = default;
 
@@ -62,6 +197,104 @@ public:
     // Backward pass (gradient computation)
     Tensor backward(const Tensor& grad_output) override;
 
+    void set_training(bool training) override;
+
+    /**
+     * @brief Prepares a forward pass over the input: caches it while training, sets the output shape and packs the filters.
+     *
+     * forward() calls this itself. Fused operators (see FusedConv2D) call it and then forward_sample()
+     * for each sample, so they can post-process every sample's output while it is still in cache.
+     */
+    void begin_forward(const Tensor& input);
+
+    /**
+     * @brief Computes the channels-first convolution of one sample, bias included, after begin_forward().
+     *
+     * @param input The NCHW input given to begin_forward().
+     * @param n The sample.
+     * @param output Buffer receiving the (C_out x H_out x W_out) output of the sample.
+     * @param workspace Scratch memory owned by the calling thread, see reserve_workspaces().
+     */
+    void forward_sample(const Tensor& input, int n, float* output, Workspace& workspace) const;
+
+    // Makes sure there is a workspace for each of num_threads threads
+    void reserve_workspaces(int num_threads) {
+        if (workspaces.size() < static_cast<size_t>(num_threads)) {
+            workspaces.resize(num_threads);
+        }
+    }
+    Workspace& get_workspace(int thread) { return workspaces[thread]; }
+
+    const std::vector<int>& get_output_shape() const { return output_shape; }
+
+    /**
+     * @brief Selects the algorithm of the channels-first forward pass.
+     *
+     * The constructor picks the algorithm from the shape of the layer:
+     * - Winograd for 3x3 kernels with stride 1 and at least winograd_min_channels input channels. It needs
+     *   16 multiplications per 2x2 output tile instead of 36, but with few input channels the tile
+     *   transforms cost more than that saves.
+     * - Direct for 3x3 and 5x5 kernels with stride 1 and fewer than direct_max_channels input channels,
+     *   such as the first layer on images, where unfolding the input costs as much as the GEMM itself.
+     *   Grouped layers with fewer than direct_max_channels input channels per group, such as depthwise
+     *   convolutions, use it for every kernel size and stride it is compiled for.
+     * - FFT, chosen at each forward pass, for kernels of at least fft_min_kernel with stride 1 and no groups
+     *   on inputs of at least fft_min_size pixels along each side. The input is cut into overlapping tiles
+     *   whose spectra are multiplied by the filter spectra, so the cost per output pixel grows with
+     *   log(tile size) instead of K * K. The backward pass uses it too.
+     * - GEMM otherwise, including 1x1 kernels, which multiply the input without unfolding it.
+     * The other backward passes use GEMM.
+     *
+     * Int8 is never picked by the constructor. It quantizes the filters of each output channel to int8 with
+     * a scale of their own, max |w| / 127, and the input of each forward pass with one scale for the whole
+     * tensor, max |x| / 127. Each output is an int8 dot product accumulated in int32 and scaled back to
+     * fp32 with the two scales, so the weights and the input it reads take a quarter of the memory and
+     * bandwidth of fp32. The products use the VNNI dot-product instructions on CPUs with AVX-512 VNNI, and
+     * AVX2 on CPUs with AVX2, detected at run time; without either, int8 is slower than fp32. Outputs
+     * typically stay within 1% of the range of the fp32 outputs. Depthwise layers pad each group to 4 input
+     * and 16 output channels, so they are better left in fp32. The backward pass uses the fp32 GEMM.
+     *
+     * @param algorithm The algorithm to use.
+     * @throws std::invalid_argument if the algorithm does not support the layer's kernel size, stride or groups.
+     */
+    void set_algorithm(ConvAlgorithm algorithm);
+    static constexpr int winograd_min_channels = 8;
+    static constexpr int direct_max_channels = 4;
+    static constexpr int direct_halo_floats = 4096; // Size of the bordered strip of one input channel
+    static constexpr int fft_min_kernel = 7;
+    static constexpr int fft_min_size = 64;
+    static constexpr int int8_block = 16; // Output channels computed together by the int8 pass
+    ConvAlgorithm get_algorithm() const { return algorithm_; }
+
+    /**
+     * @brief Sets the blocking of the GEMM and Winograd passes.
+     *
+     * The output of each sample is computed in strips of output rows. Within a strip, the input is
+     * unfolded (im2col) or transformed (Winograd) a block of input channels at a time, and each block is
+     * multiplied by the filters of a block of output channels at a time, accumulating into the strip.
+     * Only one block of unfolded input exists at once instead of the unfolded input of the whole sample,
+     * and it is reused by every output channel while it is still in cache. The backward pass uses the
+     * same strips and input channel blocks, with all output channels.
+     *
+     * By default the tiles are chosen at each forward pass from the input size and the cache sizes
+     * detected at startup (see cache_sizes()): an unfolded block and the output strip fill about half of
+     * L2, and a block of filters about a quarter of it. Small inputs are a single tile.
+     *
+     * @param tiling The tile sizes, clamped to the layer and input at each pass.
+     * @throws std::invalid_argument if a size is not positive.
+     */
+    void set_tiling(Tiling tiling);
+    const Tiling& get_tiling() const { return tiling_; }
+
+    // Both layouts are handled natively and the output has the layout of the input, but the channels-last
+    // kernels of grouped layers multiply by zeros outside each group, so those prefer channels first
+    bool supports_layout(Layout layout) const override { return layout == Layout::NCHW || groups_ == 1; }
+
+    int get_kernel_size() const { return kernel_size_; }
+    int get_stride() const { return stride_; }
+    int get_padding() const { return padding_; }
+    int get_groups() const { return groups_; }
+
     // Getter methods
     bool has_weights() const override { return true; };
     bool has_bias() const override { return true; };
@@ -87,18 +320,31 @@ public:
     std::vector<Eigen::VectorXf*> get_bias() override { return get_pointers(biases); }
     std::vector<Eigen::VectorXf*> get_grad_bias() override { return get_pointers(grad_biases); }
 
-    std::string get_name() const override { return "Conv2D"; }
+    std::string get_name() const override { return groups_ > 1 ? "GroupedConv2D" : "Conv2D"; }
+
+    Layer* clone() const override { return new Conv2D(*this); }
+
+    bool share_parameters(const Layer* owner) override;
 
     std::string get_details() const override {
         return "   Input Shape: " + std::to_string(input_shape[0]) + "x" + std::to_string(input_shape[1]) + "x" + std::to_string(input_shape[2]) + "\n" +
                "   Output Shape: " + std::to_string(output_shape[0]) + "x" + std::to_string(output_shape[1]) + "x" + std::to_string(output_shape[2]) + "\n" +
                "   Kernel Size: " + std::to_string(kernel_size_) + "\n" +
                "   Stride: " + std::to_string(stride_) + "\n" +
-               "   Padding: " + std::to_string(padding_) + "\n";
+               "   Padding: " + std::to_string(padding_) + "\n" +
+               (groups_ > 1 ? "   Groups: " + std::to_string(groups_) + "\n" : "");
     }
     
     void serialize(std::ofstream& toFileStream) const override;
-    static Conv2D* deserialize(std::ifstream& fromFileStream);
+
+    /**
+     * @brief Reads a layer written by serialize().
+     *
+     * @param fromFileStream The stream to read from.
+     * @param grouped Whether the layer was saved as a "GroupedConv2D", which also stores its groups.
+     * @return Conv2D* The new layer.
+     */
+    static Conv2D* deserialize(std::ifstream& fromFileStream, bool grouped = false);
 
 protected:
     template <typename T>
@@ -111,4 +357,40 @@ protected:
     }
 };
 
+/**
+ * @class DepthwiseConv2D
+ * @brief A convolution that filters every input channel on its own.
+ *
+ * Each input channel is convolved with depth_multiplier kernels of its own, giving channels *
+ * depth_multiplier output channels, the output channels of input channel c being consecutive from
+ * c * depth_multiplier. This is a Conv2D with one group per input channel. Followed by a 1x1 Conv2D
+ * that mixes the channels, it forms a depthwise-separable convolution, which needs about
+ * 1/C_out + 1/(K*K) of the FLOPs of a Conv2D with the same input and output channels.
+ *
+ * The forward pass slides each kernel directly over strips of its zero-bordered input plane, for kernel sizes
+ * 1, 3, 5 and 7 with strides 1 and 2, and falls back to per-channel GEMMs otherwise.
+ *
+ * @param channels The number of input channels.
+ * @param kernel_size The size of the convolutional kernel (filter).
+ * @param stride The stride of the convolution operation. Default is 1.
+ * @param padding The amount of zero-padding added to the input data. Default is 0.
+ * @param depth_multiplier The number of output channels per input channel. Default is 1.
+ */
+class DepthwiseConv2D: public Conv2D {
+public:
+    DepthwiseConv2D(int channels, int kernel_size, int stride = 1, int padding = 0, int depth_multiplier = 1);
+
+    std::string get_name() const override { return "DepthwiseConv2D"; }
+
+    Layer* clone() const override { return new DepthwiseConv2D(*this); }
+
+    int get_depth_multiplier() const { return depth_multiplier_; }
+
+    void serialize(std::ofstream& toFileStream) const override;
+    static DepthwiseConv2D* deserialize(std::ifstream& fromFileStream);
+
+private:
+    int depth_multiplier_;
+};
+
 #endif // CONVOLUTIONAL_LAYER_H
\ No newline at end of file
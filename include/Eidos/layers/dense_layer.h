@@ -22,6 +22,17 @@ private:
     Eigen::MatrixXf grad_weights;
     Eigen::VectorXf grad_bias;
     Eigen::MatrixXf input;
+    const DenseLayer* shared = nullptr; // Layer whose weights and bias are used instead of these, see share_parameters()
+
+    Precision precision = Precision::FP32;
+    bool training = true;
+    CompactMatrix compact_input;    // Input cached for backward when precision is reduced
+    CompactMatrix compact_weights;  // Reduced-precision copy of the weights used for inference
+    bool compact_weights_stale = true;
+
+    // The weights and bias the layer computes with, its own or those of the layer it shares them with
+    const Eigen::MatrixXf& source_weights() const { return shared ? shared->weights : weights; }
+    const Eigen::VectorXf& source_bias() const { return shared ? shared->bias : bias; }
 
 public:
     DenseLayer(int input_size, int output_size);
@@ -29,6 +40,9 @@ public:
     Tensor forward(const Tensor& input) override;
     Tensor backward(const Tensor& grad_output) override;
 
+    void set_training(bool training) override;
+    void set_precision(Precision precision) override;
+
     bool has_weights() const override;
     bool has_bias() const override;
 
@@ -42,6 +56,10 @@ public:
 
     std::string get_name() const override { return "Dense"; }
 
+    Layer* clone() const override { return new DenseLayer(*this); }
+
+    bool share_parameters(const Layer* owner) override;
+
     std::string get_details() const override {
         return "   Input Size: " + std::to_string(weights.rows()) + "\n" +
                "   Output Size: " + std::to_string(weights.cols()) + "\n";
@@ -13,8 +13,8 @@
  * The FlattenLayer class inherits from the Layer class and implements a layer that flattens the input.
  * It includes methods for forward and backward passes.
  * 
- * @param input_shape: The dimensions of the input tensor (e.g., {Channels, Height, Width})
- * @param output_shape: The dimensions of the flattened output (e.g., {Channels, Flattened_Size})
+ * @param input_shape: The dimensions of the input tensor (e.g., {Channels, Height, Width, Batch})
+ * @param output_shape: The dimensions of the flattened output (e.g., {Batch, Flattened_Size})
  */
 class FlattenLayer : public Layer {
 private:
@@ -24,20 +24,32 @@ private:
     // Output shape of the layer
     std::vector<int> output_shape;
 
+    // Layout of the last input, the gradient is handed back in the same layout
+    Layout input_layout = Layout::NCHW;
+
 public:
 
     /**
      * @brief Applies a forward transformation to flatten the input matrices.
      * 
-     * This function takes a vector of Eigen::MatrixXf objects as input and 
-     * performs a forward transformation to flatten them into a single 
-     * Eigen::MatrixXf object.
+     * This function takes a (N x C x H x W) tensor as input and flattens every
+     * sample into one row of a single (N x C*H*W) matrix.
      * 
-     * @param input A vector of Eigen::MatrixXf objects representing the input matrices.
-     * @return Eigen::MatrixXf The resulting flattened matrix.
+     * @param input The batched input tensor.
+     * @return Tensor A single-matrix tensor with one flattened sample per row.
      */
     Tensor forward(const Tensor& input) override;
 
+    /**
+     * @brief Flattens an input that is no longer needed by reshaping it in place.
+     *
+     * The channels are stored back to back in row-major order, so no data moves.
+     *
+     * @param input The batched input tensor, reused as the output.
+     * @return Tensor A single-matrix tensor with one flattened sample per row.
+     */
+    Tensor forward(Tensor&& input) override;
+
     /**
      * @brief Performs the backward transformation for the flatten layer.
      *
@@ -49,10 +61,23 @@ public:
      */
     Tensor backward(const Tensor& grad) override;
 
+    /**
+     * @brief Reshapes a gradient that is no longer needed back to the input shape in place.
+     *
+     * @param grad The gradient w.r.t. the flattened output, reused as the result.
+     * @return Tensor The gradient w.r.t. the input of the flatten layer.
+     */
+    Tensor backward(Tensor&& grad) override;
+
+    // NHWC inputs are flattened in (c, h, w) order as well, so the layers that follow see the same features
+    bool supports_layout(Layout) const override { return true; }
+
     bool has_weights() const override { return false; }
     bool has_bias() const override { return false; }
 
     std::string get_name() const override { return "Flatten"; }
+
+    Layer* clone() const override { return new FlattenLayer(*this); }
     std::string get_details() const override {
         return "   Input Shape: " + std::to_string(input_shape[0]) + "x" + std::to_string(input_shape[1]) + "x" + std::to_string(input_shape[2]) +
             "\n   Output Shape: " + std::to_string(output_shape[0]) + "x" + std::to_string(output_shape[1]) + "\n";
@@ -0,0 +1,61 @@
+#ifndef FUSED_CONV_LAYER_H
+#define FUSED_CONV_LAYER_H
+
+#include <Eigen/Dense>
+#include <vector>
+#include "../layer.h"
+#include "../tensor.hpp"
+#include "../activations.h"
+#include "conv_layer.h"
+#include "pooling_layer.h"
+
+/**
+ * @class FusedConv2D
+ * @brief Inference operator computing Conv2D, its bias, an element-wise activation and optionally MaxPooling2D in one pass.
+ *
+ * Model builds these in inference mode from every Conv2D followed by an element-wise activation
+ * (ReLU, LeakyReLU, Sigmoid or Tanh) and, optionally, a MaxPooling2D (see Model::set_inference).
+ * Each sample is convolved into a buffer of the calling thread, activated there while it is still in
+ * cache and pooled straight into the output, so the convolution and activation outputs are never
+ * written out as whole tensors and the activation keeps no mask.
+ *
+ * The operator points at the layers it fuses, which keep owning the weights and must outlive it.
+ * Channels-last (NHWC) inputs run the layers one after the other. There is no backward pass.
+ */
+class FusedConv2D: public Layer {
+public:
+    /**
+     * @brief Fuses a convolution with the activation and the optional max pooling that follow it.
+     *
+     * @param conv The convolution.
+     * @param activation An element-wise activation, applied to the convolution output.
+     * @param pool The max pooling applied to the activated output, or nullptr for none.
+     * @throws std::invalid_argument if the activation is not element-wise.
+     */
+    FusedConv2D(Conv2D& conv, Activation& activation, MaxPooling2D* pool = nullptr);
+
+    Tensor forward(const Tensor& input) override;
+
+    // Inference only, throws std::logic_error
+    Tensor backward(const Tensor& grad_output) override;
+
+    bool supports_layout(Layout) const override { return true; }
+
+    std::string get_name() const override { return "FusedConv2D"; }
+
+    std::string get_details() const override {
+        return "   Fuses: " + conv.get_name() + ", " + activation.get_name() + (pool ? ", " + pool->get_name() : "") + "\n";
+    }
+
+    // Only lives in the inference plan of a Model, which serializes the layers it fuses
+    void serialize(std::ofstream& toFileStream) const override;
+
+private:
+    Conv2D& conv;
+    Activation& activation;
+    MaxPooling2D* pool;
+
+    std::vector<Tensor::Matrix> conv_outputs; // (C_out x H_out*W_out) output of the current sample, one per thread
+};
+
+#endif // FUSED_CONV_LAYER_H
@@ -5,6 +5,7 @@
 #include "../activations.h"
 #include <vector>
 #include <Eigen/Dense>
+#include <memory>
 
 /**
  * @class GRULayer
@@ -53,6 +54,7 @@ private:
 
     Activation* activation;        // Activation function for reset and update gates (sigmoid) 
     Activation* gate_activation;   // Activation for candidate state (tanh)
+    std::shared_ptr<Layer> owned_activation, owned_gate_activation; // Copies owned by a clone, see clone()
 
     Eigen::MatrixXf input_sequence; // Input data stored for backward pass
     bool output_sequence;           // Whether to output the full sequence or just the last state
@@ -73,6 +75,9 @@ public:
     // Get the name of the layer
     std::string get_name() const override { return "GRU"; }
 
+    // The activations cache their outputs, so the copy gets copies of the activations too
+    Layer* clone() const override;
+
     std::string get_details() const override {
         return "   Hidden Size: " + std::to_string(hidden_state.size()) + "\n" +
                "   Output Size: " + std::to_string(biases[3].size()) + "\n" +
@@ -30,8 +30,16 @@ public:
 
     Tensor backward(const Tensor& grad_output) override;
 
+    // Both layouts are handled natively, the output has the layout of the input
+    bool supports_layout(Layout) const override { return true; }
+
     std::string get_name() const override { return "MaxPooling2D"; }
 
+    Layer* clone() const override { return new MaxPooling2D(*this); }
+
+    int get_pool_size() const { return pool_size; }
+    int get_stride() const { return stride; }
+
     std::string get_details() const override {
         return "   Pool Size: " + std::to_string(pool_size) + "\n" +
                "   Stride: " + std::to_string(stride) + "\n";
@@ -47,6 +55,10 @@ private:
     std::vector<int> output_shape;
     Tensor input;
     Tensor mask;
+
+    // Channels-last (NHWC) kernels, comparing whole pixels of channels at once
+    Tensor forward_channels_last(const Tensor& input);
+    Tensor backward_channels_last(const Tensor& grad_output);
 };
 
 /**
@@ -74,6 +86,8 @@ public:
 
     std::string get_name() const override { return "AveragePooling2D"; }
 
+    Layer* clone() const override { return new AveragePooling2D(*this); }
+
     void serialize(std::ofstream& toFileStream) const override;
     static AveragePooling2D* deserialize(std::ifstream& fromFileStream);
 
@@ -20,6 +20,13 @@ private:
     Eigen::MatrixXf mask; ///< Mask matrix used to drop units.
     bool training = true; ///< Flag to indicate if the layer is in training mode.
 
+    /**
+     * @brief Scales a single-matrix tensor in place by the dropout mask.
+     * @param values Tensor to scale.
+     * @param generate Draw a new mask (forward pass) or reuse the last one (backward pass).
+     */
+    void apply_mask(Tensor& values, bool generate);
+
 public:
     /**
      * @brief Constructor for Dropout layer.
@@ -34,6 +41,13 @@ public:
      */
     Tensor forward(const Tensor& input) override;
 
+    /**
+     * @brief Forward pass of the Dropout layer, masking the input buffer in place.
+     * @param input Input matrix, reused as the output.
+     * @return Output matrix after applying dropout.
+     */
+    Tensor forward(Tensor&& input) override;
+
     /**
      * @brief Backward pass of the Dropout layer.
      * @param grad_output Gradient of the loss with respect to the output.
@@ -41,6 +55,13 @@ public:
      */
     Tensor backward(const Tensor& grad_output) override;
 
+    /**
+     * @brief Backward pass of the Dropout layer, masking the gradient buffer in place.
+     * @param grad_output Gradient of the loss with respect to the output, reused as the result.
+     * @return Gradient of the loss with respect to the input.
+     */
+    Tensor backward(Tensor&& grad_output) override;
+
     /**
      * @brief Set the training mode for the Dropout layer.
      * @param training_ Boolean flag to set training mode.
@@ -49,6 +70,8 @@ public:
 
     std::string get_name() const override { return "Dropout"; }
 
+    Layer* clone() const override { return new Dropout(*this); }
+
     std::string get_details() const override {
         return "   Probability: " + std::to_string(probability) + "\n";
     }
@@ -93,6 +116,19 @@ private:
     Eigen::MatrixXf grad_gamma; ///< Gradient of the scale parameter.
     Eigen::VectorXf grad_beta; ///< Gradient of the shift parameter.
 
+    /**
+     * @brief Computes the batch statistics and caches the centered and normalized input.
+     * @param input Input matrix.
+     */
+    void normalize(const Tensor& input);
+
+    /**
+     * @brief Computes the parameter gradients and writes the input gradient.
+     * @param grad_output Gradient of the loss with respect to the output.
+     * @param grad_input Destination of the input gradient, which may alias grad_output.
+     */
+    void input_gradient(const Tensor& grad_output, Tensor::ChannelMap grad_input);
+
 public:
     /**
      * @brief Constructor for BatchNorm layer.
@@ -108,6 +144,13 @@ public:
      */
     Tensor forward(const Tensor& input) override;
 
+    /**
+     * @brief Forward pass of the BatchNorm layer, writing the output into the input buffer.
+     * @param input Input matrix, reused as the output.
+     * @return Output matrix after applying batch normalization.
+     */
+    Tensor forward(Tensor&& input) override;
+
     /**
      * @brief Backward pass of the BatchNorm layer.
      * @param grad_output Gradient of the loss with respect to the output.
@@ -115,6 +158,13 @@ public:
      */
     Tensor backward(const Tensor& grad_output) override;
 
+    /**
+     * @brief Backward pass of the BatchNorm layer, writing the input gradient into the gradient buffer.
+     * @param grad_output Gradient of the loss with respect to the output, reused as the result.
+     * @return Gradient of the loss with respect to the input.
+     */
+    Tensor backward(Tensor&& grad_output) override;
+
     /**
      * @brief Set the training mode for the BatchNorm layer.
      * @param training_ Boolean flag to set training mode.
@@ -161,6 +211,8 @@ public:
     std::vector<Eigen::VectorXf*> get_running_variance() { return {&running_variance}; }
 
     std::string get_name() const override { return "BatchNorm"; }
+
+    Layer* clone() const override { return new BatchNorm(*this); }
     std::string get_details() const override {
         return "Number of Features: " + std::to_string(num_features) + "\n" +
                "Epsilon: " + std::to_string(epsilon) + "\n";
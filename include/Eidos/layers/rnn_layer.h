@@ -2,6 +2,7 @@
 #define RNN_LAYER_H
 
 #include <Eigen/Dense>
+#include <memory>
 #include "../layer.h"
 #include "../activation_fns.h"
 #include "../tensor.hpp"
@@ -36,12 +37,28 @@ private:
     std::vector<Eigen::VectorXf> hidden_states;  // Hidden states for each time step
     
     Activation* activation;        // Activation function
+    std::shared_ptr<Layer> owned_activation; // Copy of the activation owned by a clone, see clone()
     std::vector<Eigen::VectorXf> pre_activations;
 
     bool output_sequence;
     Eigen::MatrixXf input_sequence;
 
+    // With reduced precision the histories above are packed into these between forward and backward
+    Precision precision = Precision::FP32;
+    CompactMatrix compact_hidden_states;    // (T + 1) x H
+    CompactMatrix compact_pre_activations;  // T x H
+
+    void pack_histories();
+    void unpack_histories();
+
 public:
+    /**
+     * @brief Stores the hidden-state and pre-activation histories kept for backward in the given precision.
+     * 
+     * @param precision The storage precision of the histories.
+     */
+    void set_precision(Precision precision) override;
+
     /**
      * @brief Constructs an RNNLayer object.
      * 
@@ -99,6 +116,9 @@ public:
 
     std::string get_name() const override { return "RNN"; }
 
+    // The activation caches its output, so the copy gets a copy of the activation too
+    Layer* clone() const override;
+
     std::string get_details() const override {
         std::string details = "   Hidden Size: " + std::to_string(hidden_state.size()) + "\n";
         details += "   Output Size: " + std::to_string(biases[1].size()) + "\n";
@@ -0,0 +1,63 @@
+#ifndef MEMORY_PLANNER_H
+#define MEMORY_PLANNER_H
+
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+/**
+ * @class MemoryPlanner
+ * @brief Records the allocation trace of one step and packs it into a single slab.
+ *
+ * Every allocation made during a recorded step is stored with its size and lifetime,
+ * measured in allocation/release events. plan() then assigns each allocation a fixed
+ * offset so that allocations whose lifetimes overlap never share bytes, while allocations
+ * that are never alive at the same time reuse the same region.
+ *
+ * Offsets are assigned greedily by size: the largest allocation is placed first and every
+ * following one goes into the lowest gap that does not collide with an already placed,
+ * simultaneously live allocation. This typically gets close to the peak live size.
+ *
+ * A plan is only valid for a step whose event sequence is identical to the recorded one,
+ * which expects() checks event by event during replay.
+ */
+class MemoryPlanner {
+public:
+    // Release time used for allocations still alive at the end of the step
+    static constexpr size_t end_of_step = std::numeric_limits<size_t>::max();
+
+    struct Allocation {
+        size_t bytes;
+        size_t begin; // Event at which the allocation was made
+        size_t end = end_of_step; // Event at which it was released
+        size_t offset = 0; // Offset in the slab, assigned by plan()
+    };
+
+    // Drop the recorded trace and any plan
+    void clear();
+
+    // Record an allocation at the current event and return its index in the step
+    size_t record_allocation(size_t bytes);
+
+    // Record the release of an allocation made earlier in the same step
+    void record_release(size_t index);
+
+    // Assign slab offsets to the recorded allocations, returning the slab size in bytes
+    size_t plan();
+
+    // Whether the index-th allocation of a replayed step matches the recorded size and event
+    bool expects_allocation(size_t index, size_t bytes, size_t event) const;
+
+    // Whether releasing the index-th allocation at this event matches the recorded trace
+    bool expects_release(size_t index, size_t event) const;
+
+    const std::vector<Allocation>& allocations() const { return allocations_; }
+    size_t offset(size_t index) const { return allocations_[index].offset; }
+    size_t events() const { return events_; }
+
+private:
+    std::vector<Allocation> allocations_;
+    size_t events_ = 0;
+};
+
+#endif // MEMORY_PLANNER_H
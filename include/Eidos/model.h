@@ -7,12 +7,15 @@
 #include <Eigen/Dense>
 #include <vector>
 #include <memory>
+#include <mutex>
 #include "layer.h"
 #include "optimizer.h"
 #include "loss.h"
 #include "callback.h"
 #include "tensor.hpp"
 #include "preprocessors.h"
+#include "arena.h"
+#include "allocator.h"
 
 /**
  * @class Model
@@ -29,6 +32,69 @@ private:
     Optimizer* optimizer; // Pointer to the optimizer used for training the model
     Loss* loss_function; // Pointer to the loss function used for training the model
     bool training = true;
+    // Backs every intermediate tensor of one training step and is reset by optimize().
+    // The first step is recorded and later steps run out of one statically planned slab.
+    Arena arena{Arena::default_block_size, true};
+    size_t step_bytes = 0; // Bytes taken from the arena during the last completed step
+    Layout layout = Layout::NCHW; // Layout requested with set_layout(), ignored while auto_layout is set
+    bool auto_layout = true;
+    Layout working_layout = Layout::NCHW; // Layout the layers run in, worked out by plan_layout() when the layers change
+    Layout output_layout = Layout::NCHW; // Layout the last layer produced in the last forward pass
+
+    // Convolutions with at least this many input channels reduce over enough channels to favour NHWC
+    static constexpr int nhwc_min_channels = 8;
+
+    // Whether every layer up to the first Flatten (or every layer without one) handles the layout
+    bool supports_layout(Layout layout) const;
+    Layout choose_layout() const;
+    void plan_layout();
+
+    // Layers run in inference mode, with every Conv2D -> element-wise activation (-> MaxPooling2D)
+    // sequence replaced by a FusedConv2D. Built on the first inference pass, cleared when the layers change.
+    std::vector<Layer*> inference_plan;
+    std::vector<std::unique_ptr<Layer> > fused_layers; // The FusedConv2D operators of the plan
+    void plan_inference();
+
+    // Runs the layers inside the arena without resetting it or copying the output out of it
+    Tensor forward_pass(const Tensor& input);
+
+    // Copies of the layers for data-parallel training, the model itself is replica 0. Each replica
+    // has its own arena, the loss function is shared and used by one replica at a time.
+    std::vector<std::unique_ptr<Model> > replicas;
+    std::mutex loss_mutex;
+
+    // Clones the layers into num_replicas - 1 replicas, or brings the replicas of the last call up to date,
+    // and returns the number of replicas to train on, 1 when the layers cannot be cloned or when the
+    // replicas split the rows of each batch (split_rows) and a recurrent layer reads them as time steps
+    int prepare_replicas(int num_replicas, bool split_rows = true);
+    Model& replica(int index) { return index == 0 ? *this : *replicas[index - 1]; }
+
+    // Copies the weights and biases of the layers into the layers of a replica
+    void copy_parameters(Model& copy) const;
+
+    /**
+     * One data-parallel step: replica r runs forward on inputs[r], the loss of the whole batch is taken
+     * on the outputs of all the replicas, replica r runs backward on its rows of the loss gradient, the
+     * gradients are summed into this model with a tree reduction, the optimizer updates this model and
+     * the new parameters are copied to the other replicas. Returns the loss of the batch.
+     */
+    float parallel_step(const std::vector<Tensor>& inputs, const Tensor& targets);
+
+    // Runs layers [first, last) of path, the model's layers or copies of them, forward or backward, as one
+    // stage of a pipeline. The first layer of the model converts the input to the working layout and the
+    // last one converts its output to NCHW, as forward_pass() does.
+    Tensor forward_layers(const std::vector<Layer*>& path, Tensor input, size_t first, size_t last);
+    Tensor backward_layers(const std::vector<Layer*>& path, Tensor grad, size_t first, size_t last);
+
+    // Boundaries of at most num_stages runs of consecutive layers with about the same number of parameters
+    std::vector<size_t> split_stages(int num_stages) const;
+
+    // Micro-batches a pipeline stage can run ahead of the next one
+    static constexpr size_t pipeline_queue_capacity = 2;
+
+    // Sums the gradients of the first count replicas into this model with a tree reduction and scales
+    // the sum, takes one optimizer step and copies the new parameters to every replica
+    void all_reduce_step(int count, float scale = 1.0f);
 
 public:
 
@@ -88,6 +154,9 @@ public:
      * @param input The input matrix of size (n, m) where n is the number of samples
      * and m is the number of features.
      * @return Eigen::MatrixXf The output matrix after the forward pass.
+     * 
+     * @note Intermediate tensors are allocated from an arena owned by the model, which
+     * this call resets first. The returned tensor is a heap copy and stays valid.
      */
     Tensor forward(const Tensor& input);
 
@@ -115,8 +184,28 @@ public:
      * This function performs optimization on the model parameters to improve 
      * performance. The specific optimization algorithm and its details are 
      * implementation-dependent.
+     * 
+     * This marks the end of a training step: the arena holding the step's activations
+     * and gradients is reset, and its usage is recorded for `bytes_per_step()`.
+     */
+    void optimize();
+
+    /**
+     * @brief Returns the number of bytes carved from the model's arena during the last training step.
+     * 
+     * This covers every intermediate tensor created by the forward and backward passes
+     * between two calls to `optimize()`, including alignment padding.
      */
-    void optimize() const;
+    size_t bytes_per_step() const { return step_bytes; }
+
+    /**
+     * @brief Returns the size of the slab planned for the intermediate tensors of a step.
+     * 
+     * After the first step, the lifetimes of all intermediate tensors are known and they are
+     * packed into one slab in which tensors that are never alive together share memory. Later
+     * steps allocate nothing. This is 0 until the first step has completed.
+     */
+    size_t planned_bytes() const { return arena.slab_size(); }
 
     /**
      * @brief Sets the model to training mode.
@@ -136,7 +225,9 @@ public:
      *
      * This function configures the model to operate in inference mode,
      * which is typically used for making predictions or classifications
-     * based on the trained model.
+     * based on the trained model. Each Conv2D followed by an element-wise
+     * activation, and optionally a MaxPooling2D, then runs as one fused
+     * operator (see FusedConv2D).
      * 
      * @note This function should be called before using the model for
      * inference if you are using manual inference loop. Otherwise, the
@@ -144,6 +235,50 @@ public:
      */
     void set_inference();
 
+    /**
+     * @brief Sets the storage precision of every layer in the model.
+     *
+     * With fp16 or bf16, layers that support it (Dense, RNN) keep the activations cached for
+     * the backward pass in reduced precision, and Dense layers read reduced-precision copies of
+     * their weights during inference. Trainable weights, gradients and all accumulation stay in fp32.
+     *
+     * @param precision The storage precision.
+     * 
+     * @note Call this after all layers have been added.
+     */
+    void set_precision(Precision precision);
+
+    /**
+     * @brief Opts in to transparent huge pages for large buffers (Linux only).
+     *
+     * Tensor buffers and arena blocks of at least `threshold` bytes allocated from now on are placed on
+     * 2MB pages, and the weight and gradient matrices of the current layers that are at least that large
+     * are advised to use them too. This cuts TLB misses on large models. Allocation counters, including
+     * how many bytes went to huge pages, are available through `Allocator::stats()`.
+     *
+     * @param threshold The smallest buffer, in bytes, to place on huge pages.
+     * 
+     * @note Call this after all layers have been added.
+     */
+    void enable_huge_pages(size_t threshold = Allocator::huge_page_size);
+
+    /**
+     * @brief Sets the memory layout the convolutional part of the network runs in.
+     *
+     * By default the model picks the layout itself: channels last (NHWC) when every layer before
+     * the first Flatten supports it and most of the convolution weights belong to layers with
+     * many input channels, channels first (NCHW) otherwise. Inputs are given in NCHW either way,
+     * the model converts them and Flatten converts back, so results do not depend on the layout.
+     *
+     * @param layout The layout to use. NHWC is ignored if a layer in the network does not support it.
+     */
+    void set_layout(Layout layout);
+
+    /**
+     * @brief Returns the layout the convolutional part of the network runs in.
+     */
+    Layout get_layout() const;
+
     /**
      * @brief Trains the model using the provided training data and labels.
      * 
@@ -156,23 +291,110 @@ public:
      * @param epochs The number of epochs to train the model.
      * @param loss_function The loss function to be used during training.
      * @param optimizer An optional optimizer to be used during training. If not provided, a default optimizer will be used.
+     * @param callbacks Callbacks notified at the end of every epoch.
+     * @param num_replicas The number of model replicas the rows of each batch are split across (see below).
+     *
+     * With more than one replica, training is data parallel: the layers are copied into num_replicas
+     * replicas that run forward and backward on their share of the rows of each batch at the same time,
+     * on ThreadPool::global(). The loss is taken once on the outputs of the whole batch and each replica
+     * runs backward on its rows of its gradient, so the gradients summed into this model match the
+     * gradient of the whole batch and so does the optimizer step. The new parameters are
+     * then copied to the replicas. Rows must be samples, so models with recurrent layers (whose rows
+     * are time steps) and layers that cannot be cloned train on one replica.
+     *
+     * @note BatchNorm normalizes each replica's rows with their own statistics, and only this model's
+     * running statistics are updated.
      */
     void Train(const Tensor& training_data, const Tensor& training_labels, 
         int epochs, Loss* loss_function = nullptr, Optimizer* optimizer=nullptr,
-        std::vector<Callback*> callbacks=std::vector<Callback*>());
+        std::vector<Callback*> callbacks=std::vector<Callback*>(), int num_replicas = 1);
 
     /**
-     * @brief Tests the model using the provided testing data and labels.
+     * @brief Trains the model asynchronously, Hogwild style, on several worker threads.
+     *
+     * Each worker takes the next batch of the epoch, runs forward and backward on its own copy of the
+     * layers (with its own caches and gradients, reading the model's weights in place, see
+     * Layer::share_parameters()), and applies the SGD update straight to the model's weights without
+     * locking (see SGD::update()). Workers do not wait for each other between batches, only at the end
+     * of every epoch.
+     *
+     * @warning Convergence is not that of synchronous training. A worker's gradient is computed on weights
+     * that other workers may have updated since, and concurrent updates of the same weight can be lost.
+     * This works well when each batch updates only a small part of the weights, such as MLPs on sparse
+     * tabular data, and may need a smaller learning rate as workers are added. Results are not
+     * reproducible from run to run. Layers with statistics (BatchNorm) and layers that cannot be
+     * cloned are not suited, the latter make the model train on one worker.
+     *
+     * @param training_data A tensor with one batch per matrix, as for Train().
+     * @param training_labels A tensor with the labels of each batch.
+     * @param epochs The number of epochs to train the model.
+     * @param loss_function The loss function to be used during training.
+     * @param optimizer The SGD optimizer, or nullptr to use the model's optimizer if it is an SGD.
+     * @param callbacks Callbacks notified at the end of every epoch.
+     * @param num_workers The number of worker threads, or 0 for one per thread of ThreadPool::global().
+     */
+    void TrainAsync(const Tensor& training_data, const Tensor& training_labels,
+        int epochs, Loss* loss_function = nullptr, SGD* optimizer = nullptr,
+        std::vector<Callback*> callbacks=std::vector<Callback*>(), int num_workers = 0);
+
+    /**
+     * @brief Trains the model with the layers split into pipeline stages that run on their own threads.
+     *
+     * The layers are cut into num_stages stages of consecutive layers with about the same number of
+     * parameters. Each stage runs on a thread of its own, pinned to a core where the platform allows it,
+     * and hands its output to the next stage through a bounded queue. The rows of each batch are split
+     * into micro_batches micro-batches that stream through the stages (GPipe), so stage s works on
+     * micro-batch m while stage s + 1 works on micro-batch m - 1. The loss is taken on the whole batch
+     * once all of them are through, then the gradients run back the other way, last micro-batch first.
+     * Each stage adds the gradients of every micro-batch into its layers in place, and the optimizer
+     * takes one step per batch, which makes it the step Train() takes on the batch.
+     *
+     * Every micro-batch in flight keeps its activations in its own copies of the layers, which read the
+     * model's parameters in place (see Layer::share_parameters()). Layers that cannot be cloned make
+     * every step a single micro-batch. Recurrent layers read the rows of a batch as the time steps of one
+     * sequence, so with them every batch is one micro-batch and micro_batches consecutive batches form a
+     * step, which is one step on the sequences put together.
+     *
+     * This gives parallelism across layers to models whose layers are too small to run in parallel
+     * themselves, such as stacks of GRU and Dense layers.
+     *
+     * @note BatchNorm normalizes each micro-batch with its own statistics, and the model's running
+     * statistics are not updated.
+     *
+     * @param training_data A tensor with one batch per matrix, as for Train().
+     * @param training_labels A tensor with the labels of each batch.
+     * @param epochs The number of epochs to train the model.
+     * @param loss_function The loss function to be used during training.
+     * @param optimizer An optional optimizer to be used during training.
+     * @param callbacks Callbacks notified at the end of every epoch.
+     * @param num_stages The number of pipeline stages, at most the number of layers.
+     * @param micro_batches The number of micro-batches each batch is split into (consecutive sequences
+     *        per step with recurrent layers).
+     */
+    void TrainPipeline(const Tensor& training_data, const Tensor& training_labels,
+        int epochs, Loss* loss_function = nullptr, Optimizer* optimizer = nullptr,
+        std::vector<Callback*> callbacks=std::vector<Callback*>(), int num_stages = 2, int micro_batches = 4);
+
+    /**
+     * @brief Trains the model on image data in mini-batches.
      * 
-     * @note This assumes that the data is not batched for training. It 
-     * treats each Tensor as a single image. There is no batching.
+     * Each Tensor in the dataset is treated as a single (C x H x W) image. Every
+     * `batch_size` consecutive images are stacked into one (N x C x H x W) tensor
+     * and their targets into a single (N x classes) matrix, so each optimizer step
+     * sees the mean gradient over the batch. The last batch may be smaller.
      * 
      * @param data A ImageInputData object containing the training input and labels.
+     * @param epochs The number of epochs to train the model.
+     * @param loss_function The loss function to be used during training.
+     * @param optimizer An optional optimizer to be used during training.
+     * @param callbacks Callbacks notified at the end of every epoch.
+     * @param batch_size The number of images per optimizer step (defaults to 1).
+     * @param num_replicas The number of model replicas the images of each batch are split across,
+     *        see the Tensor overload of Train().
      */
-    
     void Train(const ImageInputData& data,
         int epochs, Loss* loss_function = nullptr, Optimizer* optimizer=nullptr,
-        std::vector<Callback*> callbacks=std::vector<Callback*>());
+        std::vector<Callback*> callbacks=std::vector<Callback*>(), int batch_size = 1, int num_replicas = 1);
 
     /**
      * @brief Tests the model using the provided testing data and labels.
@@ -63,6 +63,20 @@ public:
 
     void optimize(Layer& layer) override;
 
+    /**
+     * @brief Updates the parameters of a layer with the gradients of a copy of it.
+     *
+     * Used by asynchronous training (see Model::TrainAsync), where workers apply the gradients of
+     * their own copies of the layers to the shared layers without locking. Only the rows of parameters
+     * with a nonzero gradient are written, which for a Dense layer are the weights of the inputs that
+     * are nonzero in the batch, so workers whose sparse inputs touch different weights do not overwrite
+     * each other's updates.
+     *
+     * @param layer The layer whose parameters are updated.
+     * @param gradients A layer of the same shape holding the gradients.
+     */
+    void update(Layer& layer, Layer& gradients);
+
     std::string get_name() const override { return "SGD"; }
 
     void serialize(std::ofstream& toFileStream) const override {
@@ -0,0 +1,122 @@
+#ifndef PRECISION_H
+#define PRECISION_H
+
+#include <Eigen/Dense>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * @enum Precision
+ * @brief Storage precision for weights and cached activations.
+ *
+ * FP16 (IEEE half) keeps more mantissa bits, BF16 (bfloat16) keeps the fp32 exponent range.
+ * Both halve the memory and bandwidth of what they store. Arithmetic always accumulates in fp32.
+ */
+enum class Precision { FP32, FP16, BF16 };
+
+std::string precision_name(Precision precision);
+
+/**
+ * @class CompactMatrix
+ * @brief A matrix stored in fp32, fp16 or bf16 that is consumed in fp32.
+ *
+ * Values are converted to the storage precision when stored. Products read the matrix in
+ * panels of rows that are widened to fp32 into a small scratch buffer (Eigen's cast, which
+ * converts whole SIMD packets where the CPU supports it) and are multiplied with fp32
+ * accumulation, so the full fp32 matrix is never materialized.
+ */
+class CompactMatrix {
+public:
+    using HalfMatrix = Eigen::Matrix<Eigen::half, Eigen::Dynamic, Eigen::Dynamic>;
+    using BFloat16Matrix = Eigen::Matrix<Eigen::bfloat16, Eigen::Dynamic, Eigen::Dynamic>;
+
+    explicit CompactMatrix(Precision precision = Precision::FP32) : precision_(precision) {}
+
+    // Change the storage precision, converting any values already stored
+    void set_precision(Precision precision);
+    Precision precision() const { return precision_; }
+
+    // Store values, converting them to the storage precision
+    template <typename Derived>
+    void store(const Eigen::MatrixBase<Derived>& values) {
+        switch (precision_) {
+            case Precision::FP32: fp32_ = values; break;
+            case Precision::FP16: fp16_ = values.template cast<Eigen::half>(); break;
+            case Precision::BF16: bf16_ = values.template cast<Eigen::bfloat16>(); break;
+        }
+    }
+
+    // Read all values back in fp32
+    Eigen::MatrixXf load() const;
+
+    // Read one row back in fp32, as a column vector
+    Eigen::VectorXf row(Eigen::Index index) const;
+
+    Eigen::Index rows() const;
+    Eigen::Index cols() const;
+
+    // Bytes used by the stored values
+    size_t bytes() const;
+
+    void clear();
+
+    /**
+     * @brief Computes lhs * M with fp32 accumulation.
+     *
+     * @param lhs A fp32 matrix with as many columns as this matrix has rows.
+     * @return Eigen::MatrixXf The product in fp32.
+     */
+    template <typename Derived>
+    Eigen::MatrixXf multiply(const Eigen::MatrixBase<Derived>& lhs) const {
+        if (precision_ == Precision::FP32) {
+            return lhs * fp32_;
+        }
+        Eigen::MatrixXf result = Eigen::MatrixXf::Zero(lhs.rows(), cols());
+        Eigen::MatrixXf& panel = scratch();
+        for (Eigen::Index begin = 0; begin < rows(); begin += panel_rows()) {
+            Eigen::Index count = std::min(panel_rows(), rows() - begin);
+            load_rows(begin, count, panel);
+            result.noalias() += lhs.middleCols(begin, count) * panel;
+        }
+        return result;
+    }
+
+    /**
+     * @brief Computes M^T * rhs with fp32 accumulation.
+     *
+     * @param rhs A fp32 matrix with as many rows as this matrix.
+     * @return Eigen::MatrixXf The product in fp32.
+     */
+    template <typename Derived>
+    Eigen::MatrixXf transpose_multiply(const Eigen::MatrixBase<Derived>& rhs) const {
+        if (precision_ == Precision::FP32) {
+            return fp32_.transpose() * rhs;
+        }
+        Eigen::MatrixXf result = Eigen::MatrixXf::Zero(cols(), rhs.cols());
+        Eigen::MatrixXf& panel = scratch();
+        for (Eigen::Index begin = 0; begin < rows(); begin += panel_rows()) {
+            Eigen::Index count = std::min(panel_rows(), rows() - begin);
+            load_rows(begin, count, panel);
+            result.noalias() += panel.transpose() * rhs.middleRows(begin, count);
+        }
+        return result;
+    }
+
+private:
+    // Rows per fp32 panel, sized so a panel stays around 64KB and in the L2 cache
+    Eigen::Index panel_rows() const;
+
+    // Widen rows [begin, begin + count) into panel
+    void load_rows(Eigen::Index begin, Eigen::Index count, Eigen::MatrixXf& panel) const;
+
+    // Per-thread panel buffer, reused across calls so widening does not allocate
+    static Eigen::MatrixXf& scratch();
+
+    Precision precision_;
+    Eigen::MatrixXf fp32_;
+    HalfMatrix fp16_;
+    BFloat16Matrix bf16_;
+};
+
+#endif // PRECISION_H
@@ -3,66 +3,461 @@
 
 #include <Eigen/Dense>
 #include <vector>
+#include <tuple>
+#include <iterator>
 #include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <type_traits>
+#include "arena.h"
+#include "allocator.h"
+
+/**
+ * @enum Layout
+ * @brief Memory order of a batched image tensor.
+ *
+ * NCHW (channels first) stores every channel as a contiguous row-major plane, which is what
+ * channel access and most layers work on. NHWC (channels last) stores the channels of each
+ * pixel next to each other, so reductions over input channels (convolution) and per-pixel
+ * operations across channels (pooling) run over unit-stride memory.
+ */
+enum class Layout { NCHW, NHWC };
+
+/**
+ * @struct TensorShape
+ * @brief The dimensions and layout of a tensor, shared by tensors and tensor expressions.
+ */
+struct TensorShape {
+    size_t batch;
+    size_t depth;
+    size_t rows;
+    size_t cols;
+    Layout layout;
+
+    size_t size() const { return batch * depth * rows * cols; }
+
+    bool operator==(const TensorShape& other) const {
+        return batch == other.batch && depth == other.depth && rows == other.rows &&
+               cols == other.cols && layout == other.layout;
+    }
+    bool operator!=(const TensorShape& other) const { return !(*this == other); }
+
+    // The shape of an element-wise operation on two operands, which must match
+    static const TensorShape& common(const TensorShape& lhs, const TensorShape& rhs) {
+        if (lhs != rhs) {
+            throw std::invalid_argument("Tensors must have the same shape and layout for element-wise operations.");
+        }
+        return lhs;
+    }
+};
+
+/**
+ * @class TensorExpression
+ * @brief A lazily evaluated element-wise expression over tensors, such as a * 2.0f + b.
+ *
+ * Arithmetic on tensors returns an expression instead of a tensor. It wraps an Eigen array
+ * expression over the operands' contiguous buffers, so nothing is computed or allocated until
+ * the expression is assigned to a Tensor. The whole expression is then evaluated in a single
+ * vectorized loop into one output buffer, however many operations it combines.
+ *
+ * Like Eigen expressions, an expression refers to the buffers of its operands and must not
+ * outlive them, so do not store one in an `auto` variable whose operands are temporaries.
+ */
+template <typename Expr>
+class TensorExpression {
+public:
+    TensorExpression(const Expr& expression, const TensorShape& shape) : expression_(expression), shape_(shape) {}
+
+    // The element-wise Eigen array expression over the flat buffers of the operands
+    const Expr& array() const { return expression_; }
+
+    const TensorShape& tensor_shape() const { return shape_; }
+
+private:
+    Expr expression_;
+    TensorShape shape_;
+};
 
+class Tensor;
+
+// Whether T can appear in element-wise tensor arithmetic (a Tensor or a TensorExpression)
+template <typename T>
+struct is_tensor_operand : std::false_type {};
+
+template <>
+struct is_tensor_operand<Tensor> : std::true_type {};
+
+template <typename Expr>
+struct is_tensor_operand<TensorExpression<Expr>> : std::true_type {};
+
+/**
+ * @class Tensor
+ * @brief A 3D tensor (depth x rows x cols), optionally batched to 4D (batch x depth x rows x cols),
+ * backed by a single contiguous buffer.
+ *
+ * All channels live back to back in one aligned allocation. Each channel is stored
+ * in row-major (C) order, so element (d, r, c) sits at offset (d * rows + r) * cols + c.
+ * Batched tensors use NCHW order: sample n occupies the channels n * depth to (n + 1) * depth - 1.
+ * A tensor can instead be laid out channels last (NHWC, see Layout and to_layout()), in which case
+ * element (n, d, r, c) sits at offset ((n * rows + r) * cols + c) * depth + d. Channel access
+ * requires NCHW; the 4D element accessor, pixel() and the whole-buffer operations work with both.
+ * Channel access returns an Eigen::Map view into the buffer instead of an owning matrix,
+ * which keeps allocation count per tensor at one and lets whole-tensor operations run
+ * as a single vectorized sweep over the buffer.
+ *
+ * A tensor can also be a non-owning view of another tensor's buffer (see view() and slice()).
+ * Views are O(1) to create and never allocate. Moving a view keeps it a view, while copying
+ * a view (or copy-assigning into one) produces an owning deep copy, so a layer that caches
+ * its input never ends up holding a dangling view. A view must not outlive the tensor it borrows from.
+ *
+ * Heap buffers come from Allocator, so they are aligned to a cache line and can be placed on huge pages.
+ * Tensors that allocate while an Arena is current on the calling thread (see Arena::Scope) take
+ * their buffer from the arena instead of the heap. Copy-assignment always stores into a heap
+ * buffer owned by the target, so long-lived tensors such as layer caches stay valid after the arena is reset.
+ */
 class Tensor {
 public:
+    // Row-major matrix type matching the memory order of a single channel
+    using Matrix = Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+    using ChannelMap = Eigen::Map<Matrix>;
+    using ConstChannelMap = Eigen::Map<const Matrix>;
+
+    /**
+     * @brief Forward iterator over the channels of a tensor, yielding mapped channel views.
+     */
+    template <typename MapType, typename Pointer>
+    class ChannelIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = MapType;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = MapType;
+
+        ChannelIterator(Pointer ptr, size_t rows, size_t cols) : ptr_(ptr), rows_(rows), cols_(cols) {}
+
+        MapType operator*() const { return MapType(ptr_, rows_, cols_); }
+        ChannelIterator& operator++() { ptr_ += rows_ * cols_; return *this; }
+        ChannelIterator operator++(int) { ChannelIterator tmp = *this; ++(*this); return tmp; }
+        bool operator==(const ChannelIterator& other) const { return ptr_ == other.ptr_; }
+        bool operator!=(const ChannelIterator& other) const { return ptr_ != other.ptr_; }
+
+    private:
+        Pointer ptr_;
+        size_t rows_;
+        size_t cols_;
+    };
+
+    using iterator = ChannelIterator<ChannelMap, float*>;
+    using const_iterator = ChannelIterator<ConstChannelMap, const float*>;
+
     // Constructor for an empty tensor
     Tensor() = default;
 
-    // Constructor to initialize a tensor with a specific number of matrices
+    // Copying always produces an owning tensor, even when the source is a view
+    Tensor(const Tensor& other)
+        : batch_(other.batch_), depth_(other.depth_), rows_(other.rows_), cols_(other.cols_), layout_(other.layout_) {
+        allocate(other.size(), false);
+        std::copy(other.data(), other.data() + other.size(), data());
+    }
+
+    Tensor& operator=(const Tensor& other) {
+        if (this == &other) {
+            return *this;
+        }
+        if (storage_ == Storage::Owned && other.data() == data()) {
+            // Assigning a view of this tensor back to it, the buffer already holds the values
+            batch_ = other.batch_; depth_ = other.depth_; rows_ = other.rows_; cols_ = other.cols_;
+            layout_ = other.layout_;
+            return *this;
+        }
+        release();
+        data_.assign(other.data(), other.data() + other.size()); // Reuses the buffer if it is large enough
+        batch_ = other.batch_;
+        depth_ = other.depth_;
+        rows_ = other.rows_;
+        cols_ = other.cols_;
+        layout_ = other.layout_;
+        return *this;
+    }
+
+    // Moving keeps the ownership mode: a moved view is still a view of the same buffer.
+    // The moved-from tensor is left empty.
+    Tensor(Tensor&& other) noexcept
+        : batch_(other.batch_), depth_(other.depth_), rows_(other.rows_), cols_(other.cols_),
+          layout_(other.layout_), data_(std::move(other.data_)), storage_(other.storage_), external_(other.external_),
+          arena_(other.arena_), arena_id_(other.arena_id_) {
+        other.forget();
+    }
+
+    Tensor& operator=(Tensor&& other) noexcept {
+        if (this != &other) {
+            release();
+            batch_ = other.batch_;
+            depth_ = other.depth_;
+            rows_ = other.rows_;
+            cols_ = other.cols_;
+            layout_ = other.layout_;
+            data_ = std::move(other.data_);
+            storage_ = other.storage_;
+            external_ = other.external_;
+            arena_ = other.arena_;
+            arena_id_ = other.arena_id_;
+            other.forget();
+        }
+        return *this;
+    }
+
+    // Arena-backed tensors report their release so the arena can plan buffer reuse
+    ~Tensor() {
+        release();
+    }
+
+    // Constructor to initialize a zero tensor with the given dimensions
     Tensor(size_t depth, size_t rows, size_t cols)
-        : data_(depth, Eigen::MatrixXf::Zero(rows, cols)) {}
+        : depth_(depth), rows_(rows), cols_(cols) {
+        allocate(size(), true);
+    }
 
-    // Constructor to initialize a tensor with a vector of dimensions
+    // Constructor to initialize a zero batched tensor (batch x depth x rows x cols) in the given layout
+    Tensor(size_t batch, size_t depth, size_t rows, size_t cols, Layout layout = Layout::NCHW)
+        : batch_(batch), depth_(depth), rows_(rows), cols_(cols), layout_(layout) {
+        allocate(size(), true);
+    }
+
+    // Constructor to initialize a tensor with a vector of dimensions, either {depth, rows, cols} or {batch, depth, rows, cols}
     Tensor(const std::vector<int>& dimensions) {
-        if (dimensions.size() != 3) {
-            throw std::invalid_argument("Dimensions vector must have exactly 3 elements.");
+        if (dimensions.size() == 3) {
+            resize(dimensions[0], dimensions[1], dimensions[2]);
+        } else if (dimensions.size() == 4) {
+            resize(dimensions[0], dimensions[1], dimensions[2], dimensions[3]);
+        } else {
+            throw std::invalid_argument("Dimensions vector must have exactly 3 or 4 elements.");
         }
-        size_t depth = dimensions[0];
-        size_t rows = dimensions[1];
-        size_t cols = dimensions[2];
-        data_.resize(depth, Eigen::MatrixXf::Zero(rows, cols));
     }
 
-    // Constructor to initialize from a single matrix
-    explicit Tensor(const Eigen::MatrixXf& matrix) {
-        data_.push_back(matrix);
+    // Constructor to initialize from a single matrix (or any Eigen expression)
+    template <typename Derived>
+    explicit Tensor(const Eigen::DenseBase<Derived>& matrix)
+        : depth_(1), rows_(matrix.rows()), cols_(matrix.cols()) {
+        allocate(size(), false);
+        (*this)[0] = matrix.derived();
+    }
+
+    // Evaluates a tensor expression (e.g. a * 2.0f + b) into a new buffer in a single sweep
+    template <typename Expr>
+    Tensor(const TensorExpression<Expr>& expression)
+        : batch_(expression.tensor_shape().batch), depth_(expression.tensor_shape().depth),
+          rows_(expression.tensor_shape().rows), cols_(expression.tensor_shape().cols),
+          layout_(expression.tensor_shape().layout) {
+        allocate(size(), false);
+        array() = expression.array();
     }
 
-    // Constructor to initialize from a vector of matrices
-    explicit Tensor(const std::vector<Eigen::MatrixXf>& matrices)
-        : data_(matrices) {}
+    // Evaluates a tensor expression into this tensor. Like copy-assignment, the result is stored in a
+    // heap buffer owned by this tensor, which is reused when the shape matches.
+    template <typename Expr>
+    Tensor& operator=(const TensorExpression<Expr>& expression) {
+        const TensorShape& shape = expression.tensor_shape();
+        if (storage_ == Storage::Owned && shape == tensor_shape()) {
+            // Every element only reads the same position of its operands, so the expression
+            // may read this tensor while it is overwritten
+            array() = expression.array();
+            return *this;
+        }
+        // Evaluate before the current buffer is released, the expression may still read from it
+        Buffer buffer(shape.size());
+        Eigen::Map<Eigen::ArrayXf>(buffer.data(), buffer.size()) = expression.array();
+        release();
+        data_.swap(buffer);
+        batch_ = shape.batch;
+        depth_ = shape.depth;
+        rows_ = shape.rows;
+        cols_ = shape.cols;
+        layout_ = shape.layout;
+        return *this;
+    }
+
+    // Constructor to initialize from a vector of matrices, all of which must share one shape
+    explicit Tensor(const std::vector<Eigen::MatrixXf>& matrices) {
+        for (const auto& matrix : matrices) {
+            push_back(matrix);
+        }
+    }
 
-    // Access element by depth and indices (const and non-const)
-    Eigen::MatrixXf& operator[](size_t index) {
-        if (index < 0 || index >= data_.size()) {
+    // Access a channel by depth as a mapped view (const and non-const).
+    // For batched tensors the index runs over all batch * depth channels (n * depth + c).
+    ChannelMap operator[](size_t index) {
+        if (index >= num_matrices()) {
             throw std::out_of_range("Index out of range.");
         }
-        return data_[index];
+        require_channels_first();
+        return ChannelMap(channel_data(index), rows_, cols_);
     }
 
-    const Eigen::MatrixXf& operator[](size_t index) const {
-        if (index < 0 || index >= data_.size()) {
+    ConstChannelMap operator[](size_t index) const {
+        if (index >= num_matrices()) {
             throw std::out_of_range("Index out of range.");
         }
-        return data_[index];
+        require_channels_first();
+        return ConstChannelMap(channel_data(index), rows_, cols_);
     }
 
-    // Access element by depth, row, and column (const and non-const)
+    // Access element by depth, row, and column (const and non-const). Assumes NCHW.
     float& operator()(size_t depth, size_t row, size_t col) {
-        return data_[depth](row, col);
+        return data()[(depth * rows_ + row) * cols_ + col];
     }
 
-    // Get the depth (number of matrices)
+    float operator()(size_t depth, size_t row, size_t col) const {
+        return data()[(depth * rows_ + row) * cols_ + col];
+    }
+
+    // Access element by sample, depth, row, and column in either layout (const and non-const)
+    float& operator()(size_t sample, size_t depth, size_t row, size_t col) {
+        return data()[offset(sample, depth, row, col)];
+    }
+
+    float operator()(size_t sample, size_t depth, size_t row, size_t col) const {
+        return data()[offset(sample, depth, row, col)];
+    }
+
+    // Access the channels of one pixel of a channels-last (NHWC) tensor as a contiguous vector
+    Eigen::Map<Eigen::VectorXf> pixel(size_t sample, size_t row, size_t col) {
+        require_channels_last();
+        return Eigen::Map<Eigen::VectorXf>(data() + offset(sample, 0, row, col), depth_);
+    }
+
+    Eigen::Map<const Eigen::VectorXf> pixel(size_t sample, size_t row, size_t col) const {
+        require_channels_last();
+        return Eigen::Map<const Eigen::VectorXf>(data() + offset(sample, 0, row, col), depth_);
+    }
+
+    // Access a channel of a single sample in a batched tensor
+    ChannelMap channel(size_t sample, size_t depth) {
+        return (*this)[sample * depth_ + depth];
+    }
+
+    ConstChannelMap channel(size_t sample, size_t depth) const {
+        return (*this)[sample * depth_ + depth];
+    }
+
+    // Get the depth (number of matrices per sample)
     size_t depth() const {
-        return data_.size();
+        return depth_;
     }
 
+    // Get the batch size (1 for unbatched tensors)
+    size_t batch() const {
+        return batch_;
+    }
+
+    // Total number of matrices stored, across all samples
+    size_t num_matrices() const {
+        return batch_ * depth_;
+    }
+
+    size_t rows() const { return rows_; }
+    size_t cols() const { return cols_; }
+
+    // Total number of elements in the tensor
+    size_t size() const { return batch_ * depth_ * rows_ * cols_; }
+
     // Get the shape (returns {depth, rows, cols})
     std::tuple<size_t, size_t, size_t> shape() const {
-        if (data_.empty()) return {0, 0, 0};
-        return {data_.size(), data_[0].rows(), data_[0].cols()};
+        if (depth_ == 0) return {0, 0, 0};
+        return {depth_, rows_, cols_};
+    }
+
+    // Get the batched shape (returns {batch, depth, rows, cols})
+    std::tuple<size_t, size_t, size_t, size_t> batch_shape() const {
+        if (depth_ == 0) return {0, 0, 0, 0};
+        return {batch_, depth_, rows_, cols_};
+    }
+
+    // Get the element strides (returns {depth, row, col} strides)
+    std::tuple<size_t, size_t, size_t> strides() const {
+        if (layout_ == Layout::NHWC) {
+            return {1, cols_ * depth_, depth_};
+        }
+        return {rows_ * cols_, cols_, 1};
+    }
+
+    // Memory order of the buffer
+    Layout layout() const { return layout_; }
+
+    // Dimensions and layout, as used by tensor expressions
+    TensorShape tensor_shape() const { return {batch_, depth_, rows_, cols_, layout_}; }
+
+    // Copy of this tensor with its buffer rearranged into the given layout (a plain copy if it already matches)
+    Tensor to_layout(Layout layout) const {
+        Tensor result(batch_, depth_, rows_, cols_, layout);
+        if (layout == layout_) {
+            std::copy(data(), data() + size(), result.data());
+            return result;
+        }
+        // Per sample, an NCHW buffer is a (depth x pixels) row-major matrix and NHWC is its transpose
+        using SampleMap = Eigen::Map<const Matrix>;
+        using ResultMap = Eigen::Map<Matrix>;
+        size_t pixels = rows_ * cols_;
+        size_t sample_size = depth_ * pixels;
+        for (size_t n = 0; n < batch_; ++n) {
+            if (layout == Layout::NHWC) {
+                ResultMap(result.data() + n * sample_size, pixels, depth_) =
+                    SampleMap(data() + n * sample_size, depth_, pixels).transpose();
+            } else {
+                ResultMap(result.data() + n * sample_size, depth_, pixels) =
+                    SampleMap(data() + n * sample_size, pixels, depth_).transpose();
+            }
+        }
+        return result;
+    }
+
+    // Conversion shorthands for to_layout()
+    Tensor to_nhwc() const { return to_layout(Layout::NHWC); }
+    Tensor to_nchw() const { return to_layout(Layout::NCHW); }
+
+    // Raw pointer to the contiguous buffer (owned, borrowed or arena-backed)
+    float* data() { return external_ ? external_ : data_.data(); }
+    const float* data() const { return external_ ? external_ : data_.data(); }
+
+    // Whether this tensor borrows its buffer from another tensor
+    bool is_view() const { return storage_ == Storage::View; }
+
+    // Whether this tensor's buffer was carved from an arena
+    bool is_arena_backed() const { return storage_ == Storage::Arena; }
+
+    // Non-owning tensor with the same shape over this tensor's buffer. Writes through the view
+    // are visible in this tensor.
+    Tensor view() {
+        return borrow(data());
+    }
+
+    // Read-only view of a const tensor. The result is const, so it cannot be written through,
+    // and copying or moving it into a mutable tensor copies the values.
+    const Tensor view() const {
+        return borrow(const_cast<float*>(data()));
+    }
+
+    // View of the buffer under another shape holding the same number of elements
+    Tensor view(size_t batch, size_t depth, size_t rows, size_t cols) {
+        Tensor result = borrow(data());
+        result.reshape(batch, depth, rows, cols);
+        return result;
+    }
+
+    const Tensor view(size_t batch, size_t depth, size_t rows, size_t cols) const {
+        Tensor result = borrow(const_cast<float*>(data()));
+        result.reshape(batch, depth, rows, cols);
+        return result;
+    }
+
+    // Whole-tensor flat array view, used for element-wise operations in a single sweep
+    Eigen::Map<Eigen::ArrayXf> array() {
+        return Eigen::Map<Eigen::ArrayXf>(data(), size());
+    }
+
+    Eigen::Map<const Eigen::ArrayXf> array() const {
+        return Eigen::Map<const Eigen::ArrayXf>(data(), size());
     }
 
     void print_shape() const {
@@ -71,144 +466,363 @@ public:
     }
 
     void set_random() {
-        for (auto& matrix : data_) {
-            matrix = Eigen::MatrixXf::Random(matrix.rows(), matrix.cols());
-        }
+        array().setRandom();
     }
 
-    // Utility for resizing the tensor
+    // Utility for resizing the tensor. Contents are kept if the shape is unchanged, otherwise zeroed.
+    // Resizing a view to a different shape gives it a buffer of its own.
     void resize(size_t depth, size_t rows, size_t cols) {
-        data_.resize(depth, Eigen::MatrixXf::Zero(rows, cols));
+        resize(1, depth, rows, cols);
     }
 
-    // Scalar operations
-    Tensor& operator*=(float scalar) {
-        for (auto& matrix : data_) {
-            matrix.array() *= scalar;
+    void resize(size_t batch, size_t depth, size_t rows, size_t cols) {
+        if (batch == batch_ && depth == depth_ && rows == rows_ && cols == cols_) {
+            return;
         }
-        return *this;
+        batch_ = batch;
+        depth_ = depth;
+        rows_ = rows;
+        cols_ = cols;
+        allocate(size(), true);
     }
 
-    Tensor operator*(float scalar) const {
-        Tensor result = *this;
-        result *= scalar;
+    // Reinterpret the buffer with a new shape holding the same number of elements, read in the given layout
+    void reshape(size_t batch, size_t depth, size_t rows, size_t cols, Layout layout = Layout::NCHW) {
+        if (batch * depth * rows * cols != size()) {
+            throw std::invalid_argument("Reshape must preserve the number of elements.");
+        }
+        batch_ = batch;
+        depth_ = depth;
+        rows_ = rows;
+        cols_ = cols;
+        layout_ = layout;
+    }
+
+    // Stack unbatched samples [begin, end) into one batched tensor of shape (end - begin) x depth x rows x cols
+    static Tensor stack(const std::vector<Tensor>& samples, size_t begin, size_t end) {
+        if (begin >= end || end > samples.size()) {
+            throw std::out_of_range("Invalid range for stacking tensors.");
+        }
+        const Tensor& first = samples[begin];
+        Tensor result(end - begin, first.depth_, first.rows_, first.cols_, first.layout_);
+        size_t sample_size = first.size();
+        for (size_t i = begin; i < end; ++i) {
+            if (samples[i].batch_ != 1 || samples[i].batch_shape() != first.batch_shape() || samples[i].layout_ != first.layout_) {
+                throw std::invalid_argument("All samples must be unbatched and share the same shape and layout to be stacked.");
+            }
+            std::copy(samples[i].data(), samples[i].data() + sample_size, result.data() + (i - begin) * sample_size);
+        }
         return result;
     }
 
-    Tensor& operator-=(float scalar) {
-        for (auto& matrix : data_) {
-            matrix.array() -= scalar;
+    // Copy out a single sample of a batched tensor as an unbatched tensor
+    Tensor sample(size_t index) const {
+        if (index >= batch_) {
+            throw std::out_of_range("Sample index out of range.");
         }
+        Tensor result(1, depth_, rows_, cols_, layout_);
+        const float* begin = data() + index * result.size();
+        std::copy(begin, begin + result.size(), result.data());
+        return result;
+    }
+
+    // Scalar operations in place. The binary operators (a * 2.0f, a + b, ...) are defined after
+    // the class and return a TensorExpression that is evaluated when assigned to a tensor.
+    Tensor& operator*=(float scalar) {
+        array() *= scalar;
         return *this;
     }
 
-    Tensor operator-(float scalar) const {
-        Tensor result = *this;
-        result -= scalar;
-        return result;
+    Tensor& operator+=(float scalar) {
+        array() += scalar;
+        return *this;
+    }
+
+    Tensor& operator-=(float scalar) {
+        array() -= scalar;
+        return *this;
     }
 
     Tensor& operator/=(float scalar) {
         if (scalar == 0.0f) {
             throw std::invalid_argument("Division by zero is not allowed.");
         }
-        for (auto& matrix : data_) {
-            matrix.array() /= scalar;
-        }
+        array() /= scalar;
         return *this;
     }
 
-    Tensor operator/(float scalar) const {
-        Tensor result = *this;
-        result /= scalar;
-        return result;
-    }
-
-    // Tensor element-wise addition
-    Tensor& operator+=(const Tensor& other) {
-        if (data_.size() != other.data_.size()) {
-            throw std::invalid_argument("Tensors must have the same size for addition.");
-        }
-        for (size_t i = 0; i < data_.size(); ++i) {
-            data_[i].array() += other.data_[i].array();
-        }
+    // Tensor element-wise addition and subtraction of a tensor or a tensor expression, in one sweep
+    template <typename Other, typename = std::enable_if_t<is_tensor_operand<Other>::value>>
+    Tensor& operator+=(const Other& other) {
+        TensorShape::common(tensor_shape(), other.tensor_shape());
+        array() += other.array();
         return *this;
     }
 
-    Tensor operator+(const Tensor& other) const {
-        Tensor result = *this;
-        result += other;
-        return result;
+    template <typename Other, typename = std::enable_if_t<is_tensor_operand<Other>::value>>
+    Tensor& operator-=(const Other& other) {
+        TensorShape::common(tensor_shape(), other.tensor_shape());
+        array() -= other.array();
+        return *this;
     }
 
-    // Flatten tensor to a single matrix
-    Eigen::MatrixXf flatten() const {
-        if (data_.empty()) return Eigen::MatrixXf();
-        size_t rows = data_[0].rows();
-        size_t cols = data_[0].cols();
-        Eigen::MatrixXf flat(rows * data_.size(), cols);
-        for (size_t i = 0; i < data_.size(); ++i) {
-            flat.middleRows(i * rows, rows) = data_[i];
-        }
-        return flat;
+    // Flatten tensor to a single matrix, stacking the channels (of every sample) vertically.
+    // The channels are already contiguous, so this is a view of the buffer and does not copy.
+    ConstChannelMap flatten() const {
+        require_channels_first();
+        return ConstChannelMap(data(), num_matrices() * rows_, cols_);
     }
 
-    // Slicing function: Get a slice of the tensor (e.g., extracting (1, batch_size, features) from (num_batch, batch_size, features))
+    // Slicing function: Get a slice of the tensor (e.g., extracting (1, batch_size, features) from (num_batch, batch_size, features)).
+    // The slice is a view of the selected channel and does not copy; copy it to keep it beyond the lifetime of this tensor.
     Tensor slice(int batch_idx) const {
-        int num_batch = data_.size();
-        int batch_size = data_[0].rows();
-        
+        int num_batch = num_matrices();
+
         // Ensure that the batch_idx is within the valid range
         if (batch_idx < 0 || batch_idx >= num_batch) {
             std::cerr << "Error: Batch index out of range!" << std::endl;
             return Tensor(); // Return an empty tensor in case of invalid index
         }
+        require_channels_first();
+
+        Tensor result;
+        result.external_ = const_cast<float*>(channel_data(batch_idx));
+        result.storage_ = Storage::View;
+        result.depth_ = 1;
+        result.rows_ = rows_;
+        result.cols_ = cols_;
+        return result;
+    }
 
-        return Tensor({data_[batch_idx]});
+    // View of rows [begin, end) of a single-matrix tensor, such as a share of the samples of a batch.
+    // The rows are contiguous in the row-major buffer, so this does not copy either.
+    Tensor slice_rows(size_t begin, size_t end) const {
+        if (num_matrices() != 1 || begin >= end || end > rows_) {
+            throw std::out_of_range("Invalid row range for slicing.");
+        }
+        require_channels_first();
+
+        Tensor result;
+        result.external_ = const_cast<float*>(data() + begin * cols_);
+        result.storage_ = Storage::View;
+        result.depth_ = 1;
+        result.rows_ = end - begin;
+        result.cols_ = cols_;
+        return result;
     }
 
-    // Add a new matrix to the tensor
-    void push_back(const Eigen::MatrixXf& matrix) {
-        data_.push_back(matrix);
+    // Add a new matrix to the tensor. The first matrix pushed fixes the channel shape.
+    template <typename Derived>
+    void push_back(const Eigen::DenseBase<Derived>& matrix) {
+        if (batch_ != 1) {
+            throw std::logic_error("Cannot push a matrix onto a batched tensor.");
+        }
+        require_channels_first();
+        detach();
+        if (depth_ == 0) {
+            rows_ = matrix.rows();
+            cols_ = matrix.cols();
+        } else if (static_cast<size_t>(matrix.rows()) != rows_ || static_cast<size_t>(matrix.cols()) != cols_) {
+            throw std::invalid_argument("All matrices in a tensor must have the same shape.");
+        }
+        data_.resize(size() + rows_ * cols_);
+        ++depth_;
+        (*this)[depth_ - 1] = matrix.derived();
     }
 
     // Remove the last matrix from the tensor
     void pop_back() {
-        if (data_.empty()) {
+        if (depth_ == 0) {
             throw std::runtime_error("Cannot pop from an empty tensor.");
         }
-        data_.pop_back();
+        --depth_;
+        if (storage_ == Storage::Owned) {
+            data_.resize(depth_ * rows_ * cols_);
+        }
     }
 
     // Check if the tensor is a single matrix
     bool isSingleMatrix() const {
-        return data_.size() == 1;
+        return num_matrices() == 1;
     }
 
-    const Eigen::MatrixXf& getSingleMatrix() const {
+    ConstChannelMap getSingleMatrix() const {
         if (!isSingleMatrix()) {
             throw std::runtime_error("Tensor does not contain a single matrix.");
         }
-        return data_[0];
+        return (*this)[0];
     }
 
     // Overload the << operator for printing
     friend std::ostream& operator<<(std::ostream& os, const Tensor& tensor) {
-        for (size_t c = 0; c < tensor.depth(); ++c) {
+        if (tensor.layout_ != Layout::NCHW) {
+            return os << tensor.to_nchw();
+        }
+        for (size_t c = 0; c < tensor.num_matrices(); ++c) {
             os << "Channel " << c << ":\n";
-            os << tensor.data_[c] << "\n";
+            os << tensor[c] << "\n";
         }
         return os;
     }
 
-    // Iterators for easy traversal
-    auto begin() { return data_.begin(); }
-    auto end() { return data_.end(); }
-    auto begin() const { return data_.cbegin(); }
-    auto end() const { return data_.cend(); }
+    // Iterators for easy traversal, each step yields a mapped channel. Assumes NCHW.
+    iterator begin() { return iterator(data(), rows_, cols_); }
+    iterator end() { return iterator(data() + size(), rows_, cols_); }
+    const_iterator begin() const { return const_iterator(data(), rows_, cols_); }
+    const_iterator end() const { return const_iterator(data() + size(), rows_, cols_); }
 
 private:
-    std::vector<Eigen::MatrixXf> data_;
+    // Heap storage, cache-line aligned and on huge pages when enabled (see Allocator)
+    using Buffer = std::vector<float, AlignedAllocator<float>>;
+
+    float* channel_data(size_t index) { return data() + index * rows_ * cols_; }
+    const float* channel_data(size_t index) const { return data() + index * rows_ * cols_; }
+
+    // Non-owning tensor with this tensor's shape over the given buffer, see view()
+    Tensor borrow(float* buffer) const {
+        Tensor result;
+        result.external_ = buffer;
+        result.storage_ = Storage::View;
+        result.batch_ = batch_;
+        result.depth_ = depth_;
+        result.rows_ = rows_;
+        result.cols_ = cols_;
+        result.layout_ = layout_;
+        return result;
+    }
+
+    size_t offset(size_t sample, size_t depth, size_t row, size_t col) const {
+        if (layout_ == Layout::NHWC) {
+            return ((sample * rows_ + row) * cols_ + col) * depth_ + depth;
+        }
+        return ((sample * depth_ + depth) * rows_ + row) * cols_ + col;
+    }
+
+    void require_channels_first() const {
+        if (layout_ != Layout::NCHW) {
+            throw std::logic_error("Channel access requires an NCHW tensor, convert it with to_nchw().");
+        }
+    }
+
+    void require_channels_last() const {
+        if (layout_ != Layout::NHWC) {
+            throw std::logic_error("Pixel access requires an NHWC tensor, convert it with to_nhwc().");
+        }
+    }
+
+    // Allocate a buffer for count elements, from the current arena if there is one
+    void allocate(size_t count, bool zero) {
+        release();
+        if (Arena* arena = Arena::current()) {
+            external_ = static_cast<float*>(arena->allocate(count * sizeof(float), arena_id_));
+            storage_ = Storage::Arena;
+            arena_ = arena;
+            data_.clear();
+            if (zero) {
+                std::fill(external_, external_ + count, 0.0f);
+            }
+        } else {
+            data_.assign(count, 0.0f);
+        }
+    }
+
+    // Move a view or arena-backed buffer into a heap buffer owned by this tensor, so it can grow
+    void detach() {
+        if (external_) {
+            data_.assign(external_, external_ + size());
+            release();
+        }
+    }
+
+    // Drop a borrowed or arena buffer, telling the arena the allocation is dead. The arena is
+    // only notified while it is current on this thread, which also guarantees it is still alive.
+    void release() {
+        if (storage_ == Storage::Arena && arena_ == Arena::current()) {
+            arena_->release(arena_id_);
+        }
+        storage_ = Storage::Owned;
+        external_ = nullptr;
+        arena_ = nullptr;
+    }
+
+    // Leave a moved-from tensor empty without releasing the buffer it handed over
+    void forget() {
+        batch_ = 1;
+        depth_ = rows_ = cols_ = 0;
+        layout_ = Layout::NCHW;
+        data_.clear();
+        storage_ = Storage::Owned;
+        external_ = nullptr;
+        arena_ = nullptr;
+    }
+
+    size_t batch_ = 1;
+    size_t depth_ = 0;
+    size_t rows_ = 0;
+    size_t cols_ = 0;
+    Layout layout_ = Layout::NCHW;
+    Buffer data_; // Single contiguous buffer for all channels
+
+    // Where the buffer lives: data_ (Owned), another tensor (View) or an Arena block (Arena).
+    // For views and arena-backed tensors external_ points at the buffer and data_ is unused.
+    enum class Storage { Owned, View, Arena };
+    Storage storage_ = Storage::Owned;
+    float* external_ = nullptr;
+    Arena* arena_ = nullptr; // Arena the buffer came from, only compared against Arena::current()
+    size_t arena_id_ = 0;    // Allocation id to report the release with
 };
 
-#endif // TENSOR_H
\ No newline at end of file
+// Element-wise arithmetic on tensors and tensor expressions. Each operator only builds an
+// expression; the result is computed when it is assigned to a Tensor.
+template <typename T>
+using enable_if_tensor_operand = std::enable_if_t<is_tensor_operand<T>::value, int>;
+
+template <typename Expr>
+TensorExpression<Expr> make_tensor_expression(const Expr& expression, const TensorShape& shape) {
+    return TensorExpression<Expr>(expression, shape);
+}
+
+template <typename L, typename R, enable_if_tensor_operand<L> = 0, enable_if_tensor_operand<R> = 0>
+auto operator+(const L& lhs, const R& rhs) {
+    return make_tensor_expression(lhs.array() + rhs.array(), TensorShape::common(lhs.tensor_shape(), rhs.tensor_shape()));
+}
+
+template <typename L, typename R, enable_if_tensor_operand<L> = 0, enable_if_tensor_operand<R> = 0>
+auto operator-(const L& lhs, const R& rhs) {
+    return make_tensor_expression(lhs.array() - rhs.array(), TensorShape::common(lhs.tensor_shape(), rhs.tensor_shape()));
+}
+
+template <typename T, enable_if_tensor_operand<T> = 0>
+auto operator-(const T& operand) {
+    return make_tensor_expression(-operand.array(), operand.tensor_shape());
+}
+
+template <typename T, enable_if_tensor_operand<T> = 0>
+auto operator*(const T& operand, float scalar) {
+    return make_tensor_expression(operand.array() * scalar, operand.tensor_shape());
+}
+
+template <typename T, enable_if_tensor_operand<T> = 0>
+auto operator*(float scalar, const T& operand) {
+    return make_tensor_expression(scalar * operand.array(), operand.tensor_shape());
+}
+
+template <typename T, enable_if_tensor_operand<T> = 0>
+auto operator/(const T& operand, float scalar) {
+    if (scalar == 0.0f) {
+        throw std::invalid_argument("Division by zero is not allowed.");
+    }
+    return make_tensor_expression(operand.array() / scalar, operand.tensor_shape());
+}
+
+template <typename T, enable_if_tensor_operand<T> = 0>
+auto operator+(const T& operand, float scalar) {
+    return make_tensor_expression(operand.array() + scalar, operand.tensor_shape());
+}
+
+template <typename T, enable_if_tensor_operand<T> = 0>
+auto operator-(const T& operand, float scalar) {
+    return make_tensor_expression(operand.array() - scalar, operand.tensor_shape());
+}
+
+#endif // TENSOR_H
@@ -0,0 +1,183 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @enum NestedParallelism
+ * @brief What a parallel loop started inside a task of the pool does.
+ */
+enum class NestedParallelism {
+    Shared, // Its chunks are queued on the same pool, so idle threads pick them up (default)
+    Serial  // It runs inline on the thread of the task, only the outermost loop is parallel
+};
+
+/**
+ * @class ThreadPool
+ * @brief A persistent pool of worker threads that share work by stealing.
+ *
+ * Every worker owns a queue of tasks. A worker takes the newest task of its own queue and, when
+ * that is empty, steals the oldest task of another worker's queue, so busy workers hand off work
+ * to idle ones without a central queue. Tasks submitted from outside the pool are spread over the
+ * workers' queues. Idle workers sleep until a task is submitted.
+ *
+ * A thread that waits for a group of tasks (TaskGroup::wait(), parallel_for()) runs the group's queued
+ * tasks itself, so parallel loops may be nested inside tasks without deadlocking and the calling thread
+ * counts as one of the pool's threads. It then sleeps until the group's tasks running on other threads
+ * are done. Tasks of other groups are left to the workers, so a waiter does not get held up by
+ * unrelated work, such as a whole task of another replica.
+ *
+ * While a task runs, OpenMP on its thread is limited to one thread, so Eigen products inside layer
+ * loops do not start a team of threads per task on top of the pool's.
+ *
+ * The layers run their parallel loops on ThreadPool::global(), whose workers are created once and
+ * live as long as the program. Its size is set with Eidos::set_num_threads() (see threading.h).
+ */
+class ThreadPool {
+public:
+    /**
+     * @class TaskGroup
+     * @brief A set of tasks that can be waited for together.
+     *
+     * The first exception thrown by a task is rethrown by wait(), the other tasks still run.
+     */
+    class TaskGroup {
+    public:
+        explicit TaskGroup(ThreadPool& pool) : pool(pool) {}
+        ~TaskGroup() { wait_quietly(); }
+
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+        // Queues a task of the group
+        void run(std::function<void()> task);
+
+        // Runs the group's queued tasks and waits for the others, then rethrows the first exception
+        void wait();
+
+    private:
+        ThreadPool& pool;
+        std::atomic<int> pending{0};
+        std::mutex error_mutex;
+        std::exception_ptr error;
+        std::mutex done_mutex;
+        std::condition_variable done; // Notified when the last task of the group finishes
+
+        void wait_quietly();
+    };
+
+    /**
+     * @brief Starts the worker threads.
+     *
+     * @param num_threads The number of threads running tasks, the thread waiting for them included,
+     *        so num_threads - 1 workers are started. At least 1.
+     */
+    explicit ThreadPool(int num_threads);
+
+    // Finishes the queued tasks and joins the workers
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // The pool of the library, with one thread per hardware thread, created on first use
+    static ThreadPool& global();
+
+    // Threads running tasks, the waiting thread included
+    int num_threads() const { return static_cast<int>(workers.size()) + 1; }
+
+    /**
+     * @brief Finishes the queued tasks and restarts the pool with another number of threads.
+     *
+     * Must not be called while other threads use the pool.
+     *
+     * @throws std::logic_error if called from a task of the pool.
+     */
+    void resize(int num_threads);
+
+    void set_nesting(NestedParallelism policy) { nesting = policy; }
+    NestedParallelism get_nesting() const { return nesting; }
+
+    // Whether the calling thread is running a task of any pool
+    static bool in_task();
+
+    /**
+     * @brief Calls body(i) for every i in [begin, end) and returns when all calls are done.
+     *
+     * The range is cut into chunks of at least grain indices, a few per thread so stolen chunks even
+     * out the load, and the calling thread runs chunks too. Small ranges run inline, and so does the
+     * whole loop when it is nested in a task and the nesting policy is NestedParallelism::Serial.
+     *
+     * @param begin The first index.
+     * @param end One past the last index.
+     * @param body The loop body, called concurrently from several threads.
+     * @param grain The smallest number of consecutive indices run as one task.
+     * @throws The first exception thrown by body.
+     */
+    void parallel_for(int begin, int end, const std::function<void(int)>& body, int grain = 1);
+
+    /**
+     * @brief Queues a task and returns a future for its result.
+     *
+     * Waiting on the future blocks the thread without running other tasks, use a TaskGroup to wait
+     * from inside a task.
+     */
+    template <typename F>
+    auto submit(F&& task) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+        using Result = std::invoke_result_t<std::decay_t<F>>;
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> result = packaged->get_future();
+        push([packaged] { (*packaged)(); });
+        return result;
+    }
+
+private:
+    // A queued task and the group it belongs to, if any
+    struct Task {
+        std::function<void()> run;
+        const TaskGroup* group = nullptr;
+    };
+
+    // Tasks of one worker, the owner works at the back and thieves at the front
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues; // One per worker
+    std::vector<std::thread> workers;
+    std::atomic<unsigned> next_queue{0};        // Queue of the next task submitted from outside the pool
+    std::atomic<int> queued{0};                 // Tasks in all the queues
+    std::atomic<NestedParallelism> nesting{NestedParallelism::Shared};
+
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void start(int num_threads);
+    void stop();
+
+    void push(std::function<void()> task, const TaskGroup* group = nullptr);
+
+    // Runs one queued task, from the queue of the calling worker first, and returns whether there was one
+    bool run_one();
+    bool pop(int queue, bool steal, Task& task);
+
+    // Same as run_one(), for the tasks of one group only
+    bool run_one_of(const TaskGroup& group);
+    bool pop_of(int queue, const TaskGroup& group, Task& task);
+
+    void work(int index);
+};
+
+#endif // THREAD_POOL_H
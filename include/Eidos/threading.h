@@ -0,0 +1,42 @@
+#ifndef THREADING_H
+#define THREADING_H
+
+#include "thread_pool.h"
+
+/**
+ * Runtime threading configuration of the library.
+ *
+ * One setting sizes the thread pool the layers run their parallel loops on (ThreadPool::global())
+ * and the OpenMP threads Eigen uses for large matrix products, so the two do not each take every
+ * core. Without a call to set_num_threads(), the EIDOS_NUM_THREADS environment variable sets the
+ * number of threads, and without it every hardware thread is used.
+ */
+namespace Eidos {
+    /**
+     * @brief Sets the number of threads of the pool and of Eigen.
+     *
+     * OpenMP settings are per thread, so Eigen products use num_threads threads on the calling thread
+     * and one thread inside pool tasks, where the pool already keeps the cores busy. Call it from the
+     * thread that runs the model, before training or inference, not while the pool is in use.
+     *
+     * @param num_threads The number of threads, or 0 for the default (see default_num_threads()).
+     */
+    void set_num_threads(int num_threads);
+
+    // The number of threads set by set_num_threads(), or the default
+    int num_threads();
+
+    // EIDOS_NUM_THREADS if it holds a positive integer, otherwise the number of hardware threads
+    int default_num_threads();
+
+    /**
+     * @brief Sets what parallel loops nested inside pool tasks do, see NestedParallelism.
+     *
+     * Shared lets inner loops (intra-op) fill threads left idle by outer tasks (inter-op), such as
+     * layers of model replicas run as tasks. Serial keeps every thread on its own outer task.
+     */
+    void set_nested_parallelism(NestedParallelism policy);
+    NestedParallelism nested_parallelism();
+}
+
+#endif // THREADING_H
@@ -11,6 +11,19 @@ Eigen::MatrixXf ReLU::backward(const Eigen::MatrixXf& grad_output) {
     return grad_output.array() * cache_output.array(); // Apply the cached mask to gradients
 }
 
+void ReLU::forward_inplace(Eigen::Ref<Eigen::ArrayXf> values) {
+    cache_output = (values > 0).cast<float>().matrix(); // Cache the mask
+    values = values.max(0.0f);
+}
+
+void ReLU::backward_inplace(Eigen::Ref<Eigen::ArrayXf> grad) {
+    grad *= cache_output.array();
+}
+
+void ReLU::apply_inplace(Eigen::Ref<Eigen::ArrayXf> values) const {
+    values = values.max(0.0f);
+}
+
 Eigen::MatrixXf LeakyReLU::forward(const Eigen::MatrixXf& input) {
     cache_output = (input.array() > 0).cast<float>() + alpha * (input.array() <= 0).cast<float>();
     return input.cwiseMax(0) + alpha * input.cwiseMin(0); // Leaky ReLU activation
@@ -20,6 +33,19 @@ Eigen::MatrixXf LeakyReLU::backward(const Eigen::MatrixXf& grad_output) {
     return grad_output.array() * cache_output.array(); // Apply the cached mask to gradients
 }
 
+void LeakyReLU::forward_inplace(Eigen::Ref<Eigen::ArrayXf> values) {
+    cache_output = (values > 0).select(1.0f, Eigen::ArrayXf::Constant(values.size(), alpha)).matrix();
+    values *= cache_output.array(); // The slope mask doubles as the activation
+}
+
+void LeakyReLU::backward_inplace(Eigen::Ref<Eigen::ArrayXf> grad) {
+    grad *= cache_output.array();
+}
+
+void LeakyReLU::apply_inplace(Eigen::Ref<Eigen::ArrayXf> values) const {
+    values = (values > 0).select(values, alpha * values);
+}
+
 Eigen::MatrixXf Sigmoid::forward(const Eigen::MatrixXf& input) {
     cache_output = 1.0f / (1.0f + (-input.array()).exp());
     return cache_output;
@@ -30,6 +56,19 @@ Eigen::MatrixXf Sigmoid::backward(const Eigen::MatrixXf& grad_output) {
 return grad_output.array() * sigmoid_grad.array();
 }
 
+void Sigmoid::forward_inplace(Eigen::Ref<Eigen::ArrayXf> values) {
+    values = 1.0f / (1.0f + (-values).exp());
+    cache_output = values.matrix();
+}
+
+void Sigmoid::backward_inplace(Eigen::Ref<Eigen::ArrayXf> grad) {
+    grad *= cache_output.array() * (1.0f - cache_output.array());
+}
+
+void Sigmoid::apply_inplace(Eigen::Ref<Eigen::ArrayXf> values) const {
+    values = 1.0f / (1.0f + (-values).exp());
+}
+
 Eigen::MatrixXf Softmax::forward(const Eigen::MatrixXf& logits) {
     // Compute the exponentials in a numerically stable way
     Eigen::MatrixXf exp_logits = (logits.array().rowwise() - logits.colwise().maxCoeff().array()).exp();
@@ -58,4 +97,17 @@ Eigen::MatrixXf Tanh::forward(const Eigen::MatrixXf& input) {
 
 Eigen::MatrixXf Tanh::backward(const Eigen::MatrixXf& grad_output) {
     return grad_output.array() * (1 - cache_output.array().square());
+}
+
+void Tanh::forward_inplace(Eigen::Ref<Eigen::ArrayXf> values) {
+    values = values.tanh();
+    cache_output = values.matrix();
+}
+
+void Tanh::backward_inplace(Eigen::Ref<Eigen::ArrayXf> grad) {
+    grad *= 1.0f - cache_output.array().square();
+}
+
+void Tanh::apply_inplace(Eigen::Ref<Eigen::ArrayXf> values) const {
+    values = values.tanh();
 }
\ No newline at end of file
@@ -0,0 +1,185 @@
+#include "../include/Eidos/allocator.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // Every buffer is preceded by one cache line holding its bookkeeping, which keeps the
+    // returned pointer 64-byte aligned and lets deallocate() work without being told the size
+    struct Header {
+        size_t reserved; // Bytes reserved from the system, header included
+        bool huge;       // Whether the buffer was advised to use huge pages
+    };
+    static_assert(sizeof(Header) <= Allocator::alignment, "The header must fit in one cache line.");
+
+    // Buffers placed on huge pages start on a 2MB boundary and keep their header in this table
+    // instead, so a buffer of exactly 2MB reserves one huge page rather than two. Never destroyed,
+    // as tensors with static storage may be freed after it would be.
+    std::mutex huge_buffers_mutex;
+    std::unordered_map<void*, Header>& huge_buffers() {
+        static auto* buffers = new std::unordered_map<void*, Header>();
+        return *buffers;
+    }
+
+    std::atomic<bool> huge_pages{false};
+    std::atomic<size_t> huge_threshold{Allocator::huge_page_size};
+
+    std::atomic<size_t> allocations{0};
+    std::atomic<size_t> deallocations{0};
+    std::atomic<size_t> bytes_allocated{0};
+    std::atomic<size_t> bytes_in_use{0};
+    std::atomic<size_t> peak_bytes_in_use{0};
+    std::atomic<size_t> huge_page_allocations{0};
+    std::atomic<size_t> huge_page_bytes{0};
+
+    size_t round_up(size_t bytes, size_t multiple) {
+        return (bytes + multiple - 1) / multiple * multiple;
+    }
+
+    bool advise(void* ptr, size_t bytes) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        return madvise(ptr, bytes, MADV_HUGEPAGE) == 0;
+#else
+        (void)ptr;
+        (void)bytes;
+        return false;
+#endif
+    }
+
+    void track_peak(size_t in_use) {
+        size_t peak = peak_bytes_in_use.load(std::memory_order_relaxed);
+        while (in_use > peak && !peak_bytes_in_use.compare_exchange_weak(peak, in_use, std::memory_order_relaxed)) {
+        }
+    }
+}
+
+void* Allocator::allocate(size_t bytes) {
+    bool huge = huge_pages.load(std::memory_order_relaxed) && bytes >= huge_threshold.load(std::memory_order_relaxed);
+
+    // Huge pages need the region to start on and span whole 2MB pages, the header is kept aside
+    size_t reserved = huge ? round_up(std::max<size_t>(bytes, 1), huge_page_size) : round_up(bytes + alignment, alignment);
+    char* base = static_cast<char*>(std::aligned_alloc(huge ? huge_page_size : alignment, reserved));
+    if (base == nullptr) {
+        throw std::bad_alloc();
+    }
+    char* buffer = base + alignment;
+    if (huge) {
+        Header header{reserved, advise(base, reserved)};
+        huge = header.huge;
+        buffer = base;
+        std::lock_guard<std::mutex> lock(huge_buffers_mutex);
+        huge_buffers().emplace(buffer, header);
+    } else {
+        new (base) Header{reserved, false};
+    }
+
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    bytes_allocated.fetch_add(bytes, std::memory_order_relaxed);
+    track_peak(bytes_in_use.fetch_add(reserved, std::memory_order_relaxed) + reserved);
+    if (huge) {
+        huge_page_allocations.fetch_add(1, std::memory_order_relaxed);
+        huge_page_bytes.fetch_add(reserved, std::memory_order_relaxed);
+    }
+    return buffer;
+}
+
+void Allocator::deallocate(void* ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+    // Only buffers starting on a 2MB boundary can be in the table of huge buffers
+    char* base = nullptr;
+    Header header{};
+    if (reinterpret_cast<uintptr_t>(ptr) % huge_page_size == 0) {
+        std::lock_guard<std::mutex> lock(huge_buffers_mutex);
+        auto it = huge_buffers().find(ptr);
+        if (it != huge_buffers().end()) {
+            base = static_cast<char*>(ptr);
+            header = it->second;
+            huge_buffers().erase(it);
+        }
+    }
+    if (base == nullptr) {
+        base = static_cast<char*>(ptr) - alignment;
+        header = *reinterpret_cast<const Header*>(base);
+    }
+
+    deallocations.fetch_add(1, std::memory_order_relaxed);
+    bytes_in_use.fetch_sub(header.reserved, std::memory_order_relaxed);
+    if (header.huge) {
+        huge_page_bytes.fetch_sub(header.reserved, std::memory_order_relaxed);
+    }
+    std::free(base);
+}
+
+void Allocator::enable_huge_pages(size_t threshold) {
+    huge_threshold.store(threshold, std::memory_order_relaxed);
+    huge_pages.store(true, std::memory_order_relaxed);
+}
+
+void Allocator::disable_huge_pages() {
+    huge_pages.store(false, std::memory_order_relaxed);
+}
+
+bool Allocator::huge_pages_enabled() {
+    return huge_pages.load(std::memory_order_relaxed);
+}
+
+bool Allocator::advise_huge_pages(void* ptr, size_t bytes) {
+#if defined(__linux__)
+    // madvise works on whole pages, so advise the pages that lie entirely inside the buffer
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    uintptr_t begin = round_up(reinterpret_cast<uintptr_t>(ptr), page);
+    uintptr_t end = (reinterpret_cast<uintptr_t>(ptr) + bytes) / page * page;
+    if (end <= begin) {
+        return false;
+    }
+    return advise(reinterpret_cast<void*>(begin), end - begin);
+#else
+    (void)ptr;
+    (void)bytes;
+    return false;
+#endif
+}
+
+AllocationStats Allocator::stats() {
+    AllocationStats stats;
+    stats.allocations = allocations.load(std::memory_order_relaxed);
+    stats.deallocations = deallocations.load(std::memory_order_relaxed);
+    stats.bytes_allocated = bytes_allocated.load(std::memory_order_relaxed);
+    stats.bytes_in_use = bytes_in_use.load(std::memory_order_relaxed);
+    stats.peak_bytes_in_use = peak_bytes_in_use.load(std::memory_order_relaxed);
+    stats.huge_page_allocations = huge_page_allocations.load(std::memory_order_relaxed);
+    stats.huge_page_bytes = huge_page_bytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void Allocator::reset_stats() {
+    allocations.store(0, std::memory_order_relaxed);
+    deallocations.store(0, std::memory_order_relaxed);
+    bytes_allocated.store(0, std::memory_order_relaxed);
+    huge_page_allocations.store(0, std::memory_order_relaxed);
+    peak_bytes_in_use.store(bytes_in_use.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+size_t Allocator::resident_huge_page_bytes() {
+#if defined(__linux__)
+    std::ifstream smaps("/proc/self/smaps_rollup");
+    std::string line;
+    while (std::getline(smaps, line)) {
+        if (line.rfind("AnonHugePages:", 0) == 0) {
+            return std::stoull(line.substr(line.find(':') + 1)) * 1024; // Reported in kB
+        }
+    }
+#endif
+    return 0;
+}
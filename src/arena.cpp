@@ -0,0 +1,149 @@
+#include "../include/Eidos/arena.h"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+namespace {
+    thread_local Arena* current_arena = nullptr;
+
+    size_t align_up(size_t bytes) {
+        return (bytes + Arena::alignment - 1) & ~(Arena::alignment - 1);
+    }
+}
+
+Arena::Arena(size_t block_size, bool planning)
+    : block_size_(align_up(block_size)), mode_(planning ? Mode::Recording : Mode::Bump) {}
+
+Arena::~Arena() {
+    free_blocks();
+    Allocator::deallocate(slab_);
+}
+
+void Arena::add_block(size_t min_bytes) {
+    size_t size = std::max(block_size_, align_up(min_bytes));
+    char* data = static_cast<char*>(Allocator::allocate(size));
+    blocks_.push_back({data, size});
+}
+
+void Arena::free_blocks() {
+    for (auto& block : blocks_) {
+        Allocator::deallocate(block.data);
+    }
+    blocks_.clear();
+}
+
+void* Arena::bump(size_t bytes) {
+    // Move on to the next block (or a new one) once the active block cannot fit the request
+    while (active_ < blocks_.size() && offset_ + bytes > blocks_[active_].size) {
+        ++active_;
+        offset_ = 0;
+    }
+    if (active_ == blocks_.size()) {
+        add_block(bytes);
+    }
+
+    void* ptr = blocks_[active_].data + offset_;
+    offset_ += bytes;
+    return ptr;
+}
+
+void* Arena::allocate(size_t bytes) {
+    size_t id;
+    return allocate(bytes, id);
+}
+
+void* Arena::allocate(size_t bytes, size_t& id) {
+    bytes = align_up(bytes == 0 ? 1 : bytes);
+    id = next_id_++;
+    bytes_allocated_ += bytes;
+
+    if (mode_ == Mode::Recording) {
+        planner_.record_allocation(bytes);
+    } else if (mode_ == Mode::Replaying && !diverged_) {
+        size_t index = id - step_first_id_;
+        if (planner_.expects_allocation(index, bytes, replay_events_)) {
+            ++replay_events_;
+            return slab_ + planner_.offset(index);
+        }
+        // The step no longer follows the plan, so the slab offsets cannot be trusted from here on
+        diverged_ = true;
+    }
+    return bump(bytes);
+}
+
+void Arena::release(size_t id) {
+    if (id < step_first_id_ || id >= next_id_) {
+        return; // Allocated before the last reset, its memory is already gone
+    }
+    size_t index = id - step_first_id_;
+
+    if (mode_ == Mode::Recording) {
+        planner_.record_release(index);
+    } else if (mode_ == Mode::Replaying && !diverged_) {
+        if (planner_.expects_release(index, replay_events_)) {
+            ++replay_events_;
+        } else {
+            diverged_ = true;
+        }
+    }
+}
+
+void Arena::build_slab() {
+    size_t size = align_up(planner_.plan());
+    if (size > slab_size_) {
+        Allocator::deallocate(slab_);
+        slab_ = nullptr;
+        slab_size_ = 0;
+        slab_ = static_cast<char*>(Allocator::allocate(size));
+        slab_size_ = size;
+    }
+}
+
+void Arena::reset() {
+    if (mode_ == Mode::Recording && !planner_.allocations().empty()) {
+        // The first step is recorded, every later step runs out of the slab
+        build_slab();
+        free_blocks();
+        mode_ = Mode::Replaying;
+    } else if (mode_ == Mode::Replaying && diverged_) {
+        // The allocation sequence changed (e.g. a different batch size), record it again
+        planner_.clear();
+        mode_ = Mode::Recording;
+    }
+
+    // Replace several blocks by a single one of the combined size so the next step needs only one
+    if (blocks_.size() > 1) {
+        size_t total = 0;
+        for (const auto& block : blocks_) {
+            total += block.size;
+        }
+        free_blocks();
+        add_block(total);
+    }
+    active_ = 0;
+    offset_ = 0;
+    bytes_allocated_ = 0;
+    step_first_id_ = next_id_;
+    replay_events_ = 0;
+    diverged_ = false;
+}
+
+size_t Arena::capacity() const {
+    size_t total = slab_size_;
+    for (const auto& block : blocks_) {
+        total += block.size;
+    }
+    return total;
+}
+
+Arena* Arena::current() {
+    return current_arena;
+}
+
+Arena::Scope::Scope(Arena& arena) : previous_(current_arena) {
+    current_arena = &arena;
+}
+
+Arena::Scope::~Scope() {
+    current_arena = previous_;
+}
@@ -0,0 +1,46 @@
+#include "../include/Eidos/cache_info.h"
+#include <cstdint>
+#include <unistd.h>
+#if defined(__APPLE__)
+#include <sys/sysctl.h>
+#endif
+
+namespace {
+    // Size of one cache level as the OS reports it, or fallback when it does not
+    size_t detect(int sysconf_name, const char* sysctl_name, size_t fallback) {
+        long size = -1;
+#if defined(__APPLE__)
+        (void)sysconf_name;
+        int64_t value = 0;
+        size_t length = sizeof(value);
+        if (sysctlbyname(sysctl_name, &value, &length, nullptr, 0) == 0) {
+            size = static_cast<long>(value);
+        }
+#else
+        (void)sysctl_name;
+        if (sysconf_name >= 0) {
+            size = sysconf(sysconf_name);
+        }
+#endif
+        return size > 0 ? static_cast<size_t>(size) : fallback;
+    }
+
+#if defined(_SC_LEVEL1_DCACHE_SIZE)
+    constexpr int l1_name = _SC_LEVEL1_DCACHE_SIZE;
+    constexpr int l2_name = _SC_LEVEL2_CACHE_SIZE;
+    constexpr int l3_name = _SC_LEVEL3_CACHE_SIZE;
+#else
+    constexpr int l1_name = -1;
+    constexpr int l2_name = -1;
+    constexpr int l3_name = -1;
+#endif
+}
+
+const CacheSizes& cache_sizes() {
+    static const CacheSizes sizes = {
+        detect(l1_name, "hw.l1dcachesize", 48 * 1024),
+        detect(l2_name, "hw.l2cachesize", 1024 * 1024),
+        detect(l3_name, "hw.l3cachesize", 8 * 1024 * 1024),
+    };
+    return sizes;
+}
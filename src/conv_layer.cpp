@@ -2,13 +2,322 @@
 #include "../include/Eidos/tensor.hpp"
 #include <random>
 #include <Eigen/Dense>
-#include <thread>
-#include <mutex>
+#include "../include/Eidos/thread_pool.h"
+#include <algorithm>
 #include <iostream>
+#include <cmath>
+#include "../include/Eidos/cache_info.h"
+#include <cstring>
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#endif
+
+namespace {
+    // Consecutive pixels of one input row, stride pixels apart, as a (pixels x channels) matrix
+    using PixelRows = Eigen::Map<Tensor::Matrix, 0, Eigen::OuterStride<>>;
+    using ConstPixelRows = Eigen::Map<const Tensor::Matrix, 0, Eigen::OuterStride<>>;
+
+    // Winograd F(2x2, 3x3) transforms (Lavin & Gray), Y = A^T [(G g G^T) * (B^T d B)] A for a 3x3 filter g,
+    // a 4x4 input tile d and a 2x2 output tile Y. Tiles are row-major, element xi = 4 * row + col.
+    void winograd_filter_transform(const float g[3][3], float u[16]) {
+        float s[4][3];
+        for (int j = 0; j < 3; ++j) {
+            s[0][j] = g[0][j];
+            s[1][j] = 0.5f * (g[0][j] + g[1][j] + g[2][j]);
+            s[2][j] = 0.5f * (g[0][j] - g[1][j] + g[2][j]);
+            s[3][j] = g[2][j];
+        }
+        for (int i = 0; i < 4; ++i) {
+            u[4 * i + 0] = s[i][0];
+            u[4 * i + 1] = 0.5f * (s[i][0] + s[i][1] + s[i][2]);
+            u[4 * i + 2] = 0.5f * (s[i][0] - s[i][1] + s[i][2]);
+            u[4 * i + 3] = s[i][2];
+        }
+    }
+
+    void winograd_input_transform(const float d[4][4], float v[16]) {
+        float t[4][4];
+        for (int j = 0; j < 4; ++j) {
+            t[0][j] = d[0][j] - d[2][j];
+            t[1][j] = d[1][j] + d[2][j];
+            t[2][j] = d[2][j] - d[1][j];
+            t[3][j] = d[1][j] - d[3][j];
+        }
+        for (int i = 0; i < 4; ++i) {
+            v[4 * i + 0] = t[i][0] - t[i][2];
+            v[4 * i + 1] = t[i][1] + t[i][2];
+            v[4 * i + 2] = t[i][2] - t[i][1];
+            v[4 * i + 3] = t[i][1] - t[i][3];
+        }
+    }
+
+    void winograd_output_transform(const float m[16], float y[2][2]) {
+        float a[2][4];
+        for (int j = 0; j < 4; ++j) {
+            a[0][j] = m[j] + m[4 + j] + m[8 + j];
+            a[1][j] = m[4 + j] - m[8 + j] - m[12 + j];
+        }
+        for (int i = 0; i < 2; ++i) {
+            y[i][0] = a[i][0] + a[i][1] + a[i][2];
+            y[i][1] = a[i][1] - a[i][2] - a[i][3];
+        }
+    }
+
+    // Range [begin, end) of output columns j whose tap j * stride + offset lands inside an input row of the given width
+    std::pair<int, int> valid_columns(int offset, int stride, int width, int output_width) {
+        int begin = offset >= 0 ? 0 : (-offset + stride - 1) / stride;
+        int last = width - 1 - offset;
+        int end = last < 0 ? 0 : std::min(output_width, last / stride + 1);
+        return {begin, std::max(begin, end)};
+    }
+
+    // One channels-first sample as a (channels x pixels) matrix
+    Tensor::ConstChannelMap sample_matrix(const Tensor& tensor, int n) {
+        return Tensor::ConstChannelMap(tensor.channel(n, 0).data(), tensor.depth(), tensor.rows() * tensor.cols());
+    }
+
+    // Scratch memory of at least size floats, only ever grown so strips of different sizes reuse it
+    template <typename Matrix>
+    typename Matrix::Scalar* scratch(Matrix& buffer, Eigen::Index size) {
+        if (buffer.size() < size) {
+            buffer.resize(1, size);
+        }
+        return buffer.data();
+    }
+
+    // int8 products of the quantized input with the filters of one block of int8_block output channels, for P
+    // consecutive output pixels of a row. input points at the group's first input channel under the top-left tap
+    // of the first pixel, the next output pixel being pixel_stride bytes further, the next input pixel tap_stride
+    // bytes and the next input row row_stride bytes. Every 4 input channels of a pixel are multiplied by the 4
+    // weights of each output channel of the block (see Conv2D::int8_filters) and summed in int32.
+    // The input is unsigned, its quantized values offset by 128, because the VNNI instructions multiply unsigned
+    // bytes by signed ones; forward_sample_int8 subtracts the offset times the filter sums.
+    constexpr int int8_block = Conv2D::int8_block;
+    using Int8Sums = int32_t[int8_block];
+    using Int8Kernel = void (*)(const uint8_t* input, int pixel_stride, int tap_stride, int row_stride,
+                                int kernel_size, int channels, const int8_t* filters, Int8Sums* sums);
+
+    // Without VNNI, the 4 weights of each input channel are stored for the whole block one after the other,
+    // so the loop over the block vectorizes into widening multiplies and adds
+#if defined(__GNUC__) || defined(__clang__)
+#define EIDOS_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define EIDOS_ALWAYS_INLINE inline
+#endif
+
+    template <int P>
+    EIDOS_ALWAYS_INLINE
+    void int8_kernel_planar(const uint8_t* input, int pixel_stride, int tap_stride, int row_stride,
+                            int kernel_size, int channels, const int8_t* filters, Int8Sums* sums) {
+        int32_t acc[P][int8_block] = {};
+        for (int ki = 0; ki < kernel_size; ++ki) {
+            for (int kj = 0; kj < kernel_size; ++kj) {
+                const uint8_t* taps = input + ki * row_stride + kj * tap_stride;
+                for (int c = 0; c < channels; c += 4, filters += 4 * int8_block) {
+                    for (int p = 0; p < P; ++p) {
+                        const uint8_t* x = taps + p * pixel_stride + c;
+                        int16_t x0 = x[0], x1 = x[1], x2 = x[2], x3 = x[3];
+                        for (int b = 0; b < int8_block; ++b) {
+                            acc[p][b] += x0 * filters[b] + x1 * filters[int8_block + b] +
+                                         x2 * filters[2 * int8_block + b] + x3 * filters[3 * int8_block + b];
+                        }
+                    }
+                }
+            }
+        }
+        std::copy(&acc[0][0], &acc[0][0] + P * int8_block, &sums[0][0]);
+    }
+
+    template <int P>
+    void int8_kernel(const uint8_t* input, int pixel_stride, int tap_stride, int row_stride,
+                     int kernel_size, int channels, const int8_t* filters, Int8Sums* sums) {
+        int8_kernel_planar<P>(input, pixel_stride, tap_stride, row_stride, kernel_size, channels, filters, sums);
+    }
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    // The kernels below are compiled for their instruction sets whatever the flags of the build, and only
+    // called on CPUs that have them. The same loop vectorizes twice as wide with AVX2.
+    template <int P>
+    __attribute__((target("avx2")))
+    void int8_kernel_avx2(const uint8_t* input, int pixel_stride, int tap_stride, int row_stride,
+                          int kernel_size, int channels, const int8_t* filters, Int8Sums* sums) {
+        int8_kernel_planar<P>(input, pixel_stride, tap_stride, row_stride, kernel_size, channels, filters, sums);
+    }
+
+    // With AVX-512 VNNI, vpdpbusd does the 4 products and their sum for all 16 output channels at once. It takes
+    // the 4 weights of each output channel side by side.
+    template <int P>
+    __attribute__((target("avx512f,avx512bw,avx512vnni")))
+    void int8_kernel_vnni(const uint8_t* input, int pixel_stride, int tap_stride, int row_stride,
+                          int kernel_size, int channels, const int8_t* filters, Int8Sums* sums) {
+        static_assert(int8_block == 16, "One 512-bit vector holds the sums of a block");
+        __m512i acc[P];
+        for (int p = 0; p < P; ++p) {
+            acc[p] = _mm512_setzero_si512();
+        }
+        for (int ki = 0; ki < kernel_size; ++ki) {
+            for (int kj = 0; kj < kernel_size; ++kj) {
+                const uint8_t* taps = input + ki * row_stride + kj * tap_stride;
+                for (int c = 0; c < channels; c += 4, filters += 4 * int8_block) {
+                    __m512i weights = _mm512_loadu_si512(filters);
+                    for (int p = 0; p < P; ++p) {
+                        int32_t x;
+                        std::memcpy(&x, taps + p * pixel_stride + c, sizeof(x));
+                        acc[p] = _mm512_dpbusd_epi32(acc[p], _mm512_set1_epi32(x), weights);
+                    }
+                }
+            }
+        }
+        for (int p = 0; p < P; ++p) {
+            _mm512_storeu_si512(sums[p], acc[p]);
+        }
+    }
+
+    bool has_vnni() {
+        static const bool vnni = __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vnni");
+        return vnni;
+    }
+
+    template <int P>
+    Int8Kernel select_int8_kernel() {
+        if (has_vnni()) {
+            return int8_kernel_vnni<P>;
+        }
+        return __builtin_cpu_supports("avx2") ? int8_kernel_avx2<P> : int8_kernel<P>;
+    }
+#else
+    bool has_vnni() {
+        return false;
+    }
+
+    template <int P>
+    Int8Kernel select_int8_kernel() {
+        return int8_kernel<P>;
+    }
+#endif
+
+    // Position of weight t of input channel c in the 4 * int8_block weights of output channel b's block
+    int int8_weight_index(int b, int c) {
+        return has_vnni() ? 4 * b + c % 4 : c % 4 * int8_block + b;
+    }
+
+    // Direct convolution of one input plane into B output planes, output[b] += kernel[b] * input, with
+    // the kernel size K, stride S and block B known at compile time. The window loops have constant trip
+    // counts and unroll, and the output is computed in vectors of V columns that accumulate every tap in
+    // registers before being stored. Each input vector loaded feeds all B output channels. The input plane
+    // already holds its zero border (see Conv2D::forward_sample_direct), so no tap needs a bounds check.
+    constexpr int direct_vector = Eigen::internal::packet_traits<float>::size;
+
+    template <int K, int S, int B>
+    void direct_block(const float* input, int row_stride, const float* kernels, int kernel_stride,
+                      float* outputs, int output_stride, int H_out, int W_out) {
+        constexpr int V = direct_vector;
+        using Vector = Eigen::Array<float, V, 1>;
+        using Taps = Eigen::Map<const Vector, Eigen::Unaligned, Eigen::InnerStride<S>>;
+
+        float taps[B][K * K] = {};
+        for (int b = 0; b < B; ++b) {
+            std::copy(kernels + b * kernel_stride, kernels + b * kernel_stride + K * K, taps[b]);
+        }
+
+        auto accumulate = [&](const float* window, Vector (&sums)[B]) {
+            for (int ki = 0; ki < K; ++ki) {
+                for (int kj = 0; kj < K; ++kj) {
+                    Vector values = Taps(window + ki * row_stride + kj);
+                    for (int b = 0; b < B; ++b) {
+                        sums[b] += taps[b][ki * K + kj] * values;
+                    }
+                }
+            }
+        };
+
+        for (int i = 0; i < H_out; ++i) {
+            const float* window = input + i * S * row_stride;
+            float* output_row = outputs + i * W_out;
+            Vector sums[B];
+            int j = 0;
+            for (; j + V <= W_out; j += V) {
+                for (int b = 0; b < B; ++b) {
+                    sums[b] = Eigen::Map<Vector>(output_row + b * output_stride + j);
+                }
+                accumulate(window + j * S, sums);
+                for (int b = 0; b < B; ++b) {
+                    Eigen::Map<Vector>(output_row + b * output_stride + j) = sums[b];
+                }
+            }
+            if (j < W_out) {
+                // The last vector of the row is partial, its extra lanes read past the row and are dropped
+                float lanes[B][V] = {};
+                for (int b = 0; b < B; ++b) {
+                    std::copy(output_row + b * output_stride + j, output_row + b * output_stride + W_out, lanes[b]);
+                    sums[b] = Eigen::Map<const Vector>(lanes[b]);
+                }
+                accumulate(window + j * S, sums);
+                for (int b = 0; b < B; ++b) {
+                    Eigen::Map<Vector> partial(lanes[b]);
+                    partial = sums[b];
+                    std::copy(lanes[b], lanes[b] + W_out - j, output_row + b * output_stride + j);
+                }
+            }
+        }
+    }
+
+    // Output channels go through the kernel four at a time, then one at a time for the rest
+    template <int K, int S>
+    void direct_kernel(const float* input, int row_stride, const float* kernels, int kernel_stride,
+                       float* outputs, int output_stride, int channels, int H_out, int W_out) {
+        int c = 0;
+        for (; c + 4 <= channels; c += 4) {
+            direct_block<K, S, 4>(input, row_stride, kernels + c * kernel_stride, kernel_stride,
+                                  outputs + c * output_stride, output_stride, H_out, W_out);
+        }
+        for (; c < channels; ++c) {
+            direct_block<K, S, 1>(input, row_stride, kernels + c * kernel_stride, kernel_stride,
+                                  outputs + c * output_stride, output_stride, H_out, W_out);
+        }
+    }
+
+    template <int K>
+    Conv2D::DirectKernel direct_kernel_for_stride(int stride) {
+        switch (stride) {
+            case 1: return direct_kernel<K, 1>;
+            case 2: return direct_kernel<K, 2>;
+            default: return nullptr;
+        }
+    }
+
+    Conv2D::DirectKernel select_direct_kernel(int kernel_size, int stride) {
+        switch (kernel_size) {
+            case 1: return direct_kernel_for_stride<1>(stride);
+            case 3: return direct_kernel_for_stride<3>(stride);
+            case 5: return direct_kernel_for_stride<5>(stride);
+            case 7: return direct_kernel_for_stride<7>(stride);
+            default: return nullptr;
+        }
+    }
+}
 
 Conv2D::Conv2D(int input_channels, int output_channels, 
-                    int kernel_size, int stride, int padding)
-    : kernel_size_(kernel_size), stride_(stride), padding_(padding) {
+                    int kernel_size, int stride, int padding, int groups)
+    : kernel_size_(kernel_size), stride_(stride), padding_(padding), groups_(groups),
+      direct_kernel_(select_direct_kernel(kernel_size, stride)) {
+    if (groups < 1 || input_channels % groups != 0 || output_channels % groups != 0) {
+        throw std::invalid_argument("The number of groups must divide the numbers of input and output channels.");
+    }
+    int group_channels = input_channels / groups; // Input channels each output channel reads
+
+    // Pick the forward algorithm for the shape of the layer, see set_algorithm()
+    if (groups == 1 && kernel_size == 3 && stride == 1 && input_channels >= winograd_min_channels) {
+        algorithm_ = ConvAlgorithm::Winograd;
+    } else if (groups == 1 && stride == 1 && (kernel_size == 3 || kernel_size == 5) && input_channels < direct_max_channels) {
+        algorithm_ = ConvAlgorithm::Direct;
+    } else if (groups > 1 && direct_kernel_ != nullptr && group_channels < direct_max_channels) {
+        algorithm_ = ConvAlgorithm::Direct;
+    } else {
+        algorithm_ = ConvAlgorithm::Gemm;
+    }
+    default_algorithm_ = algorithm_;
+
     // Store the input shape
     this->input_shape = {input_channels, -1, -1}; // Heights and widths are unknown at initialization.
 
@@ -21,11 +330,11 @@ Conv2D::Conv2D(int input_channels, int output_channels,
     // Weight initialization using Xavier/Glorot Normal initialization
     for (int oc = 0; oc < output_channels; ++oc) {
         // Initialize the weights for each filter using Random method
-        weights[oc] = Eigen::MatrixXf::Random(input_channels, kernel_size * kernel_size) 
-            * std::sqrt(2.0f / (input_channels * kernel_size * kernel_size));
+        weights[oc] = Eigen::MatrixXf::Random(group_channels, kernel_size * kernel_size) 
+            * std::sqrt(2.0f / (group_channels * kernel_size * kernel_size));
 
         // Initialize gradients for weights
-        grad_weights[oc] = Eigen::MatrixXf::Zero(input_channels, kernel_size * kernel_size);
+        grad_weights[oc] = Eigen::MatrixXf::Zero(group_channels, kernel_size * kernel_size);
 
         // Initialize biases
         biases[oc] = Eigen::VectorXf::Zero(1); // Single bias per output channel
@@ -58,172 +367,1024 @@ std::vector<int> Conv2D::calculateOutputShape() const {
     return {C_out, H_out, W_out};
 }
 
-Tensor Conv2D::applyPadding(const Tensor& input) {
-    // Extract input dimensions
-    int C_in = input_shape[0];  // Number of input channels
-    int H_in = input_shape[1];  // Input height
-    int W_in = input_shape[2];  // Input width
+void Conv2D::pack_filters() {
+    int C_in = input_shape[0] / groups_;
+    int C_out = weights.size();
+    filter_matrix.resize(C_out, C_in * kernel_size_ * kernel_size_);
+    for (int c_out = 0; c_out < C_out; ++c_out) {
+        for (int c_in = 0; c_in < C_in; ++c_in) {
+            for (int ki = 0; ki < kernel_size_; ++ki) {
+                for (int kj = 0; kj < kernel_size_; ++kj) {
+                    // weights[c_out] holds element (ki, kj) of each input channel's kernel at column kj * K + ki
+                    filter_matrix(c_out, (c_in * kernel_size_ + ki) * kernel_size_ + kj) =
+                        source_weights()[c_out](c_in, kj * kernel_size_ + ki);
+                }
+            }
+        }
+    }
+}
+
+void Conv2D::im2col(const Tensor& input, int n, float* columns, int first_channel, int channels, int top, int rows) const {
+    int H_in = input_shape[1];
+    int W_in = input_shape[2];
+    int W_out = output_shape[2];
+
+    // Row (c * K + ki) * K + kj holds, for every output pixel of the strip, the input value that kernel tap
+    // (ki, kj) of channel first_channel + c multiplies. Taps that fall in the padding are written as zeros,
+    // so no padded copy of the input is needed.
+    for (int c = 0; c < channels; ++c) {
+        const float* channel = input.channel(n, first_channel + c).data();
+        for (int ki = 0; ki < kernel_size_; ++ki) {
+            for (int kj = 0; kj < kernel_size_; ++kj) {
+                int r = (c * kernel_size_ + ki) * kernel_size_ + kj;
+                Tensor::ChannelMap taps(columns + r * rows * W_out, rows, W_out);
+                auto [begin, end] = valid_columns(kj - padding_, stride_, W_in, W_out);
+
+                for (int i = 0; i < rows; ++i) {
+                    int row = (top + i) * stride_ + ki - padding_;
+                    if (row < 0 || row >= H_in || begin == end) {
+                        taps.row(i).setZero();
+                        continue;
+                    }
+                    taps.row(i).head(begin).setZero();
+                    taps.row(i).tail(W_out - end).setZero();
+                    int col = begin * stride_ + kj - padding_;
+                    taps.row(i).segment(begin, end - begin) = Eigen::Map<const Eigen::RowVectorXf, 0, Eigen::InnerStride<>>(
+                        channel + row * W_in + col, end - begin, Eigen::InnerStride<>(stride_));
+                }
+            }
+        }
+    }
+}
+
+void Conv2D::col2im(const float* columns, int n, Tensor& grad_input, int first_channel, int channels, int top, int rows) const {
+    int H_in = input_shape[1];
+    int W_in = input_shape[2];
+    int W_out = output_shape[2];
+
+    // The adjoint of im2col: every entry of the column matrix is added back to the input pixel it was
+    // read from, and entries that were read from the padding are dropped
+    for (int c = 0; c < channels; ++c) {
+        float* channel = grad_input.channel(n, first_channel + c).data();
+        for (int ki = 0; ki < kernel_size_; ++ki) {
+            for (int kj = 0; kj < kernel_size_; ++kj) {
+                int r = (c * kernel_size_ + ki) * kernel_size_ + kj;
+                Tensor::ConstChannelMap taps(columns + r * rows * W_out, rows, W_out);
+                auto [begin, end] = valid_columns(kj - padding_, stride_, W_in, W_out);
+                if (begin == end) {
+                    continue;
+                }
+
+                for (int i = 0; i < rows; ++i) {
+                    int row = (top + i) * stride_ + ki - padding_;
+                    if (row < 0 || row >= H_in) {
+                        continue;
+                    }
+                    int col = begin * stride_ + kj - padding_;
+                    Eigen::Map<Eigen::RowVectorXf, 0, Eigen::InnerStride<>>(
+                        channel + row * W_in + col, end - begin, Eigen::InnerStride<>(stride_)) +=
+                        taps.row(i).segment(begin, end - begin);
+                }
+            }
+        }
+    }
+}
+
+void Conv2D::prepare_filters() {
+    // The filter spectra have the size of the tiles, which follows the size of the input
+    auto [tile_h, tile_w] = fft_tile_size();
+    bool fft_resized = algorithm_ == ConvAlgorithm::Fft && (fft.height() != tile_h || fft.width() != tile_w);
+    if (!training && !filters_stale && !fft_resized) {
+        return;
+    }
+    pack_filters();
+    if (algorithm_ == ConvAlgorithm::Winograd) {
+        transform_filters_winograd();
+    } else if (algorithm_ == ConvAlgorithm::Fft) {
+        transform_filters_fft();
+    } else if (algorithm_ == ConvAlgorithm::Int8) {
+        quantize_filters();
+    }
+    filters_stale = false;
+}
+
+std::pair<int, int> Conv2D::fft_tile_size() const {
+    // Tiles of four times the kernel size spend at most a quarter of each side on the overlap
+    // between tiles, and are small enough for a tile's spectra to stay in cache
+    int tile = FFT2D::next_power_of_two(4 * kernel_size_);
+    return {std::min(tile, FFT2D::next_power_of_two(input_shape[1] + 2 * padding_)),
+            std::min(tile, FFT2D::next_power_of_two(input_shape[2] + 2 * padding_))};
+}
+
+bool Conv2D::use_fft(int height, int width) const {
+    return stride_ == 1 && groups_ == 1 && kernel_size_ >= fft_min_kernel &&
+           std::min(height, width) >= fft_min_size;
+}
+
+void Conv2D::transform_filters_fft() {
+    int C_in = input_shape[0];
+    int C_out = weights.size();
+    auto [tile_h, tile_w] = fft_tile_size();
+    if (fft.height() != tile_h || fft.width() != tile_w) {
+        fft = FFT2D(tile_h, tile_w);
+    }
+
+    // Multiplying by the conjugate spectrum correlates the input with the kernel, as the layer does
+    filter_spectra.resize(C_out * C_in, fft.spectrum_size());
+    Tensor::Matrix plane = Tensor::Matrix::Zero(tile_h, tile_w);
+    for (int c_out = 0; c_out < C_out; ++c_out) {
+        for (int c_in = 0; c_in < C_in; ++c_in) {
+            for (int ki = 0; ki < kernel_size_; ++ki) {
+                for (int kj = 0; kj < kernel_size_; ++kj) {
+                    plane(ki, kj) = source_weights()[c_out](c_in, kj * kernel_size_ + ki);
+                }
+            }
+            auto spectrum = filter_spectra.row(c_out * C_in + c_in);
+            fft.forward(plane.data(), kernel_size_, spectrum.data());
+            spectrum = spectrum.conjugate();
+        }
+    }
+}
 
-    // Calculate the padded height and width
-    int H_padded = H_in + 2 * padding_;
+void Conv2D::transform_filters_winograd() {
+    int C_in = input_shape[0];
+    int C_out = weights.size();
+    winograd_filters.resize(16 * C_out, C_in);
+    for (int c_out = 0; c_out < C_out; ++c_out) {
+        for (int c_in = 0; c_in < C_in; ++c_in) {
+            float g[3][3];
+            for (int ki = 0; ki < 3; ++ki) {
+                for (int kj = 0; kj < 3; ++kj) {
+                    g[ki][kj] = source_weights()[c_out](c_in, kj * 3 + ki);
+                }
+            }
+            float u[16];
+            winograd_filter_transform(g, u);
+            for (int xi = 0; xi < 16; ++xi) {
+                winograd_filters(xi * C_out + c_out, c_in) = u[xi];
+            }
+        }
+    }
+}
+
+void Conv2D::forward_sample_winograd(const Tensor& input, int n, float* output, Workspace& workspace) const {
+    int C_in = input_shape[0];
+    int H_in = input_shape[1];
+    int W_in = input_shape[2];
+    int C_out = output_shape[0];
+    int H_out = output_shape[1];
+    int W_out = output_shape[2];
+
+    // Output is covered by 2x2 tiles, each computed from the 4x4 input tile around it. They are
+    // computed strip by strip (see set_tiling()), each strip being tile_rows rows of tiles.
+    int tiles_h = (H_out + 1) / 2;
+    int tiles_w = (W_out + 1) / 2;
+    int tile_rows = std::min(tiles_h, (tiling_.rows + 1) / 2);
+    Tensor::Matrix& products = workspace.products;
+    products.resize(16 * C_out, tile_rows * tiles_w);
+
+    for (int first = 0; first < tiles_h; first += tile_rows) {
+        int strip_rows = std::min(tile_rows, tiles_h - first);
+        int T = strip_rows * tiles_w;
+
+        for (int c = 0; c < C_in; c += tiling_.in_channels) {
+            int channels = std::min(tiling_.in_channels, C_in - c);
+            Tensor::ChannelMap tiles(scratch(workspace.columns, 16 * channels * T), 16 * channels, T);
+
+            // Transform every 4x4 input tile of the block of channels, reading zeros outside the input
+            for (int k = 0; k < channels; ++k) {
+                const float* channel = input.channel(n, c + k).data();
+                for (int th = 0; th < strip_rows; ++th) {
+                    for (int tw = 0; tw < tiles_w; ++tw) {
+                        float d[4][4];
+                        for (int a = 0; a < 4; ++a) {
+                            int row = 2 * (first + th) + a - padding_;
+                            for (int b = 0; b < 4; ++b) {
+                                int col = 2 * tw + b - padding_;
+                                bool inside = row >= 0 && row < H_in && col >= 0 && col < W_in;
+                                d[a][b] = inside ? channel[row * W_in + col] : 0.0f;
+                            }
+                        }
+                        float v[16];
+                        winograd_input_transform(d, v);
+                        for (int xi = 0; xi < 16; ++xi) {
+                            tiles(xi * channels + k, th * tiles_w + tw) = v[xi];
+                        }
+                    }
+                }
+            }
+
+            // The element-wise products, summed over input channels, are one GEMM per tile element
+            // and block of output channels
+            for (int xi = 0; xi < 16; ++xi) {
+                for (int o = 0; o < C_out; o += tiling_.out_channels) {
+                    int outputs = std::min(tiling_.out_channels, C_out - o);
+                    auto block = products.block(xi * C_out + o, 0, outputs, T);
+                    auto filters = winograd_filters.block(xi * C_out + o, c, outputs, channels);
+                    auto values = tiles.middleRows(xi * channels, channels);
+                    if (c == 0) {
+                        block.noalias() = filters * values;
+                    } else {
+                        block.noalias() += filters * values;
+                    }
+                }
+            }
+        }
+
+        // Transform back to 2x2 output tiles, dropping what falls past the output edge
+        for (int c_out = 0; c_out < C_out; ++c_out) {
+            Tensor::ChannelMap output_channel(output + c_out * H_out * W_out, H_out, W_out);
+            float bias = source_biases()[c_out](0);
+            for (int th = 0; th < strip_rows; ++th) {
+                int i = 2 * (first + th);
+                for (int tw = 0; tw < tiles_w; ++tw) {
+                    float m[16];
+                    for (int xi = 0; xi < 16; ++xi) {
+                        m[xi] = products(xi * C_out + c_out, th * tiles_w + tw);
+                    }
+                    float y[2][2];
+                    winograd_output_transform(m, y);
+                    for (int a = 0; a < 2 && i + a < H_out; ++a) {
+                        for (int b = 0; b < 2 && 2 * tw + b < W_out; ++b) {
+                            output_channel(i + a, 2 * tw + b) = y[a][b] + bias;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void Conv2D::forward_sample_direct(const Tensor& input, int n, float* output, Workspace& workspace) const {
+    int C_in = input_shape[0];
+    int H_in = input_shape[1];
+    int W_in = input_shape[2];
+    int C_out = output_shape[0];
+    int H_out = output_shape[1];
+    int W_out = output_shape[2];
+    int K2 = kernel_size_ * kernel_size_;
+
+    for (int c_out = 0; c_out < C_out; ++c_out) {
+        Tensor::ChannelMap(output + c_out * H_out * W_out, H_out, W_out).setConstant(source_biases()[c_out](0));
+    }
+
+    // Output rows go in strips. The input rows a strip reads are copied with their zero border (the
+    // halo) into a buffer of a few kilobytes per channel, followed by enough slack for the partial
+    // vectors at the end of the last row to read. Without padding the rows are read in place, except
+    // in the last strip, where the partial vectors would read past the end of the plane.
     int W_padded = W_in + 2 * padding_;
+    int strip = std::max(1, (direct_halo_floats / W_padded - kernel_size_) / stride_ + 1);
+    int slack = direct_vector * stride_ + kernel_size_;
+    int group_in = C_in / groups_;
+    int group_out = C_out / groups_;
+    Tensor::Matrix& halo = workspace.columns;
+
+    for (int top = 0; top < H_out; top += strip) {
+        int rows = std::min(strip, H_out - top);
+        int input_top = top * stride_ - padding_;   // First input row the strip reads, may lie in the padding
+        int input_rows = (rows - 1) * stride_ + kernel_size_;
+        int halo_size = input_rows * W_padded + slack;
+        bool in_place = padding_ == 0 && top + rows < H_out && stride_ * W_in >= slack;
+        if (!in_place) {
+            // Only the rows and columns inside the input are copied, the border stays zero
+            halo.setZero(group_in, halo_size);
+        }
+        int first = std::max(0, input_top);
+        int last = std::min(H_in, input_top + input_rows);
+
+        for (int g = 0; g < groups_; ++g) {
+            for (int c = 0; c < group_in && !in_place && first < last; ++c) {
+                Tensor::ChannelMap(halo.row(c).data(), input_rows, W_padded).block(first - input_top, padding_, last - first, W_in) =
+                    input.channel(n, g * group_in + c).middleRows(first, last - first);
+            }
+
+            // Output channels go in blocks within their group: each input strip is swept through the
+            // kernels of all the block's output channels while they are in cache. A depthwise
+            // convolution has one input channel per group, so each strip is copied once.
+            constexpr int block = 16;
+            for (int begin = g * group_out; begin < (g + 1) * group_out; begin += block) {
+                int end = std::min((g + 1) * group_out, begin + block);
+                for (int c = 0; c < group_in; ++c) {
+                    const float* strip_input = in_place ? input.channel(n, g * group_in + c).data() + input_top * W_in
+                                                        : halo.row(c).data();
+                    // Row c_out of the filter matrix holds the K x K kernel of each input channel of its group back to back
+                    direct_kernel_(strip_input, W_padded, filter_matrix.row(begin).data() + c * K2,
+                                   filter_matrix.cols(), output + begin * H_out * W_out + top * W_out, H_out * W_out,
+                                   end - begin, rows, W_out);
+                }
+            }
+        }
+    }
+}
 
-    // Create a new tensor with the padded dimensions
-    Tensor padded_input(C_in, H_padded, W_padded);
+namespace {
+    // Copies the part of a (height x width) plane that falls in the tile with its top-left corner at
+    // (row, col) into the tile, zero everywhere else, and returns the number of tile rows that can be nonzero
+    int load_tile(const float* channel, int height, int width, int row, int col, Tensor::Matrix& tile) {
+        tile.setZero();
+        int top = std::max(0, row);
+        int left = std::max(0, col);
+        int bottom = std::min<int>(height, row + tile.rows());
+        int right = std::min<int>(width, col + tile.cols());
+        if (top < bottom && left < right) {
+            tile.block(top - row, left - col, bottom - top, right - left) =
+                Tensor::ConstChannelMap(channel, height, width).block(top, left, bottom - top, right - left);
+        }
+        return std::max(0, std::min<int>(tile.rows(), height - row));
+    }
+}
+
+void Conv2D::forward_sample_fft(const Tensor& input, int n, float* output, Workspace& workspace) const {
+    int C_in = input_shape[0];
+    int H_in = input_shape[1];
+    int W_in = input_shape[2];
+    int C_out = output_shape[0];
+    int H_out = output_shape[1];
+    int W_out = output_shape[2];
+    int F = fft.spectrum_size();
+
+    // Each tile of the padded input gives the outputs whose windows lie entirely inside it. The
+    // spectra of a whole row of tiles are computed first, so every filter spectrum is read once per
+    // row of tiles rather than once per tile.
+    int tile_h = fft.height() - kernel_size_ + 1;
+    int tile_w = fft.width() - kernel_size_ + 1;
+    int tiles_w = (W_out + tile_w - 1) / tile_w;
+    FFT2D::Spectra& spectra = workspace.spectra;
+    spectra.resize(C_in + 1, tiles_w * F);
+    Tensor::Matrix& plane = workspace.columns;
+    plane.resize(fft.height(), fft.width());
+
+    for (int top = 0; top < H_out; top += tile_h) {
+        for (int c_in = 0; c_in < C_in; ++c_in) {
+            for (int t = 0; t < tiles_w; ++t) {
+                int rows = load_tile(input.channel(n, c_in).data(), H_in, W_in, top - padding_, t * tile_w - padding_, plane);
+                fft.forward(plane.data(), rows, spectra.row(c_in).data() + t * F);
+            }
+        }
+
+        int rows = std::min(tile_h, H_out - top);
+        Eigen::Map<Eigen::ArrayXcf> products(spectra.row(C_in).data(), tiles_w * F);
+        for (int c_out = 0; c_out < C_out; ++c_out) {
+            products.setZero();
+            for (int c_in = 0; c_in < C_in; ++c_in) {
+                Eigen::Map<const Eigen::ArrayXcf> filter(filter_spectra.row(c_out * C_in + c_in).data(), F);
+                for (int t = 0; t < tiles_w; ++t) {
+                    products.segment(t * F, F) +=
+                        Eigen::Map<const Eigen::ArrayXcf>(spectra.row(c_in).data() + t * F, F) * filter;
+                }
+            }
 
-    // Copy the input data to the center of the padded tensor
+            Tensor::ChannelMap output_channel(output + c_out * H_out * W_out, H_out, W_out);
+            float bias = source_biases()[c_out](0);
+            for (int t = 0; t < tiles_w; ++t) {
+                int cols = std::min(tile_w, W_out - t * tile_w);
+                fft.inverse(products.data() + t * F, rows, plane.data());
+                output_channel.block(top, t * tile_w, rows, cols) = plane.topLeftCorner(rows, cols).array() + bias;
+            }
+        }
+    }
+}
+
+void Conv2D::quantize_filters() {
+    int C_out = weights.size();
+    int group_in = input_shape[0] / groups_;
+    int group_out = C_out / groups_;
+    int K = kernel_size_;
+    int channels = int8_channels();
+    int blocks = int8_blocks();
+    size_t block_size = static_cast<size_t>(K * K) * channels * int8_block;
+    int8_filters.assign(groups_ * blocks * block_size, 0);
+    int8_scales.resize(C_out);
+    int8_offsets.resize(C_out);
+    for (int c_out = 0; c_out < C_out; ++c_out) {
+        int g = c_out / group_out;
+        int b = c_out % group_out % int8_block;
+        int8_t* block = int8_filters.data() + (g * blocks + c_out % group_out / int8_block) * block_size;
+        float max = filter_matrix.row(c_out).cwiseAbs().maxCoeff();
+        float scale = max > 0.0f ? max / 127.0f : 1.0f;
+        int sum = 0;
+        for (int c = 0; c < group_in; ++c) {
+            for (int ki = 0; ki < K; ++ki) {
+                for (int kj = 0; kj < K; ++kj) {
+                    int8_t value = static_cast<int8_t>(std::lround(filter_matrix(c_out, (c * K + ki) * K + kj) / scale));
+                    block[((ki * K + kj) * (channels / 4) + c / 4) * 4 * int8_block + int8_weight_index(b, c)] = value;
+                    sum += value;
+                }
+            }
+        }
+        int8_scales(c_out) = scale;
+        int8_offsets(c_out) = 128 * sum;
+    }
+}
+
+void Conv2D::forward_sample_int8(const Tensor& input, int n, float* output, Workspace& workspace) const {
+    int C_in = input_shape[0];
+    int H_in = input_shape[1];
+    int W_in = input_shape[2];
+    int C_out = output_shape[0];
+    int H_out = output_shape[1];
+    int W_out = output_shape[2];
+    int group_in = C_in / groups_;
+    int group_out = C_out / groups_;
+    int channels = int8_channels();
+    int pixel_bytes = groups_ * channels;
+    int W_padded = W_in + 2 * padding_;
+    int row_stride = W_padded * pixel_bytes;
+
+    // Quantize the sample once, channels last and with a border of the quantized zero, so every 4 input
+    // channels of a tap are 4 consecutive bytes: round(x / input_scale) in [-127, 127], offset by 128
+    std::vector<uint8_t>& quantized = workspace.quantized;
+    quantized.assign(static_cast<size_t>(H_in + 2 * padding_) * row_stride, 128);
+    float inverse = 1.0f / input_scale_;
+    Eigen::Array<uint8_t, 1, Eigen::Dynamic> values(W_in);
     for (int c = 0; c < C_in; ++c) {
-        padded_input[c].block(padding_, padding_, H_in, W_in) = input[c];
+        auto channel = input.channel(n, c);
+        uint8_t* plane = quantized.data() + padding_ * row_stride + padding_ * pixel_bytes + c / group_in * channels + c % group_in;
+        for (int i = 0; i < H_in; ++i) {
+            values = ((channel.row(i).array() * inverse).round().max(-127.0f).min(127.0f) + 128.0f).cast<uint8_t>();
+            for (int j = 0; j < W_in; ++j) {
+                plane[i * row_stride + j * pixel_bytes] = values(j);
+            }
+        }
+    }
+
+    // Strips of output rows (see set_tiling()) keep the input rows they read in cache while every block of
+    // output channels goes over them. Each sum is requantized to fp32 with the scales of the input and of its
+    // filter, after removing the input offset: sum((x + 128) * w) - 128 * sum(w).
+    constexpr int P = 4;
+    Int8Kernel kernel = select_int8_kernel<P>();
+    Int8Kernel single = select_int8_kernel<1>();
+    int blocks = int8_blocks();
+    size_t block_size = static_cast<size_t>(kernel_size_ * kernel_size_) * channels * int8_block;
+    Int8Sums sums[P];
+    for (int top = 0; top < H_out; top += tiling_.rows) {
+        int bottom = std::min(top + tiling_.rows, H_out);
+        for (int g = 0; g < groups_; ++g) {
+            for (int block = 0; block < blocks; ++block) {
+                const int8_t* filters = int8_filters.data() + (g * blocks + block) * block_size;
+                int first = g * group_out + block * int8_block;
+                int count = std::min(int8_block, group_out - block * int8_block);
+                float scales[int8_block];
+                float bias[int8_block];
+                int32_t offsets[int8_block];
+                for (int b = 0; b < count; ++b) {
+                    scales[b] = input_scale_ * int8_scales(first + b);
+                    bias[b] = source_biases()[first + b](0);
+                    offsets[b] = int8_offsets(first + b);
+                }
+                for (int i = top; i < bottom; ++i) {
+                    const uint8_t* input_row = quantized.data() + i * stride_ * row_stride + g * channels;
+                    float* output_row = output + static_cast<Eigen::Index>(first) * H_out * W_out + i * W_out;
+                    for (int j = 0; j < W_out; j += P) {
+                        int pixels = std::min(P, W_out - j);
+                        const uint8_t* window = input_row + j * stride_ * pixel_bytes;
+                        if (pixels == P) {
+                            kernel(window, stride_ * pixel_bytes, pixel_bytes, row_stride, kernel_size_, channels, filters, sums);
+                        } else {
+                            for (int p = 0; p < pixels; ++p) {
+                                single(window + p * stride_ * pixel_bytes, 0, pixel_bytes, row_stride, kernel_size_, channels,
+                                       filters, sums + p);
+                            }
+                        }
+                        for (int b = 0; b < count; ++b) {
+                            for (int p = 0; p < pixels; ++p) {
+                                output_row[b * H_out * W_out + j + p] = (sums[p][b] - offsets[b]) * scales[b] + bias[b];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void Conv2D::forward_sample_gemm(const Tensor& input, int n, float* output, Workspace& workspace) const {
+    int C_out = output_shape[0];
+    int H_out = output_shape[1];
+    int W_out = output_shape[2];
+    Tensor::ChannelMap sample_output(output, C_out, H_out * W_out);
+
+    // (C_out x C_in*K*K) x (C_in*K*K x H_out*W_out) gives every output channel of the sample. Grouped
+    // layers multiply each group's filters by the rows of the columns holding its input channels.
+    int group_in = input_shape[0] / groups_;
+    int group_out = C_out / groups_;
+    int taps = kernel_size_ * kernel_size_;
+    if (is_pointwise()) {
+        for (int g = 0; g < groups_; ++g) {
+            sample_output.middleRows(g * group_out, group_out).noalias() =
+                filter_matrix.middleRows(g * group_out, group_out) * sample_matrix(input, n).middleRows(g * group_in, group_in);
+        }
+        for (int c_out = 0; c_out < C_out; ++c_out) {
+            sample_output.row(c_out).array() += source_biases()[c_out](0);
+        }
+        return;
     }
 
-    return padded_input;
+    // The product is computed strip by strip (see set_tiling()). Each block of columns is unfolded once
+    // and multiplied by the filters of every output channel of its group before the next one is unfolded.
+    const Tiling& tiles = tiling_;
+    for (int top = 0; top < H_out; top += tiles.rows) {
+        int rows = std::min(tiles.rows, H_out - top);
+        auto strip = sample_output.middleCols(top * W_out, rows * W_out);
+        for (int g = 0; g < groups_; ++g) {
+            for (int c = 0; c < group_in; c += tiles.in_channels) {
+                int channels = std::min(tiles.in_channels, group_in - c);
+                float* data = scratch(workspace.columns, static_cast<Eigen::Index>(channels) * taps * rows * W_out);
+                im2col(input, n, data, g * group_in + c, channels, top, rows);
+                Tensor::ConstChannelMap columns(data, channels * taps, rows * W_out);
+                for (int o = 0; o < group_out; o += tiles.out_channels) {
+                    int outputs = std::min(tiles.out_channels, group_out - o);
+                    auto block = strip.middleRows(g * group_out + o, outputs);
+                    auto filters = filter_matrix.block(g * group_out + o, c * taps, outputs, channels * taps);
+                    if (c == 0) {
+                        block.noalias() = filters * columns;
+                    } else {
+                        block.noalias() += filters * columns;
+                    }
+                }
+            }
+        }
+        for (int c_out = 0; c_out < C_out; ++c_out) {
+            strip.row(c_out).array() += source_biases()[c_out](0);
+        }
+    }
 }
 
-Tensor Conv2D::forward(const Tensor& input) {
-    // Cache the input for use in the backward pass
-    this->cache_input = input;
+void Conv2D::begin_forward(const Tensor& input) {
+    // Cache the input for use in the backward pass, inference has none
+    if (training) {
+        this->cache_input = input;
+    }
 
     // Update the input shape based on the input dimensions
-    this->input_shape[1] = input[0].rows();  // Height
-    this->input_shape[2] = input[0].cols();  // Width
+    this->input_shape[1] = input.rows();  // Height
+    this->input_shape[2] = input.cols();  // Width
 
     // Calculate the output shape based on the input dimensions
     this->output_shape = calculateOutputShape();
 
-    // Apply padding to the input if needed
-    Tensor padded_input = (padding_ > 0) ? applyPadding(input) : input;
-
-    // Extract input dimensions
-    int C_in = input_shape[0];  // Number of input channels
-    int H_in = input_shape[1];  // Input height
-    int W_in = input_shape[2];  // Input width
-
-    // Extract output dimensions
-    int C_out = output_shape[0]; // Number of output channels
-    int H_out = output_shape[1]; // Output height
-    int W_out = output_shape[2]; // Output width    
-    
-    // Create output tensor
-    Tensor output(C_out, H_out, W_out);
-    
-    // Create threads for parallel computation
-    std::vector<std::thread> threads;
-    int num_threads = std::thread::hardware_concurrency();
-    for (int thd = 0; thd < num_threads; ++thd) {
-        threads.emplace_back([&](int thd){
-            // Each thread processes a subset of output channels
-            for (int c_out = thd; c_out < C_out; c_out+=num_threads) {
-                // Initialize the output channel with biases
-                output[c_out] = Eigen::MatrixXf::Constant(H_out, W_out, biases[c_out](0));
-                for (int c_in = 0; c_in < C_in; ++c_in) {
-                    // Extract the weight kernel for this output-input channel pair
-                    Eigen::MatrixXf kernel = weights[c_out].row(c_in);
-                    kernel = Eigen::Map<Eigen::MatrixXf>(kernel.data(), kernel_size_, kernel_size_);
-
-                    // Perform the convolution operation
-                    for (int i = 0; i < H_out; ++i) {
-                        for (int j = 0; j < W_out; ++j) {
-                            // Calculate the region in the padded input
-                            int start_row = i * stride_;
-                            int start_col = j * stride_;
-
-                            // Extract the region of interest
-                            Eigen::MatrixXf region = padded_input[c_in].block(
-                                start_row, start_col, kernel_size_, kernel_size_);
-                            
-                            // Perform element-wise multiplication and sum
-                            output[c_out](i, j) += (region.array() * kernel.array()).sum();
-                        }
+    // Unless an algorithm was set, large inputs go through the FFT
+    if (auto_algorithm_ && input.layout() == Layout::NCHW) {
+        ConvAlgorithm algorithm = use_fft(input.rows(), input.cols()) ? ConvAlgorithm::Fft : default_algorithm_;
+        if (algorithm != algorithm_) {
+            algorithm_ = algorithm;
+            filters_stale = true;
+        }
+    }
+
+    if (input.layout() == Layout::NCHW) {
+        prepare_filters();
+        if (algorithm_ == ConvAlgorithm::Int8) {
+            // One scale for the whole input tensor
+            float max = input.array().abs().maxCoeff();
+            input_scale_ = max > 0.0f ? max / 127.0f : 1.0f;
+        }
+        if (auto_tiling_) {
+            tiling_ = choose_tiling();
+        }
+    }
+}
+
+void Conv2D::forward_sample(const Tensor& input, int n, float* output, Workspace& workspace) const {
+    switch (algorithm_) {
+        case ConvAlgorithm::Winograd:
+            forward_sample_winograd(input, n, output, workspace);
+            break;
+        case ConvAlgorithm::Direct:
+            forward_sample_direct(input, n, output, workspace);
+            break;
+        case ConvAlgorithm::Fft:
+            forward_sample_fft(input, n, output, workspace);
+            break;
+        case ConvAlgorithm::Int8:
+            forward_sample_int8(input, n, output, workspace);
+            break;
+        default:
+            forward_sample_gemm(input, n, output, workspace);
+            break;
+    }
+}
+
+Conv2D::Tiling Conv2D::choose_tiling() const {
+    const CacheSizes& cache = cache_sizes();
+    long l2 = static_cast<long>(cache.l2 / sizeof(float));
+    int group_in = input_shape[0] / groups_;
+    int group_out = output_shape[0] / groups_;
+    int W_out = output_shape[2];
+
+    // Values per output pixel of one input channel's unfolded input (K*K taps, or 16 per 2x2 Winograd
+    // tile), and of one output channel's output (with the Winograd products)
+    bool winograd = algorithm_ == ConvAlgorithm::Winograd;
+    long taps = winograd ? 4 : kernel_size_ * kernel_size_;
+    long outputs = winograd ? 5 : 1;
+    if (algorithm_ == ConvAlgorithm::Int8) {
+        // The int8 pass only uses the strips, whose quantized input rows should fill half of L2
+        long row_bytes = static_cast<long>(stride_) * (input_shape[2] + 2 * padding_) * groups_ * int8_channels();
+        return {static_cast<int>(std::clamp<long>(cache.l2 / 2 / row_bytes, 1, output_shape[1])), group_in, group_out};
+    }
+
+    // One output row of a block of unfolded input channels fills at most a quarter of L2, then there are as
+    // many rows as fit in half of L2 with the output strip, and as many filters as fit in a quarter of it
+    Tiling tiling;
+    tiling.in_channels = static_cast<int>(std::clamp<long>(l2 / 4 / (taps * W_out), 1, group_in));
+    long row_size = (tiling.in_channels * taps + group_out * outputs) * W_out;
+    tiling.rows = static_cast<int>(std::clamp<long>(l2 / 2 / row_size, 1, output_shape[1]));
+    long filter_size = winograd ? tiling.in_channels : tiling.in_channels * taps;
+    tiling.out_channels = static_cast<int>(std::clamp<long>(l2 / 4 / filter_size, 1, group_out));
+    return tiling;
+}
+
+void Conv2D::set_tiling(Tiling tiling) {
+    if (tiling.rows < 1 || tiling.in_channels < 1 || tiling.out_channels < 1) {
+        throw std::invalid_argument("Tile sizes must be positive.");
+    }
+    tiling_ = tiling;
+    auto_tiling_ = false;
+}
+
+void Conv2D::set_training(bool training) {
+    this->training = training;
+    filters_stale = true; // The weights may have been updated since the filters were packed
+}
+
+bool Conv2D::share_parameters(const Layer* owner) {
+    shared = dynamic_cast<const Conv2D*>(owner);
+    return owner == nullptr || shared != nullptr;
+}
+
+void Conv2D::set_algorithm(ConvAlgorithm algorithm) {
+    if (algorithm == ConvAlgorithm::Winograd && (kernel_size_ != 3 || stride_ != 1 || groups_ != 1)) {
+        throw std::invalid_argument("Winograd convolution requires a 3x3 kernel with stride 1 and no groups.");
+    }
+    if (algorithm == ConvAlgorithm::Direct && direct_kernel_ == nullptr) {
+        throw std::invalid_argument("Direct convolution requires a kernel size of 1, 3, 5 or 7 and a stride of 1 or 2.");
+    }
+    if (algorithm == ConvAlgorithm::Fft && (stride_ != 1 || groups_ != 1)) {
+        throw std::invalid_argument("FFT convolution requires a stride of 1 and no groups.");
+    }
+    algorithm_ = algorithm;
+    auto_algorithm_ = false;
+    filters_stale = true;
+}
+
+Tensor Conv2D::forward(const Tensor& input) {
+    begin_forward(input);
+    if (input.layout() == Layout::NHWC) {
+        return forward_channels_last(input);
+    }
+
+    int N = input.batch();
+    Tensor output(N, output_shape[0], output_shape[1], output_shape[2]);
+
+    // Threads split the batch, each one computes whole samples with its own workspace (im2col
+    // columns, Winograd tiles, bordered input strips or FFT tiles), which is reused from sample to sample
+    int num_threads = std::max(1, std::min(ThreadPool::global().num_threads(), N));
+    reserve_workspaces(num_threads);
+    ThreadPool::global().parallel_for(0, num_threads, [&](int thd) {
+        for (int n = thd; n < N; n += num_threads) {
+            forward_sample(input, n, output.channel(n, 0).data(), workspaces[thd]);
+        }
+    });
+
+    return output;
+}
+
+Tensor Conv2D::backward(const Tensor& grad_output) {
+    if (cache_input.layout() == Layout::NHWC) {
+        if (grad_output.layout() != Layout::NHWC) {
+            return backward_channels_last(grad_output.to_nhwc());
+        }
+        return backward_channels_last(grad_output);
+    }
+    if (algorithm_ == ConvAlgorithm::Fft) {
+        return backward_fft(grad_output);
+    }
+
+    int N = cache_input.batch(); // Number of samples in the batch
+    int C_in = input_shape[0];
+    int C_out = output_shape[0];
+    int P = output_shape[1] * output_shape[2]; // Output pixels per channel
+
+    // Initialize the gradient for input, col2im only ever adds to it
+    Tensor grad_input(N, C_in, input_shape[1], input_shape[2]);
+
+    // Threads split the batch, so the samples of grad_input they scatter into never overlap.
+    // Filter and bias gradients are accumulated per thread and summed afterwards, with no locking.
+    int num_threads = std::max(1, std::min(ThreadPool::global().num_threads(), N));
+    reserve_workspaces(num_threads);
+    std::vector<Tensor::Matrix> partial_filters(num_threads, Tensor::Matrix::Zero(C_out, filter_matrix.cols()));
+    std::vector<Eigen::VectorXf> partial_biases(num_threads, Eigen::VectorXf::Zero(C_out));
+
+    // Each group's products only involve its rows of the filters, the columns and the output gradient
+    int group_out = C_out / groups_;
+    int group_in = C_in / groups_;
+    int H_out = output_shape[1];
+    int W_out = output_shape[2];
+    int taps = kernel_size_ * kernel_size_;
+
+    ThreadPool::global().parallel_for(0, num_threads, [&](int thd) {
+        Tensor::Matrix& columns = workspaces[thd].columns;
+        for (int n = thd; n < N; n += num_threads) {
+            Tensor::ConstChannelMap sample_grad(grad_output.channel(n, 0).data(), C_out, P);
+
+            // dL/db = sum of dL/dY over the pixels, dL/dW = dL/dY x im2col(X)^T
+            partial_biases[thd] += sample_grad.rowwise().sum();
+            if (is_pointwise()) {
+                Tensor::ChannelMap sample_grad_input(grad_input.channel(n, 0).data(), C_in, P);
+                for (int g = 0; g < groups_; ++g) {
+                    auto group_grad = sample_grad.middleRows(g * group_out, group_out);
+                    partial_filters[thd].middleRows(g * group_out, group_out).noalias() +=
+                        group_grad * sample_matrix(cache_input, n).middleRows(g * group_in, group_in).transpose();
+                    sample_grad_input.middleRows(g * group_in, group_in).noalias() =
+                        filter_matrix.middleRows(g * group_out, group_out).transpose() * group_grad;
+                }
+                continue;
+            }
+            // Strip by strip and block of input channels by block, like the forward pass
+            for (int top = 0; top < H_out; top += tiling_.rows) {
+                int rows = std::min(tiling_.rows, H_out - top);
+                for (int g = 0; g < groups_; ++g) {
+                    auto group_grad = sample_grad.block(g * group_out, top * W_out, group_out, rows * W_out);
+                    for (int c = 0; c < group_in; c += tiling_.in_channels) {
+                        int channels = std::min(tiling_.in_channels, group_in - c);
+                        float* data = scratch(columns, static_cast<Eigen::Index>(channels) * taps * rows * W_out);
+                        im2col(cache_input, n, data, g * group_in + c, channels, top, rows);
+                        Tensor::ChannelMap block(data, channels * taps, rows * W_out);
+                        partial_filters[thd].block(g * group_out, c * taps, group_out, channels * taps).noalias() +=
+                            group_grad * block.transpose();
+
+                        // dL/dX = col2im(W^T x dL/dY), the block is no longer needed and holds the product
+                        block.noalias() = filter_matrix.block(g * group_out, c * taps, group_out, channels * taps).transpose() * group_grad;
+                        col2im(data, n, grad_input, g * group_in + c, channels, top, rows);
                     }
                 }
             }
-        }, thd);
+        }
+    });
+
+    // Sum the per-thread partials and scatter them back into the per-filter weight layout
+    for (int thd = 1; thd < num_threads; ++thd) {
+        partial_filters[0] += partial_filters[thd];
+        partial_biases[0] += partial_biases[thd];
     }
-    // Wait for all threads to finish
-    for (auto& thd : threads) {
-        thd.join();
+    for (int c_out = 0; c_out < C_out; ++c_out) {
+        grad_biases[c_out](0) = partial_biases[0](c_out);
+        for (int c_in = 0; c_in < C_in / groups_; ++c_in) {
+            for (int ki = 0; ki < kernel_size_; ++ki) {
+                for (int kj = 0; kj < kernel_size_; ++kj) {
+                    grad_weights[c_out](c_in, kj * kernel_size_ + ki) =
+                        partial_filters[0](c_out, (c_in * kernel_size_ + ki) * kernel_size_ + kj);
+                }
+            }
+        }
     }
 
-    return output;
+    // Return the computed gradient tensor for input
+    return grad_input;
 }
 
-Tensor Conv2D::backward(const Tensor& grad_output) {
-    // Initialize gradient tensors
-    Tensor grad_input(input_shape);  // Initialize the gradient for input
+Tensor Conv2D::backward_fft(const Tensor& grad_output) {
+    int N = cache_input.batch();
+    int C_in = input_shape[0];
+    int H_in = input_shape[1];
+    int W_in = input_shape[2];
+    int C_out = output_shape[0];
+    int H_out = output_shape[1];
+    int W_out = output_shape[2];
+    int F = fft.spectrum_size();
+    int tile_h = fft.height() - kernel_size_ + 1;
+    int tile_w = fft.width() - kernel_size_ + 1;
 
-    // Create threads for parallel computation
-    std::vector<std::thread> threads;
-    std::mutex grad_input_mutex; // mutex for protecting grad_input
-    int num_threads = std::thread::hardware_concurrency();
-    for (int thd = 0; thd < num_threads; ++thd) {
-        threads.emplace_back([&](int thd){
-            // Iterate through each output channel
-            for (int c_out = thd; c_out < output_shape[0]; c_out += num_threads) {
-                // Extract the gradient for the output channel
-                Eigen::MatrixXf grad_output_channel = grad_output[c_out];
-
-                // Update biases: dL/db_i = sum(dL/dz_i) for all i
-                grad_biases[c_out](0) = grad_output_channel.sum();
-
-                // Iterate through each input channel
-                for (int c_in = 0; c_in < input_shape[0]; ++c_in) {
-
-                    // Weight gradient computation using valid convolution
-                    for (int i = 0; i < output_shape[1]; ++i) {
-                        for (int j = 0; j < output_shape[2]; ++j) {
-                            int start_row = i * stride_;
-                            int start_col = j * stride_;
-
-                            // Check if the kernel goes out of bounds
-                            if (start_row + kernel_size_ > cache_input[c_in].rows() || 
-                                start_col + kernel_size_ > cache_input[c_in].cols()) {
-                                continue; // Skip this position
-                            }
+    Tensor grad_input(N, C_in, H_in, W_in);
 
-                            // Extract the valid region from the input
-                            Eigen::MatrixXf region = cache_input[c_in].block(start_row, start_col, kernel_size_, kernel_size_);
+    // Threads split the batch, so the samples of grad_input they add into never overlap. The filter
+    // gradients are summed per thread as spectra and only transformed back once, at the end.
+    int num_threads = std::max(1, std::min(ThreadPool::global().num_threads(), N));
+    reserve_workspaces(num_threads);
+    std::vector<FFT2D::Spectra> partial_filters(num_threads, FFT2D::Spectra::Zero(C_out * C_in, F));
+    std::vector<Eigen::VectorXf> partial_biases(num_threads, Eigen::VectorXf::Zero(C_out));
 
-                            // Accumulate gradients for weights
-                            Eigen::MatrixXf region_flat = Eigen::Map<Eigen::MatrixXf>(region.data(), 1, region.size());
-                            grad_weights[c_out].row(c_in) += region_flat * grad_output_channel(i, j);
+    ThreadPool::global().parallel_for(0, num_threads, [&](int thd) {
+        // Rows: the input tile of each input channel, the output gradient tile of each output channel,
+        // then the input gradient being summed
+        FFT2D::Spectra& spectra = workspaces[thd].spectra;
+        spectra.resize(C_in + C_out + 1, F);
+        Tensor::Matrix& plane = workspaces[thd].columns;
+        plane.resize(fft.height(), fft.width());
+        auto grad_spectrum = spectra.row(C_in + C_out).array();
+
+        for (int n = thd; n < N; n += num_threads) {
+            partial_biases[thd] += Tensor::ConstChannelMap(grad_output.channel(n, 0).data(), C_out, H_out * W_out)
+                .rowwise().sum();
+            for (int top = 0; top < H_out; top += tile_h) {
+                for (int left = 0; left < W_out; left += tile_w) {
+                    int row = top - padding_;
+                    int col = left - padding_;
+                    for (int c_in = 0; c_in < C_in; ++c_in) {
+                        int rows = load_tile(cache_input.channel(n, c_in).data(), H_in, W_in, row, col, plane);
+                        fft.forward(plane.data(), rows, spectra.row(c_in).data());
+                    }
+                    // The gradient tile holds only this tile's outputs, the rest of it is zero
+                    for (int c_out = 0; c_out < C_out; ++c_out) {
+                        plane.setZero();
+                        int rows = std::min(tile_h, H_out - top);
+                        int cols = std::min(tile_w, W_out - left);
+                        plane.topLeftCorner(rows, cols) =
+                            grad_output.channel(n, c_out).block(top, left, rows, cols);
+                        fft.forward(plane.data(), rows, spectra.row(C_in + c_out).data());
+                    }
+
+                    // dL/dW = X correlated with dL/dY, whose spectrum is X * conj(dL/dY)
+                    for (int c_out = 0; c_out < C_out; ++c_out) {
+                        auto grad = spectra.row(C_in + c_out).array().conjugate();
+                        for (int c_in = 0; c_in < C_in; ++c_in) {
+                            partial_filters[thd].row(c_out * C_in + c_in).array() += spectra.row(c_in).array() * grad;
                         }
                     }
 
-                    // Extract the weight kernel for this output-input channel pair
-                    Eigen::MatrixXf kernel = weights[c_out].row(c_in);
-                    kernel = Eigen::Map<Eigen::MatrixXf>(kernel.data(), kernel_size_, kernel_size_);
+                    // dL/dX = dL/dY convolved with W, whose spectrum is dL/dY * W. Each tile's input
+                    // gradient overlaps its neighbours' and is added in, except over the padding.
+                    for (int c_in = 0; c_in < C_in; ++c_in) {
+                        grad_spectrum.setZero();
+                        for (int c_out = 0; c_out < C_out; ++c_out) {
+                            grad_spectrum += spectra.row(C_in + c_out).array() *
+                                filter_spectra.row(c_out * C_in + c_in).array().conjugate();
+                        }
+                        fft.inverse(grad_spectrum.data(), fft.height(), plane.data());
+                        int top_in = std::max(0, row);
+                        int left_in = std::max(0, col);
+                        int bottom_in = std::min<int>(H_in, row + fft.height());
+                        int right_in = std::min<int>(W_in, col + fft.width());
+                        if (top_in < bottom_in && left_in < right_in) {
+                            grad_input.channel(n, c_in).block(top_in, left_in, bottom_in - top_in, right_in - left_in) +=
+                                plane.block(top_in - row, left_in - col, bottom_in - top_in, right_in - left_in);
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    // Sum the per-thread partials, the first K x K values of each inverse are the kernel's gradient
+    for (int thd = 1; thd < num_threads; ++thd) {
+        partial_filters[0] += partial_filters[thd];
+        partial_biases[0] += partial_biases[thd];
+    }
+    Tensor::Matrix plane(fft.height(), fft.width());
+    for (int c_out = 0; c_out < C_out; ++c_out) {
+        grad_biases[c_out](0) = partial_biases[0](c_out);
+        for (int c_in = 0; c_in < C_in; ++c_in) {
+            fft.inverse(partial_filters[0].row(c_out * C_in + c_in).data(), kernel_size_, plane.data());
+            for (int ki = 0; ki < kernel_size_; ++ki) {
+                for (int kj = 0; kj < kernel_size_; ++kj) {
+                    grad_weights[c_out](c_in, kj * kernel_size_ + ki) = plane(ki, kj);
+                }
+            }
+        }
+    }
+
+    return grad_input;
+}
+
+void Conv2D::pack_weights() {
+    int C_in = input_shape[0];
+    int C_out = weights.size();
+    packed_weights.resize(kernel_size_ * kernel_size_);
+    for (int ki = 0; ki < kernel_size_; ++ki) {
+        for (int kj = 0; kj < kernel_size_; ++kj) {
+            // weights[c_out] holds the kernel of every input channel, element (ki, kj) at column kj * K + ki
+            Eigen::MatrixXf& packed = packed_weights[ki * kernel_size_ + kj];
+            packed.setZero(C_in, C_out);
+            for (int c_out = 0; c_out < C_out; ++c_out) {
+                int group = c_out / (C_out / groups_);
+                packed.col(c_out).segment(group * (C_in / groups_), C_in / groups_) =
+                    source_weights()[c_out].col(kj * kernel_size_ + ki);
+            }
+        }
+    }
+}
+
+Tensor Conv2D::forward_channels_last(const Tensor& input) {
+    int N = input.batch();
+    int C_in = input_shape[0];
+    int H_in = input_shape[1];
+    int W_in = input_shape[2];
+    int C_out = output_shape[0];
+    int H_out = output_shape[1];
+    int W_out = output_shape[2];
+
+    pack_weights();
+    Eigen::RowVectorXf bias(C_out);
+    for (int c_out = 0; c_out < C_out; ++c_out) {
+        bias(c_out) = source_biases()[c_out](0);
+    }
+
+    Tensor output(N, C_out, H_out, W_out, Layout::NHWC);
+
+    // Each output row is a (W_out x C_out) matrix. For every kernel offset, the input pixels it reads
+    // form a (W_out x C_in) matrix whose rows are unit-stride over the input channels, so the
+    // offset's contribution is a single matrix product with its (C_in x C_out) weights.
+    ThreadPool::global().parallel_for(0, N * H_out, [&](int idx) {
+        int n = idx / H_out;
+        int i = idx % H_out;
+        Tensor::ChannelMap output_row(output.pixel(n, i, 0).data(), W_out, C_out);
+        output_row.rowwise() = bias;
+
+        for (int ki = 0; ki < kernel_size_; ++ki) {
+            int row = i * stride_ + ki - padding_;
+            if (row < 0 || row >= H_in) {
+                continue; // The whole kernel row lies in the zero padding
+            }
+            for (int kj = 0; kj < kernel_size_; ++kj) {
+                auto [begin, end] = valid_columns(kj - padding_, stride_, W_in, W_out);
+                if (begin == end) {
+                    continue;
+                }
+                int col = begin * stride_ + kj - padding_;
+                ConstPixelRows taps(input.pixel(n, row, col).data(), end - begin, C_in,
+                    Eigen::OuterStride<>(stride_ * C_in));
+                output_row.middleRows(begin, end - begin).noalias() +=
+                    taps * packed_weights[ki * kernel_size_ + kj];
+            }
+        }
+    });
+
+    return output;
+}
+
+Tensor Conv2D::backward_channels_last(const Tensor& grad_output) {
+    int N = cache_input.batch();
+    int C_in = input_shape[0];
+    int H_in = input_shape[1];
+    int W_in = input_shape[2];
+    int C_out = output_shape[0];
+    int H_out = output_shape[1];
+    int W_out = output_shape[2];
+    int K2 = kernel_size_ * kernel_size_;
 
-                    // Flip the kernel 180 degrees for convolution. 
-                    Eigen::MatrixXf flipped_kernel = kernel.colwise().reverse().rowwise().reverse();
+    Tensor grad_input(N, C_in, H_in, W_in, Layout::NHWC);
 
-                    // Compute the gradient for the input tensor using full convolution
-                    Eigen::MatrixXf grad_output_padded = Eigen::MatrixXf::Zero(
-                        grad_output_channel.rows() + 2 * (kernel_size_ - 1),
-                        grad_output_channel.cols() + 2 * (kernel_size_ - 1)
-                    );
+    // Threads split the batch, so the input gradient rows they scatter into never overlap.
+    // Weight and bias gradients are accumulated per thread and summed afterwards.
+    int num_threads = std::max(1, std::min(ThreadPool::global().num_threads(), N));
+    std::vector<std::vector<Eigen::MatrixXf>> partial_weights(num_threads,
+        std::vector<Eigen::MatrixXf>(K2, Eigen::MatrixXf::Zero(C_in, C_out)));
+    std::vector<Eigen::RowVectorXf> partial_biases(num_threads, Eigen::RowVectorXf::Zero(C_out));
 
-                    grad_output_padded.block(kernel_size_ - 1, kernel_size_ - 1, 
-                                            grad_output_channel.rows(), grad_output_channel.cols()) = grad_output_channel;
+    ThreadPool::global().parallel_for(0, num_threads, [&](int thd) {
+        for (int n = thd; n < N; n += num_threads) {
+            for (int i = 0; i < H_out; ++i) {
+                Tensor::ConstChannelMap grad_row(grad_output.pixel(n, i, 0).data(), W_out, C_out);
+                partial_biases[thd] += grad_row.colwise().sum();
 
-                    for (int i = 0; i < grad_output_channel.rows(); ++i) {
-                        for (int j = 0; j < grad_output_channel.cols(); ++j) {
-                            Eigen::MatrixXf region = grad_output_padded.block(i, j, kernel_size_, kernel_size_);
-                            grad_input_mutex.lock(); // Lock the mutex before updating the shared resource
-                            grad_input[c_in](i, j) += (region.array() * flipped_kernel.array()).sum();
-                            grad_input_mutex.unlock();
+                for (int ki = 0; ki < kernel_size_; ++ki) {
+                    int row = i * stride_ + ki - padding_;
+                    if (row < 0 || row >= H_in) {
+                        continue;
+                    }
+                    for (int kj = 0; kj < kernel_size_; ++kj) {
+                        auto [begin, end] = valid_columns(kj - padding_, stride_, W_in, W_out);
+                        if (begin == end) {
+                            continue;
                         }
+                        int col = begin * stride_ + kj - padding_;
+                        int k = ki * kernel_size_ + kj;
+                        auto grad = grad_row.middleRows(begin, end - begin);
+                        ConstPixelRows taps(cache_input.pixel(n, row, col).data(), end - begin, C_in,
+                            Eigen::OuterStride<>(stride_ * C_in));
+                        PixelRows grad_taps(grad_input.pixel(n, row, col).data(), end - begin, C_in,
+                            Eigen::OuterStride<>(stride_ * C_in));
+
+                        partial_weights[thd][k].noalias() += taps.transpose() * grad;
+                        grad_taps.noalias() += grad * packed_weights[k].transpose();
                     }
                 }
             }
-        }, thd);
-    }
+        }
+    });
 
-    // Wait for all threads to finish
-    for (auto& thd : threads) {
-        thd.join();
+    // Sum the per-thread partials and scatter them back into the per-filter weight layout
+    for (int c_out = 0; c_out < C_out; ++c_out) {
+        grad_biases[c_out].setZero();
+        grad_weights[c_out].setZero();
+    }
+    for (int thd = 0; thd < num_threads; ++thd) {
+        for (int c_out = 0; c_out < C_out; ++c_out) {
+            grad_biases[c_out](0) += partial_biases[thd](c_out);
+        }
+        for (int ki = 0; ki < kernel_size_; ++ki) {
+            for (int kj = 0; kj < kernel_size_; ++kj) {
+                const Eigen::MatrixXf& partial = partial_weights[thd][ki * kernel_size_ + kj];
+                for (int c_out = 0; c_out < C_out; ++c_out) {
+                    // Only the input channels of the output channel's group have weights
+                    int group = c_out / (C_out / groups_);
+                    grad_weights[c_out].col(kj * kernel_size_ + ki) +=
+                        partial.col(c_out).segment(group * (C_in / groups_), C_in / groups_);
+                }
+            }
+        }
     }
 
-    // Return the computed gradient tensor for input
     return grad_input;
 }
 
@@ -234,21 +1395,36 @@ void Conv2D::serialize(std::ofstream& toFileStream) const {
     int oc = weights.size();
     toFileStream.write((char*)&oc, sizeof(int));
 
-    // Write the layer attributes
+    // Write the layer attributes, grouped layers are saved as "GroupedConv2D" and add their groups
     toFileStream.write((char*)&kernel_size_, sizeof(int));
     toFileStream.write((char*)&stride_, sizeof(int));
     toFileStream.write((char*)&padding_, sizeof(int));
+    if (groups_ > 1) {
+        toFileStream.write((char*)&groups_, sizeof(int));
+    }
 
-    // Write the weights and biases
-    for (int i = 0; i < weights.size(); ++i) {
+    write_parameters(toFileStream);
+}
+
+void Conv2D::write_parameters(std::ofstream& toFileStream) const {
+    for (size_t i = 0; i < weights.size(); ++i) {
         toFileStream.write((char*)weights[i].data(), weights[i].size() * sizeof(float));
     }
-    for (int i = 0; i < biases.size(); ++i) {
+    for (size_t i = 0; i < biases.size(); ++i) {
         toFileStream.write((char*)biases[i].data(), biases[i].size() * sizeof(float));
     }
 }
 
-Conv2D* Conv2D::deserialize(std::ifstream& fromFileStream) {
+void Conv2D::read_parameters(std::ifstream& fromFileStream) {
+    for (size_t i = 0; i < weights.size(); ++i) {
+        fromFileStream.read((char*)weights[i].data(), weights[i].size() * sizeof(float));
+    }
+    for (size_t i = 0; i < biases.size(); ++i) {
+        fromFileStream.read((char*)biases[i].data(), biases[i].size() * sizeof(float));
+    }
+}
+
+Conv2D* Conv2D::deserialize(std::ifstream& fromFileStream, bool grouped) {
     // Read the number of input channels
     int input_channels;
     fromFileStream.read((char*)&input_channels, sizeof(int));
@@ -259,20 +1435,46 @@ Conv2D* Conv2D::deserialize(std::ifstream& fromFileStream) {
 
     // Read the layer attributes
     int kernel_size, stride, padding;
+    int groups = 1;
     fromFileStream.read((char*)&kernel_size, sizeof(int));
     fromFileStream.read((char*)&stride, sizeof(int));
     fromFileStream.read((char*)&padding, sizeof(int));
+    if (grouped) {
+        fromFileStream.read((char*)&groups, sizeof(int));
+    }
+
+    // Create a new Conv2D layer and read the weights and biases
+    Conv2D* layer = new Conv2D(input_channels, output_channels, kernel_size, stride, padding, groups);
+    layer->read_parameters(fromFileStream);
+    return layer;
+}
 
-    // Create a new Conv2D layer
-    Conv2D* layer = new Conv2D(input_channels, output_channels, kernel_size, stride, padding);
+DepthwiseConv2D::DepthwiseConv2D(int channels, int kernel_size, int stride, int padding, int depth_multiplier)
+    : Conv2D(channels, channels * depth_multiplier, kernel_size, stride, padding, channels),
+      depth_multiplier_(depth_multiplier) {}
 
-    // Read the weights and biases
-    for (int i = 0; i < output_channels; ++i) {
-        fromFileStream.read((char*)layer->get_weights()[i]->data(), input_channels * kernel_size * kernel_size * sizeof(float));
-    }
-    for (int i = 0; i < output_channels; ++i) {
-        fromFileStream.read((char*)layer->get_bias()[i]->data(), 1 * sizeof(float));
-    }
+void DepthwiseConv2D::serialize(std::ofstream& toFileStream) const {
+    int channels = get_groups();
+    int kernel_size = get_kernel_size();
+    int stride = get_stride();
+    int padding = get_padding();
+    toFileStream.write((char*)&channels, sizeof(int));
+    toFileStream.write((char*)&kernel_size, sizeof(int));
+    toFileStream.write((char*)&stride, sizeof(int));
+    toFileStream.write((char*)&padding, sizeof(int));
+    toFileStream.write((char*)&depth_multiplier_, sizeof(int));
+    write_parameters(toFileStream);
+}
 
+DepthwiseConv2D* DepthwiseConv2D::deserialize(std::ifstream& fromFileStream) {
+    int channels, kernel_size, stride, padding, depth_multiplier;
+    fromFileStream.read((char*)&channels, sizeof(int));
+    fromFileStream.read((char*)&kernel_size, sizeof(int));
+    fromFileStream.read((char*)&stride, sizeof(int));
+    fromFileStream.read((char*)&padding, sizeof(int));
+    fromFileStream.read((char*)&depth_multiplier, sizeof(int));
+
+    DepthwiseConv2D* layer = new DepthwiseConv2D(channels, kernel_size, stride, padding, depth_multiplier);
+    layer->read_parameters(fromFileStream);
     return layer;
-}
\ No newline at end of file
+}
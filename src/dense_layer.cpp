@@ -7,15 +7,53 @@ DenseLayer::DenseLayer(int input_size, int output_size)
       grad_bias(Eigen::VectorXf::Zero(output_size)) {}
 
 Tensor DenseLayer::forward(const Tensor& input) {
-    this->input = input.getSingleMatrix();
-    return Tensor((this->input * weights).rowwise() + bias.transpose()); // Row wise bias addition
+    if (precision == Precision::FP32) {
+        this->input = input.getSingleMatrix();
+        return Tensor((this->input * source_weights()).rowwise() + source_bias().transpose()); // Row wise bias addition
+    }
+
+    Tensor::ConstChannelMap input_mat = input.getSingleMatrix();
+    if (!training) {
+        // Inference streams the reduced-precision weights, which are refreshed after training
+        if (compact_weights_stale) {
+            compact_weights.store(source_weights());
+            compact_weights_stale = false;
+        }
+        return Tensor(compact_weights.multiply(input_mat).rowwise() + source_bias().transpose());
+    }
+
+    // Training keeps fp32 weights but caches the input for backward in reduced precision
+    compact_input.store(input_mat);
+    return Tensor((input_mat * source_weights()).rowwise() + source_bias().transpose());
 }
 
 Tensor DenseLayer::backward(const Tensor& grad_output) {
     Eigen::MatrixXf grad_output_mat = grad_output.getSingleMatrix();
-    grad_weights = input.transpose() * grad_output_mat; // dL/dW = X^T * dL/dY
+    if (precision == Precision::FP32) {
+        grad_weights = input.transpose() * grad_output_mat; // dL/dW = X^T * dL/dY
+    } else {
+        grad_weights = compact_input.transpose_multiply(grad_output_mat);
+    }
     grad_bias = grad_output_mat.colwise().sum(); // dL/db = sum(dL/dY)
-    return Tensor(grad_output_mat * weights.transpose()); // dL/dX = dL/dY * W^T
+    return Tensor(grad_output_mat * source_weights().transpose()); // dL/dX = dL/dY * W^T
+}
+
+void DenseLayer::set_training(bool training) {
+    this->training = training;
+    compact_weights_stale = true; // The weights may have been updated since the last copy
+}
+
+void DenseLayer::set_precision(Precision precision) {
+    this->precision = precision;
+    compact_input = CompactMatrix(precision);
+    compact_weights = CompactMatrix(precision);
+    compact_weights_stale = true;
+    input.resize(0, 0);
+}
+
+bool DenseLayer::share_parameters(const Layer* owner) {
+    shared = dynamic_cast<const DenseLayer*>(owner);
+    return owner == nullptr || shared != nullptr;
 }
 
 bool DenseLayer::has_weights() const { return true; }
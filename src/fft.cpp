@@ -0,0 +1,172 @@
+#include "../include/Eidos/fft.h"
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+    using Complex = FFT2D::Complex;
+    using Row = Eigen::Map<Eigen::ArrayXcf>;
+
+    constexpr double pi = 3.14159265358979323846;
+
+    // Plain complex product, without the NaN and infinity handling of std::complex's operator*
+    inline Complex multiply(Complex a, Complex b) {
+        return {a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real()};
+    }
+
+    std::vector<Complex> twiddles(int n) {
+        std::vector<Complex> factors(n / 2);
+        for (int k = 0; k < n / 2; ++k) {
+            double angle = -2.0 * pi * k / n;
+            factors[k] = Complex(static_cast<float>(std::cos(angle)), static_cast<float>(std::sin(angle)));
+        }
+        return factors;
+    }
+
+    std::vector<int> bit_reversal(int n) {
+        std::vector<int> reversed(n, 0);
+        for (int i = 1; i < n; ++i) {
+            reversed[i] = (reversed[i >> 1] >> 1) | ((i & 1) ? n >> 1 : 0);
+        }
+        return reversed;
+    }
+
+    bool is_power_of_two(int n) {
+        return n > 0 && (n & (n - 1)) == 0;
+    }
+
+    // Checked before any table is built from the size
+    int checked_size(int n) {
+        if (!is_power_of_two(n)) {
+            throw std::invalid_argument("FFT sizes must be powers of two.");
+        }
+        return n;
+    }
+}
+
+FFT2D::FFT2D(int height, int width)
+    : height_(checked_size(height)), width_(checked_size(width)),
+      row_twiddles(twiddles(width_)), column_twiddles(twiddles(height_)),
+      row_reversal(bit_reversal(width_)), column_reversal(bit_reversal(height_)) {}
+
+int FFT2D::next_power_of_two(int size) {
+    int power = 1;
+    while (power < size) {
+        power <<= 1;
+    }
+    return power;
+}
+
+void FFT2D::transform_row(Complex* values, bool inverse) const {
+    int n = width_;
+    for (int i = 0; i < n; ++i) {
+        int j = row_reversal[i];
+        if (i < j) {
+            std::swap(values[i], values[j]);
+        }
+    }
+    for (int length = 2; length <= n; length <<= 1) {
+        int half = length / 2;
+        int step = n / length;
+        for (int i = 0; i < n; i += length) {
+            for (int k = 0; k < half; ++k) {
+                Complex w = row_twiddles[k * step];
+                Complex v = multiply(values[i + k + half], inverse ? std::conj(w) : w);
+                Complex u = values[i + k];
+                values[i + k] = u + v;
+                values[i + k + half] = u - v;
+            }
+        }
+    }
+}
+
+void FFT2D::transform_columns(Complex* spectrum, bool inverse) const {
+    // The same butterflies as transform_row, with whole spectrum rows in place of single values
+    int n = height_;
+    int cols = spectrum_cols();
+    auto row = [&](int i) { return Row(spectrum + i * cols, cols); };
+    for (int i = 0; i < n; ++i) {
+        int j = column_reversal[i];
+        if (i < j) {
+            row(i).swap(row(j));
+        }
+    }
+    Eigen::ArrayXcf product(cols);
+    for (int length = 2; length <= n; length <<= 1) {
+        int half = length / 2;
+        int step = n / length;
+        for (int i = 0; i < n; i += length) {
+            for (int k = 0; k < half; ++k) {
+                Complex w = column_twiddles[k * step];
+                Row u = row(i + k);
+                Row v = row(i + k + half);
+                product = v * (inverse ? std::conj(w) : w);
+                v = u - product;
+                u += product;
+            }
+        }
+    }
+}
+
+void FFT2D::forward(const float* plane, int rows, Complex* spectrum) const {
+    int cols = spectrum_cols();
+    std::vector<Complex> values(width_);
+
+    // Rows a and b go in as one complex sequence a + ib. Their transforms A and B are Hermitian,
+    // so they separate as A[k] = (Z[k] + conj(Z[-k])) / 2 and B[k] = (Z[k] - conj(Z[-k])) / 2i.
+    for (int r = 0; r < height_; r += 2) {
+        Complex* first = spectrum + r * cols;
+        Complex* second = r + 1 < height_ ? first + cols : nullptr;
+        if (r >= rows) {
+            std::fill(first, first + (second ? 2 : 1) * cols, Complex(0.0f, 0.0f));
+            continue;
+        }
+        const float* a = plane + r * width_;
+        const float* b = r + 1 < rows ? a + width_ : nullptr;
+        for (int k = 0; k < width_; ++k) {
+            values[k] = Complex(a[k], b ? b[k] : 0.0f);
+        }
+        transform_row(values.data(), false);
+        for (int k = 0; k < cols; ++k) {
+            Complex z = values[k];
+            Complex mirror = std::conj(values[(width_ - k) & (width_ - 1)]);
+            first[k] = 0.5f * (z + mirror);
+            if (second) {
+                Complex difference = z - mirror;
+                second[k] = Complex(0.5f * difference.imag(), -0.5f * difference.real());
+            }
+        }
+    }
+
+    transform_columns(spectrum, false);
+}
+
+void FFT2D::inverse(Complex* spectrum, int rows, float* plane) const {
+    transform_columns(spectrum, true);
+
+    // The inverse of the row transforms of a and b is the inverse of A + iB, whose real and
+    // imaginary parts are a and b. The columns past width/2 follow from A[-k] = conj(A[k]).
+    int cols = spectrum_cols();
+    float scale = 1.0f / (static_cast<float>(height_) * width_);
+    std::vector<Complex> values(width_);
+    for (int r = 0; r < rows; r += 2) {
+        const Complex* first = spectrum + r * cols;
+        const Complex* second = r + 1 < height_ ? first + cols : nullptr;
+        for (int k = 0; k < width_; ++k) {
+            bool mirrored = k >= cols;
+            int index = mirrored ? width_ - k : k;
+            Complex a = mirrored ? std::conj(first[index]) : first[index];
+            Complex b = second ? (mirrored ? std::conj(second[index]) : second[index]) : Complex(0.0f, 0.0f);
+            values[k] = Complex(a.real() - b.imag(), a.imag() + b.real());
+        }
+        transform_row(values.data(), true);
+        float* a = plane + r * width_;
+        float* b = r + 1 < rows ? a + width_ : nullptr;
+        for (int k = 0; k < width_; ++k) {
+            a[k] = values[k].real() * scale;
+            if (b) {
+                b[k] = values[k].imag() * scale;
+            }
+        }
+    }
+}
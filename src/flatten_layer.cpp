@@ -3,61 +3,67 @@
 #include <stdexcept>
 #include <Eigen/Dense>
 
-// Forward pass: Flattens the input tensor into a 1D vector within a 3D structure
+// Forward pass: Flattens each sample of the input tensor into one row of a single matrix
 Tensor FlattenLayer::forward(const Tensor& input) {
-   // Get the shape of the input tensor (assuming it's 3D)
-    // Assuming shape is a tuple (c, h, w)
-    auto shape = input.shape();  // (c, h, w)
+    return forward(Tensor(input));
+}
+
+// Forward pass on an input that is no longer needed: only the shape changes, the buffer is reused
+Tensor FlattenLayer::forward(Tensor&& input) {
+    // Get the shape of the input tensor (n, c, h, w)
+    auto shape = input.batch_shape();
 
     // Accessing the individual elements of the tuple using std::get
-    int c = std::get<0>(shape);  // channels
-    int h = std::get<1>(shape);  // height
-    int w = std::get<2>(shape);  // width
+    int n = std::get<0>(shape);  // batch size
+    int c = std::get<1>(shape);  // channels
+    int h = std::get<2>(shape);  // height
+    int w = std::get<3>(shape);  // width
 
     // Calculate the flattened size
     int flattened_size = c * h * w;
 
-    this->input_shape = {c, h, w};
-    this->output_shape = {1, 1, flattened_size};
+    this->input_shape = {c, h, w, n};
+    this->output_shape = {n, flattened_size};
+    this->input_layout = input.layout();
 
-    // Create an Eigen Matrix to store the flattened data
-    Eigen::MatrixXf flattened(1, flattened_size);
-
-    // Manually flattening with a loop (iterate through each matrix in the vector)
-    size_t idx = 0;
-    for (size_t i = 0; i < c; ++i) {
-        Eigen::MatrixXf matrix = input[i];  // Access each matrix (channel)
-        Eigen::Map<Eigen::MatrixXf> flattened_map(flattened.data() + idx, 1, matrix.size());
-        flattened_map = matrix.transpose().reshaped(1, matrix.size()); // Flatten each matrix (channel)
-        idx += matrix.size();
+    // Channels-last samples are transposed into (c, h, w) order, so the features seen by the
+    // following layers (and their trained weights) do not depend on the layout
+    if (input_layout == Layout::NHWC) {
+        Tensor flattened = input.to_nchw();
+        flattened.reshape(1, 1, n, flattened_size);
+        return flattened;
     }
 
-    // Return the flattened tensor as a 3D tensor (1, 1, flattened_size)
-    return Tensor(flattened);
+    // Channels are stored row-major and back to back, so each sample is already
+    // laid out in flattened order and the whole batch is one (n x c*h*w) block
+    Tensor flattened = std::move(input);
+    flattened.reshape(1, 1, n, flattened_size);
+
+    // Return the flattened tensor as a single matrix (1, n, flattened_size)
+    return flattened;
 }
 
 // Backward pass: Compute the gradient of the loss with respect to the input tensor
 Tensor FlattenLayer::backward(const Tensor& grad_output) {
-    // Get the gradient of the loss with respect to the output (flattened size)
-    Eigen::MatrixXf grad_data = grad_output.getSingleMatrix();
+    return backward(Tensor(grad_output));
+}
 
+Tensor FlattenLayer::backward(Tensor&& grad_output) {
     // Reshape the gradient to match the input shape of the flatten layer
     int c = input_shape[0];  // Number of channels
     int h = input_shape[1];  // Height of the input
     int w = input_shape[2];  // Width of the input
+    int n = input_shape[3];  // Batch size
 
-    Tensor grad_input(c, h, w);
-
-    // Reshape the gradient for each channel
-    for (int i = 0; i < c; ++i) {
-        // Extract the gradient block corresponding to one channel
-        Eigen::MatrixXf matrix = grad_data.block(0, i * h * w, 1, h * w);
-        
-        // Reshape the extracted matrix into (h, w) shape
-        Eigen::Map<Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic>> reshaped_matrix(matrix.data(), h, w);
+    if (grad_output.size() != static_cast<size_t>(n) * c * h * w) {
+        throw std::invalid_argument("Gradient size does not match the flatten layer input.");
+    }
 
-        // Store reshaped gradient into the grad_input tensor
-        grad_input[i] = reshaped_matrix;
+    // Row i of the gradient is sample i in (c, h, w) order, which is the buffer layout
+    Tensor grad_input = std::move(grad_output);
+    grad_input.reshape(n, c, h, w);
+    if (input_layout == Layout::NHWC) {
+        return grad_input.to_nhwc();
     }
 
     // Return the reshaped gradient as a tensor
@@ -0,0 +1,84 @@
+#include "../include/Eidos/layers/fused_conv_layer.h"
+#include "../include/Eidos/thread_pool.h"
+#include <limits>
+#include <stdexcept>
+#include <algorithm>
+
+namespace {
+    // Max pools one (height x width) plane, taking whole output rows at a time: the pool_size values
+    // of window column wj of an output row lie stride apart in the input row
+    void max_pool_plane(const float* input, int width, float* output, int output_height, int output_width,
+                        int pool_size, int stride) {
+        using StridedRow = Eigen::Map<const Eigen::ArrayXf, 0, Eigen::InnerStride<>>;
+        for (int i = 0; i < output_height; ++i) {
+            Eigen::Map<Eigen::ArrayXf> row(output + i * output_width, output_width);
+            row.setConstant(-std::numeric_limits<float>::infinity());
+            for (int wi = 0; wi < pool_size; ++wi) {
+                const float* input_row = input + (i * stride + wi) * width;
+                for (int wj = 0; wj < pool_size; ++wj) {
+                    row = row.max(StridedRow(input_row + wj, output_width, Eigen::InnerStride<>(stride)));
+                }
+            }
+        }
+    }
+}
+
+FusedConv2D::FusedConv2D(Conv2D& conv, Activation& activation, MaxPooling2D* pool)
+    : conv(conv), activation(activation), pool(pool) {
+    if (!activation.is_elementwise()) {
+        throw std::invalid_argument("FusedConv2D requires an element-wise activation, got " + activation.get_name() + ".");
+    }
+}
+
+Tensor FusedConv2D::forward(const Tensor& input) {
+    if (input.layout() == Layout::NHWC) {
+        // The channels-last kernels are not fused
+        Tensor output = activation.forward(conv.forward(input));
+        return pool ? pool->forward(output) : output;
+    }
+
+    conv.begin_forward(input);
+    const std::vector<int>& shape = conv.get_output_shape();
+    int N = input.batch();
+    int C = shape[0];
+    int H = shape[1];
+    int W = shape[2];
+    int pool_size = pool ? pool->get_pool_size() : 1;
+    int stride = pool ? pool->get_stride() : 1;
+    int H_out = (H - pool_size) / stride + 1;
+    int W_out = (W - pool_size) / stride + 1;
+    Tensor output(N, C, H_out, W_out);
+
+    // Threads split the batch. Without pooling each sample is convolved and activated in the output,
+    // otherwise in a buffer of the thread that is then pooled into the output.
+    int num_threads = std::max(1, std::min(ThreadPool::global().num_threads(), N));
+    conv.reserve_workspaces(num_threads);
+    if (conv_outputs.size() < static_cast<size_t>(num_threads)) {
+        conv_outputs.resize(num_threads);
+    }
+    ThreadPool::global().parallel_for(0, num_threads, [&](int thd) {
+        Tensor::Matrix& conv_output = conv_outputs[thd];
+        conv_output.resize(C, H * W);
+        for (int n = thd; n < N; n += num_threads) {
+            float* sample = pool ? conv_output.data() : output.channel(n, 0).data();
+            conv.forward_sample(input, n, sample, conv.get_workspace(thd));
+            activation.apply_inplace(Eigen::Map<Eigen::ArrayXf>(sample, C * H * W));
+            if (pool) {
+                for (int c = 0; c < C; ++c) {
+                    max_pool_plane(conv_output.row(c).data(), W, output.channel(n, c).data(), H_out, W_out,
+                                   pool_size, stride);
+                }
+            }
+        }
+    });
+
+    return output;
+}
+
+Tensor FusedConv2D::backward(const Tensor&) {
+    throw std::logic_error("FusedConv2D is an inference operator and has no backward pass.");
+}
+
+void FusedConv2D::serialize(std::ofstream&) const {
+    throw std::logic_error("FusedConv2D is not serialized, the layers it fuses are.");
+}
@@ -169,6 +169,24 @@ void GRULayer::serialize(std::ofstream& toFileStream) const {
     }
 }
 
+Layer* GRULayer::clone() const {
+    auto* copy = new GRULayer(*this);
+    if (activation != nullptr) {
+        copy->owned_activation.reset(activation->clone());
+        copy->activation = static_cast<Activation*>(copy->owned_activation.get());
+    }
+    if (gate_activation != nullptr) {
+        copy->owned_gate_activation.reset(gate_activation->clone());
+        copy->gate_activation = static_cast<Activation*>(copy->owned_gate_activation.get());
+    }
+    if ((activation != nullptr && copy->activation == nullptr) ||
+        (gate_activation != nullptr && copy->gate_activation == nullptr)) {
+        delete copy;
+        return nullptr;
+    }
+    return copy;
+}
+
 GRULayer* GRULayer::deserialize(std::ifstream& fromFileStream) {
     std::vector<Eigen::MatrixXf> weights;
     std::vector<Eigen::VectorXf> biases;
@@ -0,0 +1,67 @@
+#include "../include/Eidos/memory_planner.h"
+#include <algorithm>
+#include <numeric>
+
+void MemoryPlanner::clear() {
+    allocations_.clear();
+    events_ = 0;
+}
+
+size_t MemoryPlanner::record_allocation(size_t bytes) {
+    allocations_.push_back({bytes, events_++});
+    return allocations_.size() - 1;
+}
+
+void MemoryPlanner::record_release(size_t index) {
+    allocations_[index].end = events_++;
+}
+
+size_t MemoryPlanner::plan() {
+    // Place the largest allocations first, ties broken by allocation order
+    std::vector<size_t> order(allocations_.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return allocations_[a].bytes > allocations_[b].bytes;
+    });
+
+    size_t slab_size = 0;
+    std::vector<size_t> placed;
+    std::vector<const Allocation*> live;
+    for (size_t index : order) {
+        Allocation& current = allocations_[index];
+
+        // Collect the placed allocations that are alive at the same time, sorted by offset
+        live.clear();
+        for (size_t other : placed) {
+            const Allocation& candidate = allocations_[other];
+            if (candidate.begin < current.end && current.begin < candidate.end) {
+                live.push_back(&candidate);
+            }
+        }
+        std::sort(live.begin(), live.end(), [](const Allocation* a, const Allocation* b) {
+            return a->offset < b->offset;
+        });
+
+        // Take the lowest gap between live allocations that is large enough
+        size_t offset = 0;
+        for (const Allocation* other : live) {
+            if (other->offset >= offset + current.bytes) {
+                break;
+            }
+            offset = std::max(offset, other->offset + other->bytes);
+        }
+
+        current.offset = offset;
+        slab_size = std::max(slab_size, offset + current.bytes);
+        placed.push_back(index);
+    }
+    return slab_size;
+}
+
+bool MemoryPlanner::expects_allocation(size_t index, size_t bytes, size_t event) const {
+    return index < allocations_.size() && allocations_[index].bytes == bytes && allocations_[index].begin == event;
+}
+
+bool MemoryPlanner::expects_release(size_t index, size_t event) const {
+    return index < allocations_.size() && allocations_[index].end == event;
+}
@@ -9,16 +9,129 @@
 #include "../include/Eidos/layers/flatten_layer.h"
 #include "../include/Eidos/tensor.hpp"
 #include "../include/Eidos/preprocessors.h"
+#include "../include/Eidos/thread_pool.h"
+#include "../include/Eidos/bounded_queue.h"
+#include <atomic>
 #include <fstream>
 #include <filesystem>
 #include <string>
 #include <vector>
 #include <algorithm>
 #include <random>
+#include <thread>
 #include <Eigen/Dense>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+    // Boundaries of at most parts nearly equal, non-empty ranges covering [0, count)
+    std::vector<size_t> split_range(size_t count, int parts) {
+        size_t num_ranges = std::min(static_cast<size_t>(parts), count);
+        std::vector<size_t> bounds(num_ranges + 1);
+        for (size_t r = 0; r <= num_ranges; ++r) {
+            bounds[r] = count * r / num_ranges;
+        }
+        return bounds;
+    }
+
+    // Copies the weights and biases of a layer into a copy of it
+    void copy_layer_parameters(Layer& layer, Layer& copy) {
+        auto weights = layer.get_weights();
+        auto copy_weights = copy.get_weights();
+        for (size_t i = 0; i < weights.size(); ++i) {
+            *copy_weights[i] = *weights[i];
+        }
+        auto bias = layer.get_bias();
+        auto copy_bias = copy.get_bias();
+        for (size_t i = 0; i < bias.size(); ++i) {
+            *copy_bias[i] = *bias[i];
+        }
+    }
+
+    // Recurrent layers read the rows of a batch as the time steps of one sequence
+    bool is_recurrent(const Layer& layer) {
+        return layer.get_name() == "RNN" || layer.get_name() == "GRU";
+    }
+
+    // Adds the gradients of a copy of a layer to the layer's own, or replaces them when first is set
+    void accumulate_gradients(Layer& layer, Layer& copy, bool first) {
+        auto grad_weights = layer.get_grad_weights();
+        auto copy_grad_weights = copy.get_grad_weights();
+        for (size_t i = 0; i < grad_weights.size(); ++i) {
+            if (first) {
+                *grad_weights[i] = *copy_grad_weights[i];
+            } else {
+                *grad_weights[i] += *copy_grad_weights[i];
+            }
+        }
+        auto grad_bias = layer.get_grad_bias();
+        auto copy_grad_bias = copy.get_grad_bias();
+        for (size_t i = 0; i < grad_bias.size(); ++i) {
+            if (first) {
+                *grad_bias[i] = *copy_grad_bias[i];
+            } else {
+                *grad_bias[i] += *copy_grad_bias[i];
+            }
+        }
+    }
+
+    // Stacks the rows of the matrices into one, offsets[m] being the first row of matrix m and
+    // offsets.back() the number of rows
+    Eigen::MatrixXf stack_rows(const std::vector<Eigen::MatrixXf>& parts, std::vector<Eigen::Index>& offsets) {
+        offsets.assign(parts.size() + 1, 0);
+        for (size_t m = 0; m < parts.size(); ++m) {
+            offsets[m + 1] = offsets[m] + parts[m].rows();
+        }
+        Eigen::MatrixXf stacked(offsets.back(), parts[0].cols());
+        for (size_t m = 0; m < parts.size(); ++m) {
+            stacked.middleRows(offsets[m], parts[m].rows()) = parts[m];
+        }
+        return stacked;
+    }
+
+    // The activations (forward) or gradients (backward) of one micro-batch, handed between pipeline stages
+    struct MicroBatch {
+        int index = 0; // Micro-batch of the step, which is also the copy of the layers that runs it
+        int count = 0; // Micro-batches in the step
+        Tensor tensor;
+    };
+
+    // Pins the calling thread to the index-th of the CPUs it may run on, wrapping around, so a process
+    // restricted to some CPUs (taskset, cgroups) stays on them. Best effort, the thread keeps running
+    // wherever the scheduler puts it if this is not supported.
+    void pin_to_core(int index) {
+#if defined(__linux__)
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+            return;
+        }
+        int target = index % CPU_COUNT(&allowed);
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed) && target-- == 0) {
+                cpu_set_t core;
+                CPU_ZERO(&core);
+                CPU_SET(cpu, &core);
+                pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &core);
+                return;
+            }
+        }
+#else
+        (void)index;
+#endif
+    }
+}
 
 void Model::Add(Layer* layer) {
     this->layers.emplace_back(layer); // Wraps raw pointer in a unique_ptr
+    inference_plan.clear();
+    replicas.clear();
+    plan_layout();
 }
 
 void Model::add_callback(Callback* callback) {
@@ -49,6 +162,15 @@ void Model::set_train() {
     for (auto& layer : layers) {
         layer->set_training(true);
     }
+    // The fused operators do not cache anything for the backward pass
+    inference_plan.clear();
+    fused_layers.clear();
+}
+
+void Model::set_precision(Precision precision) {
+    for (auto& layer : layers) {
+        layer->set_precision(precision);
+    }
 }
 
 void Model::set_inference() {
@@ -56,16 +178,206 @@ void Model::set_inference() {
     for (auto& layer : layers) {
         layer->set_training(false);
     }
+    // Planned again on the next inference pass, from the layers as they are now
+    inference_plan.clear();
+    fused_layers.clear();
 }
 
-Tensor Model::forward(const Tensor& input) {
-   Tensor output = input;
+void Model::plan_inference() {
+    inference_plan.clear();
+    fused_layers.clear();
+    for (size_t i = 0; i < layers.size(); ++i) {
+        auto* conv = dynamic_cast<Conv2D*>(layers[i].get());
+        auto* activation = i + 1 < layers.size() ? dynamic_cast<Activation*>(layers[i + 1].get()) : nullptr;
+        if (conv == nullptr || activation == nullptr || !activation->is_elementwise()) {
+            inference_plan.push_back(layers[i].get());
+            continue;
+        }
+        auto* pool = i + 2 < layers.size() ? dynamic_cast<MaxPooling2D*>(layers[i + 2].get()) : nullptr;
+        fused_layers.emplace_back(new FusedConv2D(*conv, *activation, pool));
+        inference_plan.push_back(fused_layers.back().get());
+        i += pool ? 2 : 1;
+    }
+}
+
+void Model::enable_huge_pages(size_t threshold) {
+    Allocator::enable_huge_pages(threshold);
+
+    // Parameters are Eigen matrices that are already allocated, advise the large ones in place
     for (auto& layer : layers) {
-        output = layer->forward(output);
+        for (const auto& params : {layer->get_weights(), layer->get_grad_weights()}) {
+            for (Eigen::MatrixXf* matrix : params) {
+                size_t bytes = matrix->size() * sizeof(float);
+                if (bytes >= threshold) {
+                    Allocator::advise_huge_pages(matrix->data(), bytes);
+                }
+            }
+        }
+    }
+}
+
+void Model::set_layout(Layout layout) {
+    this->layout = layout;
+    auto_layout = false;
+    plan_layout();
+}
+
+Layout Model::get_layout() const {
+    return working_layout;
+}
+
+void Model::plan_layout() {
+    if (auto_layout) {
+        working_layout = choose_layout();
+    } else {
+        working_layout = supports_layout(layout) ? layout : Layout::NCHW;
+    }
+}
+
+bool Model::supports_layout(Layout layout) const {
+    for (const auto& layer : layers) {
+        if (!layer->supports_layout(layout)) {
+            return false;
+        }
+        if (dynamic_cast<const FlattenLayer*>(layer.get()) != nullptr) {
+            break; // Flatten always hands NCHW features to the layers after it
+        }
+    }
+    return true;
+}
+
+Layout Model::choose_layout() const {
+    // NHWC pays off when convolutions reduce over many input channels. Each convolution is
+    // weighted by its number of weights, which is proportional to its work per output pixel.
+    size_t total = 0;
+    size_t wide = 0;
+    for (const auto& layer : layers) {
+        if (dynamic_cast<const Conv2D*>(layer.get()) == nullptr) {
+            continue;
+        }
+        for (const Eigen::MatrixXf* weights : layer->get_weights()) {
+            total += weights->size();
+            if (weights->rows() >= nhwc_min_channels) {
+                wide += weights->size();
+            }
+        }
+    }
+    if (total == 0 || 2 * wide <= total || !supports_layout(Layout::NHWC)) {
+        return Layout::NCHW;
+    }
+    return Layout::NHWC;
+}
+
+Tensor Model::forward(const Tensor& input) {
+    arena.reset();
+    Tensor output = forward_pass(input);
+
+    // The output lives in the arena (or is a view of the input when no layer allocates),
+    // hand back a heap copy that survives the next step
+    return output.is_arena_backed() || output.is_view() ? Tensor(output) : output;
+}
+
+Tensor Model::forward_pass(const Tensor& input) {
+    // Intermediate tensors of the step are carved from the arena
+    Arena::Scope scope(arena);
+
+    // The first layer reads the caller's input through the const overload so it is not copied,
+    // then each output is moved into the next layer so layers that can work in place reuse the buffer
+    Tensor output;
+    Layout layout = get_layout();
+    bool owned = input.layout() != layout;
+    if (owned) {
+        output = input.to_layout(layout);
+    }
+    auto run = [&](Layer* layer) {
+        output = owned ? layer->forward(std::move(output)) : layer->forward(input);
+        owned = true;
+    };
+    if (training) {
+        for (auto& layer : layers) {
+            run(layer.get());
+        }
+    } else {
+        if (inference_plan.empty()) {
+            plan_inference();
+        }
+        for (Layer* layer : inference_plan) {
+            run(layer);
+        }
+    }
+    if (!owned) {
+        output = input;
+    }
+
+    // Networks without a Flatten end in the working layout, hand the output back in NCHW
+    output_layout = output.layout();
+    if (output_layout != Layout::NCHW) {
+        output = output.to_nchw();
     }
     return output;
 }
 
+Tensor Model::forward_layers(const std::vector<Layer*>& path, Tensor input, size_t first, size_t last) {
+    Tensor output = std::move(input);
+    if (first == 0 && output.layout() != get_layout()) {
+        output = output.to_layout(get_layout());
+    }
+    for (size_t i = first; i < last; ++i) {
+        output = path[i]->forward(std::move(output));
+    }
+    if (last == layers.size()) {
+        output_layout = output.layout();
+        if (output_layout != Layout::NCHW) {
+            output = output.to_nchw();
+        }
+    }
+    return output;
+}
+
+Tensor Model::backward_layers(const std::vector<Layer*>& path, Tensor grad, size_t first, size_t last) {
+    if (last == layers.size() && grad.layout() != output_layout) {
+        grad = grad.to_layout(output_layout);
+    }
+    for (size_t i = last; i > first; --i) {
+        grad = path[i - 1]->backward(std::move(grad));
+    }
+    return grad;
+}
+
+std::vector<size_t> Model::split_stages(int num_stages) const {
+    // Layers are weighed by their number of parameters, plus one for layers without any. The work
+    // of Dense and recurrent layers per row is about proportional to it.
+    size_t num_layers = layers.size();
+    std::vector<double> cost(num_layers + 1, 0.0); // Cost of the layers before each index
+    for (size_t l = 0; l < num_layers; ++l) {
+        double parameters = 1.0;
+        for (const Eigen::MatrixXf* weights : layers[l]->get_weights()) {
+            parameters += weights->size();
+        }
+        for (const Eigen::VectorXf* bias : layers[l]->get_bias()) {
+            parameters += bias->size();
+        }
+        cost[l + 1] = cost[l] + parameters;
+    }
+
+    size_t stages = std::max<size_t>(1, std::min(static_cast<size_t>(std::max(num_stages, 1)), num_layers));
+    std::vector<size_t> bounds{0};
+    for (size_t s = 1; s < stages; ++s) {
+        // Cut where the cost so far is closest to s / stages of the total, leaving a layer for each later stage
+        double target = cost[num_layers] * s / stages;
+        size_t cut = bounds.back() + 1;
+        while (cut < num_layers - (stages - s) && cost[cut] < target) {
+            ++cut;
+        }
+        if (cut > bounds.back() + 1 && target - cost[cut - 1] < cost[cut] - target) {
+            --cut;
+        }
+        bounds.push_back(cut);
+    }
+    bounds.push_back(num_layers);
+    return bounds;
+}
+
 void Model::backward() {
     if (loss_function == nullptr) {
         Console::log("No loss function provided. Backward pass aborted.", Console::ERROR);
@@ -75,21 +387,163 @@ void Model::backward() {
 }
 
 void Model::backward(const Tensor& grad_output) {
-    Tensor grad = grad_output;
+    Arena::Scope scope(arena);
+    // As in forward_pass, the caller's gradient is only read through the const overload
+    Tensor grad;
+    bool owned = grad_output.layout() != output_layout;
+    if (owned) {
+        grad = grad_output.to_layout(output_layout);
+    }
     for (auto it = layers.rbegin(); it != layers.rend(); ++it) {
-        grad = (*it)->backward(grad);
+        grad = owned ? (*it)->backward(std::move(grad)) : (*it)->backward(grad_output);
+        owned = true;
     }
 }
 
-void Model::optimize() const {
+void Model::optimize() {
     for (auto& layer : layers) {
         optimizer->optimize(*layer);
     }
+
+    // The step is over, release every intermediate tensor at once
+    step_bytes = arena.bytes_allocated();
+    arena.reset();
+}
+
+int Model::prepare_replicas(int num_replicas, bool split_rows) {
+    if (num_replicas <= 1) {
+        replicas.clear();
+        return 1;
+    }
+    // Recurrent layers read the rows of a batch as time steps, which replicas must not split
+    for (const auto& layer : layers) {
+        if (split_rows && is_recurrent(*layer)) {
+            Console::log("Recurrent layers cannot split batches by rows, training on one replica.", Console::WARNING);
+            replicas.clear();
+            return 1;
+        }
+    }
+
+    // Replicas of the last call are kept, their parameters and settings are brought up to date below
+    if (replicas.size() != static_cast<size_t>(num_replicas - 1)) {
+        replicas.clear();
+        for (int r = 1; r < num_replicas; ++r) {
+            auto copy = std::make_unique<Model>();
+            for (const auto& layer : layers) {
+                Layer* clone = layer->clone();
+                if (clone == nullptr) {
+                    Console::log(layer->get_name() + " layers cannot be cloned, training on one replica.", Console::WARNING);
+                    replicas.clear();
+                    return 1;
+                }
+                copy->layers.emplace_back(clone);
+            }
+            replicas.push_back(std::move(copy));
+        }
+    }
+    ThreadPool::global().parallel_for(0, static_cast<int>(replicas.size()), [&](int r) {
+        Model& copy = *replicas[r];
+        copy_parameters(copy);
+        copy.layout = layout;
+        copy.auto_layout = auto_layout;
+        copy.working_layout = working_layout;
+        copy.set_train();
+    });
+    return num_replicas;
+}
+
+void Model::copy_parameters(Model& copy) const {
+    for (size_t l = 0; l < layers.size(); ++l) {
+        copy_layer_parameters(*layers[l], *copy.layers[l]);
+    }
+}
+
+void Model::all_reduce_step(int count, float scale) {
+    ThreadPool& pool = ThreadPool::global();
+
+    // Tree reduction into replica 0: in round k, replica i adds replica i + 2^k for every i that is a
+    // multiple of 2^(k+1), so the sums of a round run in parallel and there are log2(count) rounds
+    for (int stride = 1; stride < count; stride *= 2) {
+        int num_pairs = (count + 2 * stride - 1) / (2 * stride);
+        pool.parallel_for(0, num_pairs, [&](int pair) {
+            int into = pair * 2 * stride;
+            int from = into + stride;
+            if (from >= count) {
+                return;
+            }
+            for (size_t l = 0; l < layers.size(); ++l) {
+                Layer& sum = *replica(into).layers[l];
+                Layer& term = *replica(from).layers[l];
+                auto sum_weights = sum.get_grad_weights();
+                auto term_weights = term.get_grad_weights();
+                for (size_t i = 0; i < sum_weights.size(); ++i) {
+                    *sum_weights[i] += *term_weights[i];
+                }
+                auto sum_bias = sum.get_grad_bias();
+                auto term_bias = term.get_grad_bias();
+                for (size_t i = 0; i < sum_bias.size(); ++i) {
+                    *sum_bias[i] += *term_bias[i];
+                }
+            }
+        });
+    }
+    if (scale != 1.0f) {
+        for (auto& layer : layers) {
+            for (Eigen::MatrixXf* grad_weights : layer->get_grad_weights()) {
+                *grad_weights *= scale;
+            }
+            for (Eigen::VectorXf* grad_bias : layer->get_grad_bias()) {
+                *grad_bias *= scale;
+            }
+        }
+    }
+
+    // One optimizer step on the summed gradients, then every replica starts the next step from its result
+    optimize();
+    pool.parallel_for(0, static_cast<int>(replicas.size()), [&](int r) {
+        Model& copy = *replicas[r];
+        copy_parameters(copy);
+        copy.step_bytes = copy.arena.bytes_allocated();
+        copy.arena.reset();
+    });
+}
+
+float Model::parallel_step(const std::vector<Tensor>& inputs, const Tensor& targets) {
+    ThreadPool& pool = ThreadPool::global();
+    int num_shards = static_cast<int>(inputs.size());
+    std::vector<Eigen::MatrixXf> outputs(num_shards);
+
+    // Every replica runs its shard at once, the layers' own parallel loops share the same pool
+    pool.parallel_for(0, num_shards, [&](int r) {
+        Model& model = replica(r);
+        Arena::Scope scope(model.arena);
+        outputs[r] = model.forward_pass(inputs[r]).getSingleMatrix();
+    });
+
+    // The loss sees the outputs of the whole batch, as in a step on one replica, so the gradients of
+    // the shards sum to the gradient of the batch whether the loss averages or sums over the rows
+    std::vector<Eigen::Index> offsets;
+    float loss = loss_function->forward(Tensor(stack_rows(outputs, offsets)), targets);
+    Tensor grad = loss_function->backward();
+
+    pool.parallel_for(0, num_shards, [&](int r) {
+        Model& model = replica(r);
+        Arena::Scope scope(model.arena);
+        model.backward(grad.slice_rows(offsets[r], offsets[r + 1]));
+    });
+
+    all_reduce_step(num_shards);
+    return loss;
 }
 
 void Model::Train(const ImageInputData& data,
     int epochs, Loss* loss_function, Optimizer* optimizer,
-    std::vector<Callback*> callbacks) {
+    std::vector<Callback*> callbacks, int batch_size, int num_replicas) {
+
+    if (batch_size < 1) {
+        Console::log("Batch size must be at least 1. Training aborted.", Console::ERROR);
+        return;
+    }
 
     if (optimizer != nullptr) {
         set_optimizer(*optimizer);
@@ -108,17 +562,43 @@ void Model::Train(const ImageInputData& data,
     }
     
     set_train();
+    int num_parallel = prepare_replicas(num_replicas);
     bool stop_training = false;
     for (int epoch = 0; epoch < epochs; ++epoch) {
         float total_loss = 0.0;
-        for (size_t i = 0; i < data.training.inputs.size(); ++i) {
-            Tensor output = forward(data.training.inputs[i]);
-            float loss = this->loss_function->forward(output, data.training.targets[i]);
+        size_t num_samples = data.training.inputs.size();
+        size_t num_batches = 0;
+        for (size_t begin = 0; begin < num_samples; begin += batch_size) {
+            size_t end = std::min(begin + static_cast<size_t>(batch_size), num_samples);
+
+            if (num_parallel > 1) {
+                // Each replica stacks its own share of the images
+                std::vector<size_t> bounds = split_range(end - begin, num_parallel);
+                std::vector<Tensor> inputs;
+                for (size_t r = 0; r + 1 < bounds.size(); ++r) {
+                    inputs.push_back(Tensor::stack(data.training.inputs, begin + bounds[r], begin + bounds[r + 1]));
+                }
+                Tensor targets = Tensor::stack(data.training.targets, begin, end);
+                targets.reshape(1, 1, end - begin, targets.cols());
+                total_loss += parallel_step(inputs, targets);
+                ++num_batches;
+                continue;
+            }
+
+            // Stack the images into one (N x C x H x W) tensor and the one-hot
+            // targets into a single (N x classes) matrix
+            Tensor inputs = Tensor::stack(data.training.inputs, begin, end);
+            Tensor targets = Tensor::stack(data.training.targets, begin, end);
+            targets.reshape(1, 1, end - begin, targets.cols());
+
+            Tensor output = forward_pass(inputs);
+            float loss = this->loss_function->forward(output, targets);
             total_loss += loss;
             backward();
             optimize();
+            ++num_batches;
         }
-        float average_loss = total_loss / data.training.inputs.size();
+        float average_loss = num_batches > 0 ? total_loss / num_batches : 0.0f;
         
         // Notify callbacks at the end of the epoch
         for (auto& callback : this->callbacks) {
@@ -137,7 +617,7 @@ void Model::Train(const ImageInputData& data,
 
 void Model::Train(const Tensor& training_data, const Tensor& training_labels, 
     int epochs, Loss* loss_function, Optimizer* optimizer,
-    std::vector<Callback*> callbacks) {
+    std::vector<Callback*> callbacks, int num_replicas) {
 
     set_train();
     // Optimizer can either be set in the model or passed as an argument
@@ -159,6 +639,8 @@ void Model::Train(const Tensor& training_data, const Tensor& training_labels,
         this->callbacks = callbacks;
     }
 
+    int num_parallel = prepare_replicas(num_replicas);
+
     // Split the data into batches
     int num_batches = training_data.depth();
     bool stop_training = false;
@@ -169,11 +651,24 @@ void Model::Train(const Tensor& training_data, const Tensor& training_labels,
         // Handle batches
         float total_loss = 0.0f;
         for (int i = 0; i < num_batches; ++i) {
-            // Get the current batch
+            // Get the current batch as views into the training tensors, nothing is copied
             inputs = training_data.slice(i);
             targets = training_labels.slice(i);
+
+            if (num_parallel > 1) {
+                // Each replica takes a share of the rows of the batch, as views
+                size_t num_rows = inputs.rows();
+                std::vector<size_t> bounds = split_range(num_rows, num_parallel);
+                std::vector<Tensor> input_shards;
+                for (size_t r = 0; r + 1 < bounds.size(); ++r) {
+                    input_shards.push_back(inputs.slice_rows(bounds[r], bounds[r + 1]));
+                }
+                total_loss += parallel_step(input_shards, targets);
+                continue;
+            }
+
             // Forward pass
-            Tensor outputs = forward(inputs);
+            Tensor outputs = forward_pass(inputs);
             float loss = this->loss_function->forward(outputs, targets);
             total_loss += loss;
 
@@ -201,6 +696,342 @@ void Model::Train(const Tensor& training_data, const Tensor& training_labels,
     }
 }
 
+void Model::TrainAsync(const Tensor& training_data, const Tensor& training_labels,
+    int epochs, Loss* loss_function, SGD* optimizer,
+    std::vector<Callback*> callbacks, int num_workers) {
+
+    set_train();
+    if (optimizer != nullptr) {
+        set_optimizer(*optimizer);
+    }
+    auto* sgd = dynamic_cast<SGD*>(this->optimizer);
+    if (sgd == nullptr) {
+        Console::log("Asynchronous training needs an SGD optimizer. Training aborted.", Console::ERROR);
+        return;
+    }
+    if (loss_function != nullptr) {
+        set_loss_function(*loss_function);
+    } else if (this->loss_function == nullptr) {
+        Console::log("No Loss function provided. Training aborted.", Console::ERROR);
+        return;
+    }
+    if (!callbacks.empty()) {
+        this->callbacks = callbacks;
+    }
+
+    ThreadPool& pool = ThreadPool::global();
+    int num_batches = training_data.depth();
+    num_workers = prepare_replicas(std::min(num_workers > 0 ? num_workers : pool.num_threads(), num_batches), false);
+
+    // Worker 0 runs on the model's own layers, the others on copies that read the model's parameters
+    // in place. The layers that cannot share them have their parameters copied before every batch.
+    std::vector<std::vector<size_t>> copied_layers(num_workers);
+    for (int w = 1; w < num_workers; ++w) {
+        for (size_t l = 0; l < layers.size(); ++l) {
+            if (!replica(w).layers[l]->share_parameters(layers[l].get())) {
+                copied_layers[w].push_back(l);
+            }
+        }
+    }
+
+    bool stop_training = false;
+    for (int epoch = 0; epoch < epochs; ++epoch) {
+        std::atomic<int> next_batch{0};
+        std::vector<float> worker_losses(num_workers, 0.0f);
+
+        // Nothing is locked but the loss function, which keeps the predictions of its last call until backward()
+        pool.parallel_for(0, num_workers, [&](int w) {
+            Model& worker = replica(w);
+            for (int i = next_batch++; i < num_batches; i = next_batch++) {
+                for (size_t l : copied_layers[w]) {
+                    copy_layer_parameters(*layers[l], *worker.layers[l]);
+                }
+                {
+                    Arena::Scope scope(worker.arena);
+                    Tensor outputs = worker.forward_pass(training_data.slice(i));
+                    Tensor grad_loss;
+                    {
+                        std::lock_guard<std::mutex> lock(loss_mutex);
+                        worker_losses[w] += this->loss_function->forward(outputs, training_labels.slice(i));
+                        grad_loss = this->loss_function->backward();
+                    }
+                    worker.backward(grad_loss);
+                }
+                for (size_t l = 0; l < layers.size(); ++l) {
+                    sgd->update(*layers[l], *worker.layers[l]);
+                }
+                worker.step_bytes = worker.arena.bytes_allocated();
+                worker.arena.reset();
+            }
+        });
+
+        float total_loss = 0.0f;
+        for (float loss : worker_losses) {
+            total_loss += loss;
+        }
+        float average_loss = total_loss / num_batches;
+
+        // Notify callbacks at the end of the epoch
+        for (auto& callback : this->callbacks) {
+            callback->on_epoch_end(epoch, average_loss);
+            if (callback->should_stop()) {
+                stop_training = true;
+            }
+        }
+
+        if (stop_training) {
+            std::cout << "Stopping at epoch " << epoch << "!" << std::endl;
+            break;
+        }
+    }
+
+    // The replicas go back to their own parameters, which prepare_replicas() refreshes before they are used again
+    for (int w = 1; w < num_workers; ++w) {
+        for (auto& layer : replica(w).layers) {
+            layer->share_parameters(nullptr);
+        }
+    }
+}
+
+void Model::TrainPipeline(const Tensor& training_data, const Tensor& training_labels,
+    int epochs, Loss* loss_function, Optimizer* optimizer,
+    std::vector<Callback*> callbacks, int num_stages, int micro_batches) {
+
+    set_train();
+    if (optimizer != nullptr) {
+        set_optimizer(*optimizer);
+    } else if (this->optimizer == nullptr) {
+        Console::log("No Optimizer provided. Training aborted.", Console::ERROR);
+        return;
+    }
+    if (loss_function != nullptr) {
+        set_loss_function(*loss_function);
+    } else if (this->loss_function == nullptr) {
+        Console::log("No Loss function provided. Training aborted.", Console::ERROR);
+        return;
+    }
+    if (!callbacks.empty()) {
+        this->callbacks = callbacks;
+    }
+    if (layers.empty()) {
+        Console::log("The model has no layers. Training aborted.", Console::ERROR);
+        return;
+    }
+
+    // The rows of each batch are split into micro-batches. Recurrent layers read the rows of a batch as
+    // the time steps of one sequence, so with them each batch is a micro-batch and consecutive batches
+    // form a step.
+    bool split_rows = std::none_of(layers.begin(), layers.end(), [](const auto& layer) { return is_recurrent(*layer); });
+    int num_batches = training_data.depth();
+    micro_batches = std::max(1, std::min(micro_batches, split_rows ? static_cast<int>(training_data.rows()) : num_batches));
+    std::vector<size_t> bounds = split_stages(num_stages);
+    int stages = static_cast<int>(bounds.size()) - 1;
+
+    // Every micro-batch in flight runs through its own copies of the layers, which keep its caches and
+    // gradients but read the model's parameters in place. The parameters of the layers that cannot share
+    // them are copied at the start of every step. A single micro-batch runs through the model's layers.
+    std::vector<std::vector<std::unique_ptr<Layer> > > copies;
+    std::vector<std::vector<size_t> > copied_layers;
+    for (int m = 0; m < micro_batches && micro_batches > 1; ++m) {
+        copies.emplace_back();
+        copied_layers.emplace_back();
+        for (size_t l = 0; l < layers.size(); ++l) {
+            Layer* copy = layers[l]->clone();
+            if (copy == nullptr) {
+                Console::log(layers[l]->get_name() + " layers cannot be cloned, training on one micro-batch per step.", Console::WARNING);
+                micro_batches = 1;
+                copies.clear();
+                copied_layers.clear();
+                break;
+            }
+            copies[m].emplace_back(copy);
+            if (!copy->share_parameters(layers[l].get())) {
+                copied_layers[m].push_back(l);
+            }
+        }
+    }
+    std::vector<std::vector<Layer*> > paths(micro_batches);
+    for (int m = 0; m < micro_batches; ++m) {
+        for (size_t l = 0; l < layers.size(); ++l) {
+            paths[m].push_back(copies.empty() ? layers[l].get() : copies[m][l].get());
+        }
+    }
+
+    // forward_queues[s] feeds the forward pass of stage s. backward_queues[s] takes the gradients stage s
+    // hands back, stage 0 only reports that a micro-batch is done.
+    std::vector<std::unique_ptr<BoundedQueue<MicroBatch> > > forward_queues, backward_queues;
+    for (int s = 0; s < stages; ++s) {
+        forward_queues.emplace_back(new BoundedQueue<MicroBatch>(pipeline_queue_capacity));
+        backward_queues.emplace_back(new BoundedQueue<MicroBatch>(pipeline_queue_capacity));
+    }
+    auto close_queues = [&] {
+        for (int s = 0; s < stages; ++s) {
+            forward_queues[s]->close();
+            backward_queues[s]->close();
+        }
+    };
+
+    // The targets and loss of the current step, handed over through the queues like the micro-batches
+    Tensor step_targets;
+    float step_loss = 0.0f;
+    std::mutex error_mutex;
+    std::exception_ptr error;
+
+    auto run_stage = [&](int s) {
+        pin_to_core(s);
+#ifdef _OPENMP
+        // The stages already keep the cores busy
+        omp_set_num_threads(1);
+#endif
+        // No arena: tensors cross stages and stay in the caches of other stages' layers, so they are
+        // released by other threads than the one that allocated them
+        bool last = s == stages - 1;
+        try {
+            MicroBatch item;
+            while (forward_queues[s]->pop(item)) {
+                int count = item.count;
+                for (int m = 0; m < static_cast<int>(copied_layers.size()); ++m) {
+                    for (size_t l : copied_layers[m]) {
+                        if (l >= bounds[s] && l < bounds[s + 1]) {
+                            copy_layer_parameters(*layers[l], *copies[m][l]);
+                        }
+                    }
+                }
+
+                // Forward every micro-batch of the step. The last stage keeps the outputs until the loss
+                // can be taken on the whole step.
+                std::vector<Eigen::MatrixXf> outputs(last ? count : 0);
+                for (int m = 0; m < count; ++m) {
+                    if (m > 0 && !forward_queues[s]->pop(item)) {
+                        return;
+                    }
+                    item.tensor = forward_layers(paths[item.index], std::move(item.tensor), bounds[s], bounds[s + 1]);
+                    if (last) {
+                        outputs[item.index] = item.tensor.getSingleMatrix();
+                    } else if (!forward_queues[s + 1]->push(std::move(item))) {
+                        return;
+                    }
+                }
+
+                // As in a step on one thread, the loss sees the whole step, so the gradients of the
+                // micro-batches sum to the gradient of the step whether the loss averages or sums the rows
+                Tensor grad;
+                std::vector<Eigen::Index> offsets;
+                if (last) {
+                    step_loss = this->loss_function->forward(Tensor(stack_rows(outputs, offsets)), step_targets);
+                    grad = this->loss_function->backward();
+                }
+
+                // Backward, last micro-batch first, adding the gradients of each into the model's layers
+                for (int m = count - 1; m >= 0; --m) {
+                    if (last) {
+                        item.index = m;
+                        item.count = count;
+                        item.tensor = grad.slice_rows(offsets[m], offsets[m + 1]);
+                    } else if (!backward_queues[s + 1]->pop(item)) {
+                        return;
+                    }
+                    item.tensor = backward_layers(paths[item.index], std::move(item.tensor), bounds[s], bounds[s + 1]);
+                    if (!copies.empty()) {
+                        for (size_t l = bounds[s]; l < bounds[s + 1]; ++l) {
+                            accumulate_gradients(*layers[l], *copies[item.index][l], item.index == count - 1);
+                        }
+                    }
+                    if (s == 0) {
+                        item.tensor = Tensor(); // Nobody needs the input gradient
+                    }
+                    if (!backward_queues[s]->push(std::move(item))) {
+                        return;
+                    }
+                }
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+            close_queues();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int s = 0; s < stages; ++s) {
+        threads.emplace_back(run_stage, s);
+    }
+
+    bool stop_training = false;
+    for (int epoch = 0; epoch < epochs && !stop_training; ++epoch) {
+        float total_loss = 0.0f;
+        int num_steps = 0;
+        for (int begin = 0; begin < num_batches; begin += split_rows ? 1 : micro_batches) {
+            // The micro-batches of the step, as views into the training tensors
+            std::vector<Tensor> inputs;
+            if (split_rows) {
+                Tensor batch = training_data.slice(begin);
+                std::vector<size_t> rows = split_range(batch.rows(), micro_batches);
+                for (size_t m = 0; m + 1 < rows.size(); ++m) {
+                    inputs.push_back(batch.slice_rows(rows[m], rows[m + 1]));
+                }
+                step_targets = training_labels.slice(begin);
+            } else {
+                int count = std::min(micro_batches, num_batches - begin);
+                for (int m = 0; m < count; ++m) {
+                    inputs.push_back(training_data.slice(begin + m));
+                }
+                // The labels of consecutive batches are consecutive rows of the labels tensor
+                size_t rows = training_labels.rows();
+                step_targets = training_labels.view(1, 1, training_labels.depth() * rows, training_labels.cols())
+                    .slice_rows(begin * rows, (begin + count) * rows);
+            }
+
+            int count = static_cast<int>(inputs.size());
+            bool fed = true;
+            for (int m = 0; m < count && fed; ++m) {
+                fed = forward_queues[0]->push({m, count, std::move(inputs[m])});
+            }
+            // Stage 0 finishes a micro-batch last, once every stage is done with it
+            int finished = 0;
+            MicroBatch done;
+            while (fed && finished < count && backward_queues[0]->pop(done)) {
+                ++finished;
+            }
+            if (finished < count) {
+                stop_training = true; // A stage failed
+                break;
+            }
+
+            // The stages summed the gradients of the step into the model's layers
+            optimize();
+            total_loss += step_loss;
+            ++num_steps;
+        }
+        if (stop_training) {
+            break;
+        }
+        float average_loss = num_steps > 0 ? total_loss / num_steps : 0.0f;
+
+        // Notify callbacks at the end of the epoch
+        for (auto& callback : this->callbacks) {
+            callback->on_epoch_end(epoch, average_loss);
+            if (callback->should_stop()) {
+                stop_training = true;
+            }
+        }
+
+        if (stop_training) {
+            std::cout << "Stopping at epoch " << epoch << "!" << std::endl;
+        }
+    }
+
+    close_queues();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
 void Model::Test(const Tensor& testing_data, const Tensor& testing_labels, Loss* loss_function) {
     if (loss_function != nullptr) {
         set_loss_function(*loss_function);
@@ -210,8 +1041,9 @@ void Model::Test(const Tensor& testing_data, const Tensor& testing_labels, Loss*
     }
     
     set_inference();
-    Tensor flattened_inputs(testing_data.flatten());
-    Tensor flattened_labels(testing_labels.flatten());
+    // Stack every batch into one matrix by reshaping views of the test tensors, without copying
+    const Tensor flattened_inputs = testing_data.view(1, 1, testing_data.num_matrices() * testing_data.rows(), testing_data.cols());
+    const Tensor flattened_labels = testing_labels.view(1, 1, testing_labels.num_matrices() * testing_labels.rows(), testing_labels.cols());
     Tensor outputs = forward(flattened_inputs);
     float loss = this->loss_function->forward(outputs, flattened_labels);
     int correct_predictions = 0;
@@ -417,7 +1249,10 @@ void Model::Deserialize(std::string fromFilePath, bool weights_only) {
     file.read(reinterpret_cast<char*>(&NameBuffSize), sizeof(size_t));
     
     // Clear the current model
+    inference_plan.clear();
+    fused_layers.clear();
     layers.clear();
+    replicas.clear();
     callbacks.clear();
     if (!weights_only) {
         loss_function = nullptr;
@@ -437,6 +1272,10 @@ void Model::Deserialize(std::string fromFilePath, bool weights_only) {
             layers.emplace_back(DenseLayer::deserialize(file));
         } else if (layer_name == "Conv2D") {
             layers.emplace_back(Conv2D::deserialize(file));
+        } else if (layer_name == "GroupedConv2D") {
+            layers.emplace_back(Conv2D::deserialize(file, true));
+        } else if (layer_name == "DepthwiseConv2D") {
+            layers.emplace_back(DepthwiseConv2D::deserialize(file));
         } else if (layer_name == "MaxPooling2D") {
             layers.emplace_back(MaxPooling2D::deserialize(file));
         } else if (layer_name == "AveragePooling2D") {
@@ -468,6 +1307,7 @@ void Model::Deserialize(std::string fromFilePath, bool weights_only) {
         }
         Console::log("Layer deserialized: " + layer_name, Console::DEBUG);
     }
+    plan_layout();
 
     if (weights_only) {
         file.close();
@@ -24,6 +24,42 @@ void SGD::optimize(Layer& layer) {
     }
 }
 
+namespace {
+    // parameters -= learning_rate * gradients, skipping the rows whose gradients are all zero so their
+    // parameters are not written. A row of a Dense layer's weights belongs to one input, so the inputs
+    // that are zero over the whole batch leave their rows alone. Without zero rows the update is one
+    // vectorized pass over the whole matrix.
+    template <typename Matrix>
+    void subtract_nonzero_rows(Matrix& parameters, const Matrix& gradients, float learning_rate) {
+        Eigen::Array<bool, Eigen::Dynamic, 1> nonzero = (gradients.array() != 0.0f).rowwise().any();
+        if (nonzero.all()) {
+            parameters -= learning_rate * gradients;
+            return;
+        }
+        for (Eigen::Index row = 0; row < parameters.rows(); ++row) {
+            if (nonzero(row)) {
+                parameters.row(row) -= learning_rate * gradients.row(row);
+            }
+        }
+    }
+}
+
+void SGD::update(Layer& layer, Layer& gradients) {
+    const auto& weights = layer.get_weights();
+    const auto& grad_weights = gradients.get_grad_weights();
+    for (size_t i = 0; i < weights.size(); ++i) {
+        subtract_nonzero_rows(*weights[i], *grad_weights[i], learning_rate);
+    }
+
+    if (layer.has_bias()) {
+        const auto& bias = layer.get_bias();
+        const auto& grad_bias = gradients.get_grad_bias();
+        for (size_t i = 0; i < bias.size(); ++i) {
+            subtract_nonzero_rows(*bias[i], *grad_bias[i], learning_rate);
+        }
+    }
+}
+
 Adam::Moments Adam::initialize_moments(Layer& layer) {
     Moments moment;
 
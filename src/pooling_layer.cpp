@@ -1,8 +1,9 @@
 #include "../include/Eidos/layers/pooling_layer.h"
 #include "../include/Eidos/tensor.hpp"
+#include "../include/Eidos/thread_pool.h"
 #include <Eigen/Dense>
-#include <thread>
 #include <mutex>
+#include <algorithm>
 
 MaxPooling2D::MaxPooling2D(int pool_size, int stride) : pool_size(pool_size), stride(stride) {}
 
@@ -17,74 +18,117 @@ Tensor MaxPooling2D::forward(const Tensor& input) {
     int output_height = (height - pool_size) / stride + 1;
     int output_width = (width - pool_size) / stride + 1;
     this->output_shape = {channels, output_height, output_width};
-    Tensor output = Tensor(channels, output_height, output_width);
-    this->mask = Tensor(channels, output_height, output_width);
-
-    std::vector<std::thread> threads;
-    int num_threads = std::thread::hardware_concurrency();
-    for (int thd = 0; thd < num_threads; ++thd) {
-        threads.emplace_back([&](int thd) {
-            // iterate over each channel independently
-            for (int c = thd; c < channels; c += num_threads) {
-                Eigen::MatrixXf channel = input[c];
-                // Perform max pooling using valid convolutions
-                for (int i = 0; i < output_height; i++) {
-                    for (int j = 0; j < output_width; j++) {
-                        Eigen::MatrixXf window = channel.block(i * stride, j * stride, pool_size, pool_size);
-                        int max_idx;
-                        float max_val = window.reshaped().maxCoeff(&max_idx);
-                        output(c, i, j) = max_val;
-                        this->mask(c, i, j) = max_idx;
-                    }
-                }
-            }
-        }, thd);
+    if (input.layout() == Layout::NHWC) {
+        return forward_channels_last(input);
     }
+    int batch = input.batch();
+    int planes = input.num_matrices(); // One (height x width) plane per sample and channel
+    Tensor output = Tensor(batch, channels, output_height, output_width);
+    this->mask = Tensor(batch, channels, output_height, output_width);
 
-    // Wait for all threads to finish
-    for (auto& thd : threads) {
-        thd.join();
-    }
+    // iterate over each plane independently
+    ThreadPool::global().parallel_for(0, planes, [&](int c) {
+        Eigen::MatrixXf channel = input[c];
+        // Perform max pooling using valid convolutions
+        for (int i = 0; i < output_height; i++) {
+            for (int j = 0; j < output_width; j++) {
+                Eigen::MatrixXf window = channel.block(i * stride, j * stride, pool_size, pool_size);
+                int max_idx;
+                // Row-major order, so the index decodes as (max_idx / pool_size, max_idx % pool_size)
+                float max_val = window.reshaped<Eigen::RowMajor>().maxCoeff(&max_idx);
+                output(c, i, j) = max_val;
+                this->mask(c, i, j) = max_idx;
+            }
+        }
+    });
 
     return output;
 }
 
 Tensor MaxPooling2D::backward(const Tensor& grad_output) {
-    Tensor grad_input = Tensor(input_shape[0], input_shape[1], input_shape[2]);
-
-    std::vector<std::thread> threads;
-    int num_threads = std::thread::hardware_concurrency();
-    for (int thd = 0; thd < num_threads; ++thd) {
-        threads.emplace_back([&](int thd) {
-            // iterate over each channel independently
-            for (int c = thd; c < output_shape[0]; c += num_threads) { // channel
-                // Get gradient and mask for current channel
-                Eigen::MatrixXf grad_channel = grad_output[c];
-                Eigen::MatrixXf mask_channel = this->mask[c];
-
-                // Unravel the mask to get the indices of the max values
-                for (int i = 0; i < output_shape[1]; i++) { // height
-                    for (int j = 0; j < output_shape[2]; j++) { // width
-                        int max_idx = mask_channel(i, j);
-                        int max_i = max_idx / pool_size;
-                        int max_j = max_idx % pool_size;
-
-                        // Scatter the gradient to the corresponding location in the input gradient matrix
-                        grad_input(c, i * stride + max_i, j * stride + max_j) += grad_channel(i, j);
-                    }
-                }
-            }
-        }, thd);
+    if (this->input.layout() == Layout::NHWC) {
+        if (grad_output.layout() != Layout::NHWC) {
+            return backward_channels_last(grad_output.to_nhwc());
+        }
+        return backward_channels_last(grad_output);
     }
 
-    // Wait for all threads to finish
-    for (auto& thd : threads) {
-        thd.join();
-    }
+    Tensor grad_input = Tensor(grad_output.batch(), input_shape[0], input_shape[1], input_shape[2]);
+    int planes = grad_output.num_matrices();
+
+    // iterate over each plane independently
+    ThreadPool::global().parallel_for(0, planes, [&](int c) { // sample and channel
+        // Get gradient and mask for current channel
+        Eigen::MatrixXf grad_channel = grad_output[c];
+        Eigen::MatrixXf mask_channel = this->mask[c];
+
+        // Unravel the mask to get the indices of the max values
+        for (int i = 0; i < output_shape[1]; i++) { // height
+            for (int j = 0; j < output_shape[2]; j++) { // width
+                int max_idx = mask_channel(i, j);
+                int max_i = max_idx / pool_size;
+                int max_j = max_idx % pool_size;
+
+                // Scatter the gradient to the corresponding location in the input gradient matrix
+                grad_input(c, i * stride + max_i, j * stride + max_j) += grad_channel(i, j);
+            }
+        }
+    });
     
     return grad_input;
 }
 
+Tensor MaxPooling2D::forward_channels_last(const Tensor& input) {
+    int batch = input.batch();
+    int channels = input_shape[0];
+    int output_height = output_shape[1];
+    int output_width = output_shape[2];
+    Tensor output(batch, channels, output_height, output_width, Layout::NHWC);
+    this->mask = Tensor(batch, channels, output_height, output_width, Layout::NHWC);
+
+    // iterate over output rows of every sample, each window is reduced a whole pixel at a time
+    ThreadPool::global().parallel_for(0, batch * output_height, [&](int idx) {
+        int n = idx / output_height;
+        int i = idx % output_height;
+        for (int j = 0; j < output_width; j++) {
+            auto max_val = output.pixel(n, i, j);
+            auto max_idx = this->mask.pixel(n, i, j);
+            max_val = input.pixel(n, i * stride, j * stride);
+            for (int wi = 0; wi < pool_size; wi++) {
+                for (int wj = 0; wj < pool_size; wj++) {
+                    auto window = input.pixel(n, i * stride + wi, j * stride + wj);
+                    // Same row-major window index as the NCHW mask, the first maximum wins
+                    max_idx = (window.array() > max_val.array()).select(float(wi * pool_size + wj), max_idx);
+                    max_val = max_val.cwiseMax(window);
+                }
+            }
+        }
+    });
+
+    return output;
+}
+
+Tensor MaxPooling2D::backward_channels_last(const Tensor& grad_output) {
+    int batch = grad_output.batch();
+    Tensor grad_input(batch, input_shape[0], input_shape[1], input_shape[2], Layout::NHWC);
+
+    // Windows of one sample may overlap, so threads split the batch
+    ThreadPool::global().parallel_for(0, batch, [&](int n) {
+        for (int i = 0; i < output_shape[1]; i++) {
+            for (int j = 0; j < output_shape[2]; j++) {
+                auto grad = grad_output.pixel(n, i, j);
+                auto max_idx = this->mask.pixel(n, i, j);
+                for (int c = 0; c < input_shape[0]; c++) {
+                    int idx = max_idx(c);
+                    grad_input(n, c, i * stride + idx / pool_size, j * stride + idx % pool_size) += grad(c);
+                }
+            }
+        }
+    });
+
+    return grad_input;
+}
+
 void MaxPooling2D::serialize(std::ofstream& toFileStream) const {
     toFileStream.write((char*)&pool_size, sizeof(int));
     toFileStream.write((char*)&stride, sizeof(int));
@@ -109,10 +153,10 @@ Tensor AveragePooling2D::forward(const Tensor& input) {
     int output_height = (height - pool_size) / stride + 1;
     int output_width = (width - pool_size) / stride + 1;
     this->output_shape = {channels, output_height, output_width};
-    Tensor output = Tensor(channels, output_height, output_width);
+    Tensor output = Tensor(input.batch(), channels, output_height, output_width);
 
-    // iterate over each channel independently
-    for (int c = 0; c < channels; c++) {
+    // iterate over each plane (sample and channel) independently
+    for (size_t c = 0; c < input.num_matrices(); c++) {
         Eigen::MatrixXf channel = input[c];
         // Perform average pooling using valid convolutions
         for (int i = 0; i < output_height; i++) {
@@ -127,10 +171,10 @@ Tensor AveragePooling2D::forward(const Tensor& input) {
 }
 
 Tensor AveragePooling2D::backward(const Tensor& grad_output) {
-    Tensor grad_input = Tensor(input_shape[0], input_shape[1], input_shape[2]);
+    Tensor grad_input = Tensor(grad_output.batch(), input_shape[0], input_shape[1], input_shape[2]);
 
-    // iterate over each channel independently
-    for (int c = 0; c < output_shape[0]; c++) {
+    // iterate over each plane (sample and channel) independently
+    for (size_t c = 0; c < grad_output.num_matrices(); c++) {
         Eigen::MatrixXf grad_channel = grad_output[c];
         for (int i = 0; i < output_shape[1]; i++) {
             for (int j = 0; j < output_shape[2]; j++) {
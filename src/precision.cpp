@@ -0,0 +1,81 @@
+#include "../include/Eidos/precision.h"
+#include <algorithm>
+
+std::string precision_name(Precision precision) {
+    switch (precision) {
+        case Precision::FP16: return "fp16";
+        case Precision::BF16: return "bf16";
+        default: return "fp32";
+    }
+}
+
+void CompactMatrix::set_precision(Precision precision) {
+    if (precision == precision_) {
+        return;
+    }
+    Eigen::MatrixXf values = load();
+    clear();
+    precision_ = precision;
+    store(values);
+}
+
+Eigen::MatrixXf CompactMatrix::load() const {
+    switch (precision_) {
+        case Precision::FP16: return fp16_.cast<float>();
+        case Precision::BF16: return bf16_.cast<float>();
+        default: return fp32_;
+    }
+}
+
+Eigen::VectorXf CompactMatrix::row(Eigen::Index index) const {
+    switch (precision_) {
+        case Precision::FP16: return fp16_.row(index).transpose().cast<float>();
+        case Precision::BF16: return bf16_.row(index).transpose().cast<float>();
+        default: return fp32_.row(index).transpose();
+    }
+}
+
+Eigen::Index CompactMatrix::rows() const {
+    switch (precision_) {
+        case Precision::FP16: return fp16_.rows();
+        case Precision::BF16: return bf16_.rows();
+        default: return fp32_.rows();
+    }
+}
+
+Eigen::Index CompactMatrix::cols() const {
+    switch (precision_) {
+        case Precision::FP16: return fp16_.cols();
+        case Precision::BF16: return bf16_.cols();
+        default: return fp32_.cols();
+    }
+}
+
+size_t CompactMatrix::bytes() const {
+    size_t element = precision_ == Precision::FP32 ? sizeof(float) : sizeof(uint16_t);
+    return static_cast<size_t>(rows() * cols()) * element;
+}
+
+void CompactMatrix::clear() {
+    fp32_.resize(0, 0);
+    fp16_.resize(0, 0);
+    bf16_.resize(0, 0);
+}
+
+Eigen::Index CompactMatrix::panel_rows() const {
+    constexpr Eigen::Index panel_floats = 16 * 1024;
+    return std::max<Eigen::Index>(1, panel_floats / std::max<Eigen::Index>(1, cols()));
+}
+
+void CompactMatrix::load_rows(Eigen::Index begin, Eigen::Index count, Eigen::MatrixXf& panel) const {
+    if (precision_ == Precision::FP16) {
+        panel = fp16_.middleRows(begin, count).cast<float>();
+    } else {
+        panel = bf16_.middleRows(begin, count).cast<float>();
+    }
+}
+
+Eigen::MatrixXf& CompactMatrix::scratch() {
+    thread_local Eigen::MatrixXf panel;
+    return panel;
+}
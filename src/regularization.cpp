@@ -7,19 +7,52 @@ Dropout::Dropout(float probability) : probability(probability) {}
 
 Tensor Dropout::forward(const Tensor& input) {
 
-    Eigen::MatrixXf input_mat = input.getSingleMatrix();
-
     if (!training) {
         return input; // No dropout during inference
     }
-    // Generate random mask and apply dropout
-    mask = (Eigen::MatrixXf::Random(input_mat.rows(), input_mat.cols()).array() > probability).cast<float>();
-    return Tensor(input_mat.array() * mask.array() / (1.0f - probability));
+    Tensor output = input;
+    apply_mask(output, true);
+    return output;
+}
+
+Tensor Dropout::forward(Tensor&& input) {
+    if (input.is_view()) {
+        return forward(static_cast<const Tensor&>(input));
+    }
+    if (training) {
+        apply_mask(input, true);
+    }
+    return std::move(input); // Inference passes the buffer straight through
 }
 
 Tensor Dropout::backward(const Tensor& grad_output) {
+    Tensor grad_input = grad_output;
+    apply_mask(grad_input, false);
+    return grad_input;
+}
+
+Tensor Dropout::backward(Tensor&& grad_output) {
+    if (grad_output.is_view()) {
+        return backward(static_cast<const Tensor&>(grad_output));
+    }
     // Backprop through only the active nodes
-    return Tensor(mask.array() * grad_output.getSingleMatrix().array());
+    apply_mask(grad_output, false);
+    return std::move(grad_output);
+}
+
+void Dropout::apply_mask(Tensor& values, bool generate) {
+    if (!values.isSingleMatrix()) {
+        throw std::runtime_error("Tensor does not contain a single matrix.");
+    }
+    Tensor::ChannelMap values_mat = values[0];
+
+    if (generate) {
+        // Generate random mask and apply dropout
+        mask = (Eigen::MatrixXf::Random(values_mat.rows(), values_mat.cols()).array() > probability).cast<float>();
+        values_mat.array() *= mask.array() / (1.0f - probability);
+    } else {
+        values_mat.array() *= mask.array();
+    }
 }
 
 void Dropout::set_training(bool training_) {
@@ -39,9 +72,9 @@ void BatchNorm::set_training(bool training_) {
     training = training_;
 }
 
-Tensor BatchNorm::forward(const Tensor& input) {
+void BatchNorm::normalize(const Tensor& input) {
 
-    Eigen::MatrixXf input_mat = input.getSingleMatrix();
+    Tensor::ConstChannelMap input_mat = input.getSingleMatrix();
 
     if (input_mat.rows() == 1) {
         Console::log("Using BatchNorm with a single sample. This will cause unintended behaviour. Consider using LayerNorm instead.", Console::WARNING);
@@ -70,16 +103,47 @@ Tensor BatchNorm::forward(const Tensor& input) {
     // Normalize input
     normalized_input = centered_input.array().rowwise() / 
         (variance.array() + epsilon).sqrt().transpose();
-    
+}
+
+Tensor BatchNorm::forward(const Tensor& input) {
+    normalize(input);
+
     // Scale and shift 
-    Eigen::MatrixXf output = (normalized_input.array().rowwise() * gamma.row(0).array()).rowwise() + beta.transpose().array();
+    Tensor output(1, normalized_input.rows(), normalized_input.cols());
+    output[0] = (normalized_input.array().rowwise() * gamma.row(0).array()).rowwise() + beta.transpose().array();
     
-    return Tensor(output);
+    return output;
+}
+
+Tensor BatchNorm::forward(Tensor&& input) {
+    if (input.is_view()) {
+        return forward(static_cast<const Tensor&>(input));
+    }
+    normalize(input);
+
+    // The normalized values are cached separately, so the output can overwrite the input
+    input[0] = (normalized_input.array().rowwise() * gamma.row(0).array()).rowwise() + beta.transpose().array();
+
+    return std::move(input);
 }
 
 Tensor BatchNorm::backward(const Tensor& grad_output) {
+    Tensor grad_input(1, grad_output.rows(), grad_output.cols());
+    input_gradient(grad_output, grad_input[0]);
+    return grad_input;
+}
+
+Tensor BatchNorm::backward(Tensor&& grad_output) {
+    if (grad_output.is_view()) {
+        return backward(static_cast<const Tensor&>(grad_output));
+    }
+    input_gradient(grad_output, grad_output[0]);
+    return std::move(grad_output);
+}
 
-    Eigen::MatrixXf grad_output_mat = grad_output.getSingleMatrix();
+void BatchNorm::input_gradient(const Tensor& grad_output, Tensor::ChannelMap grad_input) {
+
+    Tensor::ConstChannelMap grad_output_mat = grad_output.getSingleMatrix();
 
     int m = grad_output_mat.rows();
     
@@ -99,13 +163,12 @@ Tensor BatchNorm::backward(const Tensor& grad_output) {
         grad_normalized.colwise().sum().array() * -1.0f / (variance.array() + epsilon).sqrt().transpose() +
         grad_variance.array() * -2.0f * centered_input.colwise().sum().array() / m;
     
-    // Compute the gradient with respect to the original input
-    Eigen::MatrixXf grad_input = 
+    // Compute the gradient with respect to the original input. Everything read here is
+    // derived from grad_output above, so grad_input may share its buffer.
+    grad_input = 
         grad_normalized.array().rowwise() / (variance.array() + epsilon).sqrt().transpose() +
         centered_input.array().rowwise() * grad_variance.row(0).array() * 2.0f / m + 
         (grad_mean.array() / m).replicate(m, 1);
-    
-    return Tensor(grad_input);
 }
 
 void BatchNorm::serialize(std::ofstream& toFileStream) const {
@@ -66,12 +66,12 @@ Tensor RNNLayer::forward(const Tensor& input_sequence) {
     // Update the hidden_state member to the final state for continuity
     hidden_state = hidden_states[T];
 
-    if (output_sequence) {
-        return Tensor(outputs); // Return output sequence
-    } else {
-        // If output_sequence is false, return the last hidden state
-        return Tensor(hidden_states[T]);
-    }
+    // Return the output sequence, or the last hidden state if output_sequence is false
+    Tensor result = output_sequence ? Tensor(outputs) : Tensor(hidden_states[T]);
+
+    // Keep the histories for backward in the storage precision
+    pack_histories();
+    return result;
 }
 
 // Backward pass
@@ -82,6 +82,8 @@ Tensor RNNLayer::backward(const Tensor& grad_output_sequence) {
     int T = grad_output_mat.rows();  // Sequence length
     int H = hidden_state.rows();          // Hidden size
 
+    unpack_histories();
+
     grad_weights[0].setZero();  // W_h
     grad_weights[1].setZero();  // U_h
     grad_weights[2].setZero();  // W_o
@@ -108,9 +110,57 @@ Tensor RNNLayer::backward(const Tensor& grad_output_sequence) {
         grad_h_next = weights[1].transpose() * grad_h_t_raw;
     }
 
+    // Drop the widened histories again, the compact copies stay until the next forward
+    if (precision != Precision::FP32) {
+        std::vector<Eigen::VectorXf>().swap(hidden_states);
+        std::vector<Eigen::VectorXf>().swap(pre_activations);
+    }
+
     return Tensor(grad_h_next);  // Return gradient w.r.t. input (optional)
 }
 
+void RNNLayer::set_precision(Precision precision) {
+    this->precision = precision;
+    compact_hidden_states = CompactMatrix(precision);
+    compact_pre_activations = CompactMatrix(precision);
+}
+
+void RNNLayer::pack_histories() {
+    if (precision == Precision::FP32) {
+        return;
+    }
+    int H = hidden_state.rows();
+    Eigen::MatrixXf packed(hidden_states.size(), H);
+    for (size_t t = 0; t < hidden_states.size(); ++t) {
+        packed.row(t) = hidden_states[t].transpose();
+    }
+    compact_hidden_states.store(packed);
+
+    packed.resize(pre_activations.size(), H);
+    for (size_t t = 0; t < pre_activations.size(); ++t) {
+        packed.row(t) = pre_activations[t].transpose();
+    }
+    compact_pre_activations.store(packed);
+
+    // Release the fp32 histories until backward needs them
+    std::vector<Eigen::VectorXf>().swap(hidden_states);
+    std::vector<Eigen::VectorXf>().swap(pre_activations);
+}
+
+void RNNLayer::unpack_histories() {
+    if (precision == Precision::FP32) {
+        return;
+    }
+    hidden_states.resize(compact_hidden_states.rows());
+    for (size_t t = 0; t < hidden_states.size(); ++t) {
+        hidden_states[t] = compact_hidden_states.row(t);
+    }
+    pre_activations.resize(compact_pre_activations.rows());
+    for (size_t t = 0; t < pre_activations.size(); ++t) {
+        pre_activations[t] = compact_pre_activations.row(t);
+    }
+}
+
 void RNNLayer::serialize(std::ofstream& toFileStream) const {
     for (const auto& weight : weights) {
         Eigen::Index rows = weight.rows();
@@ -126,6 +176,19 @@ void RNNLayer::serialize(std::ofstream& toFileStream) const {
     }
 }
 
+Layer* RNNLayer::clone() const {
+    auto* copy = new RNNLayer(*this);
+    if (activation != nullptr) {
+        copy->owned_activation.reset(activation->clone());
+        copy->activation = static_cast<Activation*>(copy->owned_activation.get());
+        if (copy->activation == nullptr) {
+            delete copy;
+            return nullptr;
+        }
+    }
+    return copy;
+}
+
 RNNLayer* RNNLayer::deserialize(std::ifstream& fromFileStream) {
     std::vector<Eigen::MatrixXf> weights;
     std::vector<Eigen::VectorXf> biases;
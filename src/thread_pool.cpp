@@ -0,0 +1,255 @@
+#include "../include/Eidos/thread_pool.h"
+#include "../include/Eidos/threading.h"
+#include <algorithm>
+#include <stdexcept>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+    // The pool the calling thread is a worker of, and its index there
+    thread_local ThreadPool* current_pool = nullptr;
+    thread_local int current_index = -1;
+    // Tasks running on the calling thread, more than one when a waiting task runs others
+    thread_local int task_depth = 0;
+
+    // Marks the calling thread as running a task, with OpenMP limited to one thread in the outermost one
+    class TaskScope {
+    public:
+        TaskScope() {
+#ifdef _OPENMP
+            if (task_depth == 0) {
+                omp_threads = omp_get_max_threads();
+                omp_set_num_threads(1);
+            }
+#endif
+            ++task_depth;
+        }
+
+        ~TaskScope() {
+            --task_depth;
+#ifdef _OPENMP
+            if (task_depth == 0) {
+                omp_set_num_threads(omp_threads);
+            }
+#endif
+        }
+
+    private:
+        int omp_threads = 1;
+    };
+
+    void run_task(const std::function<void()>& task) {
+        TaskScope scope;
+        task();
+    }
+}
+
+ThreadPool::ThreadPool(int num_threads) {
+    start(num_threads);
+}
+
+ThreadPool::~ThreadPool() {
+    stop();
+}
+
+void ThreadPool::start(int num_threads) {
+    int num_workers = std::max(1, num_threads) - 1;
+    stopping = false;
+    for (int i = 0; i < std::max(1, num_workers); ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (int i = 0; i < num_workers; ++i) {
+        workers.emplace_back(&ThreadPool::work, this, i);
+    }
+}
+
+void ThreadPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+    queues.clear();
+}
+
+void ThreadPool::resize(int num_threads) {
+    if (task_depth > 0) {
+        throw std::logic_error("ThreadPool::resize cannot be called from a task");
+    }
+    stop();
+    start(num_threads);
+}
+
+bool ThreadPool::in_task() {
+    return task_depth > 0;
+}
+
+ThreadPool& ThreadPool::global() {
+    static ThreadPool pool(Eidos::default_num_threads());
+    return pool;
+}
+
+void ThreadPool::push(std::function<void()> task, const TaskGroup* group) {
+    // Without workers nobody else would run the task
+    if (workers.empty()) {
+        run_task(task);
+        return;
+    }
+    // Workers queue their own tasks, where they will run them next unless another worker steals them
+    int index = current_pool == this ? current_index : static_cast<int>(next_queue++ % queues.size());
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back({std::move(task), group});
+        ++queued;
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    wake.notify_one();
+}
+
+bool ThreadPool::pop(int queue, bool steal, Task& task) {
+    std::lock_guard<std::mutex> lock(queues[queue]->mutex);
+    std::deque<Task>& tasks = queues[queue]->tasks;
+    if (tasks.empty()) {
+        return false;
+    }
+    if (steal) {
+        task = std::move(tasks.front());
+        tasks.pop_front();
+    } else {
+        task = std::move(tasks.back());
+        tasks.pop_back();
+    }
+    --queued;
+    return true;
+}
+
+bool ThreadPool::run_one() {
+    int own = current_pool == this ? current_index : -1;
+    int count = static_cast<int>(queues.size());
+    Task task;
+    bool found = own >= 0 && pop(own, false, task);
+    for (int i = 1; !found && i <= count; ++i) {
+        int victim = (std::max(own, 0) + i) % count;
+        found = victim != own && pop(victim, true, task);
+    }
+    if (found) {
+        run_task(task.run);
+    }
+    return found;
+}
+
+bool ThreadPool::pop_of(int queue, const TaskGroup& group, Task& task) {
+    std::lock_guard<std::mutex> lock(queues[queue]->mutex);
+    std::deque<Task>& tasks = queues[queue]->tasks;
+    // The newest task of the group, which is the one the owner of the queue would run next
+    auto it = std::find_if(tasks.rbegin(), tasks.rend(), [&group](const Task& queued_task) {
+        return queued_task.group == &group;
+    });
+    if (it == tasks.rend()) {
+        return false;
+    }
+    task = std::move(*it);
+    tasks.erase(std::next(it).base());
+    --queued;
+    return true;
+}
+
+bool ThreadPool::run_one_of(const TaskGroup& group) {
+    int own = current_pool == this ? current_index : -1;
+    int count = static_cast<int>(queues.size());
+    Task task;
+    bool found = own >= 0 && pop_of(own, group, task);
+    for (int i = 1; !found && i <= count; ++i) {
+        int victim = (std::max(own, 0) + i) % count;
+        found = victim != own && pop_of(victim, group, task);
+    }
+    if (found) {
+        run_task(task.run);
+    }
+    return found;
+}
+
+void ThreadPool::work(int index) {
+    current_pool = this;
+    current_index = index;
+    while (true) {
+        if (run_one()) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wake.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::parallel_for(int begin, int end, const std::function<void(int)>& body, int grain) {
+    int count = end - begin;
+    int chunks = std::min((count + std::max(1, grain) - 1) / std::max(1, grain), 4 * num_threads());
+    bool serial = task_depth > 0 && nesting == NestedParallelism::Serial;
+    if (chunks <= 1 || num_threads() == 1 || serial) {
+        for (int i = begin; i < end; ++i) {
+            body(i);
+        }
+        return;
+    }
+
+    TaskGroup group(*this);
+    for (int chunk = 0; chunk < chunks; ++chunk) {
+        int first = begin + static_cast<int>(static_cast<long>(count) * chunk / chunks);
+        int last = begin + static_cast<int>(static_cast<long>(count) * (chunk + 1) / chunks);
+        group.run([&body, first, last] {
+            for (int i = first; i < last; ++i) {
+                body(i);
+            }
+        });
+    }
+    group.wait();
+}
+
+void ThreadPool::TaskGroup::run(std::function<void()> task) {
+    ++pending;
+    pool.push([this, task = std::move(task)] {
+        try {
+            task();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+        // The waiter returns, and may destroy the group, only once it holds the lock after the count dropped
+        std::lock_guard<std::mutex> lock(done_mutex);
+        if (--pending == 0) {
+            done.notify_all();
+        }
+    }, this);
+}
+
+void ThreadPool::TaskGroup::wait_quietly() {
+    // Run the group's queued tasks here, then sleep until the ones running on other threads are done
+    while (pending > 0 && pool.run_one_of(*this)) {
+    }
+    std::unique_lock<std::mutex> lock(done_mutex);
+    done.wait(lock, [this] { return pending == 0; });
+}
+
+void ThreadPool::TaskGroup::wait() {
+    wait_quietly();
+    std::exception_ptr thrown;
+    {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        std::swap(thrown, error);
+    }
+    if (thrown) {
+        std::rethrow_exception(thrown);
+    }
+}
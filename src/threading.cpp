@@ -0,0 +1,59 @@
+#include "../include/Eidos/threading.h"
+#include <Eigen/Core>
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef _OPENMP
+namespace {
+    // The pool reads EIDOS_NUM_THREADS when first used, OpenMP on the main thread takes it at startup
+    const bool openmp_configured = [] {
+        if (std::getenv("EIDOS_NUM_THREADS")) {
+            omp_set_num_threads(Eidos::default_num_threads());
+        }
+        return true;
+    }();
+}
+#endif
+
+namespace Eidos {
+    void set_num_threads(int num_threads) {
+        int threads = num_threads > 0 ? num_threads : default_num_threads();
+        ThreadPool::global().resize(threads);
+#ifdef _OPENMP
+        omp_set_num_threads(threads);
+#endif
+        // 0 makes Eigen follow the OpenMP setting of the calling thread, which pool tasks lower to one
+        Eigen::setNbThreads(0);
+    }
+
+    int num_threads() {
+        return ThreadPool::global().num_threads();
+    }
+
+    int default_num_threads() {
+        if (const char* value = std::getenv("EIDOS_NUM_THREADS")) {
+            try {
+                int threads = std::stoi(value);
+                if (threads > 0) {
+                    return threads;
+                }
+            } catch (const std::exception&) {
+                // Not a number, fall back to the hardware threads
+            }
+        }
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    void set_nested_parallelism(NestedParallelism policy) {
+        ThreadPool::global().set_nesting(policy);
+    }
+
+    NestedParallelism nested_parallelism() {
+        return ThreadPool::global().get_nesting();
+    }
+}
@@ -67,3 +67,26 @@ TEST(ActivationFunctionsTest, LeakyReLUBackward) {
     ASSERT_TRUE(leaky_relu.backward(grad_output).isApprox(expected));
 }
 
+
+// The cache of a non element-wise activation must not point into an arena after it was reset
+TEST(ActivationFunctionsTest, SoftmaxForwardAfterArenaReset) {
+    Tensor input(Eigen::MatrixXf::Random(4, 3));
+    Tensor grad_output(Eigen::MatrixXf::Random(4, 3));
+    Softmax reference;
+    Layer& reference_layer = reference;
+    reference_layer.forward(input);
+    Eigen::MatrixXf expected = reference_layer.backward(grad_output).getSingleMatrix();
+
+    Arena arena;
+    Softmax softmax;
+    Layer& layer = softmax;
+    for (int step = 0; step < 3; ++step) {
+        {
+            Arena::Scope scope(arena);
+            layer.forward(input);
+            Tensor grad_input = layer.backward(grad_output);
+            ASSERT_TRUE(grad_input.getSingleMatrix().isApprox(expected));
+        }
+        arena.reset();
+    }
+}
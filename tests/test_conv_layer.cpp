@@ -3,6 +3,9 @@
 #include "../include/Eidos/tensor.hpp"
 #include "../include/Eidos/layers/conv_layer.h"
 #include "../include/Eidos/layers/pooling_layer.h"
+#include "../include/Eidos/layers/flatten_layer.h"
+#include "../include/Eidos/layers/fused_conv_layer.h"
+#include "../include/Eidos/activation_fns.h"
 
 TEST(ConvLayerTest, ForwardPassCorrectShape) {
     Conv2D conv1(3, 16, 3, 1, 1); // 3 input channels, 16 output channels, 3x3 kernel, stride 1, padding 1
@@ -67,6 +70,22 @@ TEST(PoolingLayerTest, BackwardPassCorrectShape) {
     ASSERT_EQ(std::get<2>(grad_input_shape), 32);
 }
 
+TEST(PoolingLayerTest, BackwardRoutesGradientToTheMaximum) {
+    MaxPooling2D pool(2, 2);
+    Tensor input(1, 2, 2);
+    input[0] << 0, 5,
+                1, 2;
+    Tensor grad_output(1, 1, 1);
+    grad_output[0](0, 0) = 1;
+
+    pool.forward(input);
+    Tensor grad_input = pool.backward(grad_output);
+    Eigen::MatrixXf expected(2, 2);
+    expected << 0, 1,
+                0, 0;
+    ASSERT_TRUE(grad_input.getSingleMatrix().isApprox(expected));
+}
+
 TEST(PoolingLayerTest, AveragePoolingForwardPassCorrectShape) {
     AveragePooling2D pool1(2, 2); // 2x2 pooling kernel, stride 2
     Tensor input_tensor(3, 32, 32); // Example dimensions for CNN input (channels, height, width)
@@ -98,3 +117,539 @@ TEST(PoolingLayerTest, AveragePoolingBackwardPassCorrectShape) {
     ASSERT_EQ(std::get<1>(grad_input_shape), 32);
     ASSERT_EQ(std::get<2>(grad_input_shape), 32);
 }
+
+TEST(ConvLayerTest, BatchedForwardMatchesPerSample) {
+    Conv2D conv1(2, 4, 3, 2, 1); // 2 input channels, 4 output channels, 3x3 kernel, stride 2, padding 1
+    MaxPooling2D pool1(2, 2);
+    FlattenLayer flatten;
+
+    std::vector<Tensor> samples(3, Tensor(2, 8, 8));
+    for (auto& sample : samples) {
+        sample.set_random();
+    }
+    Tensor batch = Tensor::stack(samples, 0, samples.size());
+    ASSERT_EQ(batch.batch(), 3);
+
+    // One pass over the whole batch produces one flattened row per sample
+    Tensor batched_output = flatten.forward(pool1.forward(conv1.forward(batch)));
+    Eigen::MatrixXf rows = batched_output.getSingleMatrix();
+    ASSERT_EQ(rows.rows(), 3);
+    ASSERT_EQ(rows.cols(), 4 * 2 * 2);
+
+    for (size_t n = 0; n < samples.size(); ++n) {
+        Tensor output = flatten.forward(pool1.forward(conv1.forward(samples[n])));
+        ASSERT_TRUE(rows.row(n).isApprox(output.getSingleMatrix()));
+    }
+
+    // Gradients flow back to a tensor with the batched input shape
+    conv1.forward(batch);
+    Tensor grad_output(3, 4, 4, 4);
+    grad_output.set_random();
+    Tensor grad_input = conv1.backward(grad_output);
+    ASSERT_EQ(grad_input.batch_shape(), batch.batch_shape());
+}
+
+TEST(ConvLayerTest, GemmForwardMatchesDirectConvolution) {
+    for (auto [kernel_size, stride, padding] : {std::tuple{3, 1, 1}, {3, 2, 1}, {5, 2, 2}, {2, 1, 0}}) {
+        Conv2D conv1(3, 4, kernel_size, stride, padding);
+        conv1.set_algorithm(ConvAlgorithm::Gemm);
+        Tensor input(2, 3, 9, 8);
+        input.set_random();
+        Tensor output = conv1.forward(input);
+
+        // Direct sum over the kernel window, with zeros outside the input
+        int K = kernel_size;
+        ASSERT_EQ(output.rows(), (9 + 2 * padding - K) / stride + 1);
+        ASSERT_EQ(output.cols(), (8 + 2 * padding - K) / stride + 1);
+        for (int n = 0; n < 2; ++n) {
+            for (int c_out = 0; c_out < 4; ++c_out) {
+                const Eigen::MatrixXf& weights = *conv1.get_weights()[c_out];
+                for (int i = 0; i < output.rows(); ++i) {
+                    for (int j = 0; j < output.cols(); ++j) {
+                        float expected = (*conv1.get_bias()[c_out])(0);
+                        for (int c_in = 0; c_in < 3; ++c_in) {
+                            for (int ki = 0; ki < K; ++ki) {
+                                for (int kj = 0; kj < K; ++kj) {
+                                    int row = i * stride + ki - padding;
+                                    int col = j * stride + kj - padding;
+                                    if (row >= 0 && row < 9 && col >= 0 && col < 8) {
+                                        expected += weights(c_in, kj * K + ki) * input(n, c_in, row, col);
+                                    }
+                                }
+                            }
+                        }
+                        ASSERT_NEAR(output(n, c_out, i, j), expected, 1e-4f);
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST(ConvLayerTest, WinogradMatchesGemm) {
+    // Even and odd output sizes, so the last row and column of 2x2 tiles are partly outside the output
+    for (auto [padding, height, width] : {std::tuple{1, 8, 8}, {0, 9, 7}, {2, 5, 6}}) {
+        Conv2D conv1(8, 6, 3, 1, padding);
+        ASSERT_EQ(conv1.get_algorithm(), ConvAlgorithm::Winograd);
+        for (auto* bias : conv1.get_bias()) {
+            bias->setRandom();
+        }
+        Tensor input(3, 8, height, width);
+        input.set_random();
+
+        Tensor output = conv1.forward(input);
+        conv1.set_algorithm(ConvAlgorithm::Gemm);
+        Tensor expected = conv1.forward(input);
+        ASSERT_EQ(output.batch_shape(), expected.batch_shape());
+        ASSERT_TRUE((output.array() - expected.array()).abs().maxCoeff() < 1e-4f);
+    }
+
+    // In inference the transformed filters are cached until the layer goes back to training
+    Conv2D conv2(2, 2, 3, 1, 1);
+    conv2.set_algorithm(ConvAlgorithm::Winograd);
+    Tensor input(1, 2, 4, 4);
+    input.set_random();
+    conv2.set_training(false);
+    Tensor output = conv2.forward(input);
+    *conv2.get_weights()[0] *= 2.0f;
+    ASSERT_TRUE(conv2.forward(input).array().isApprox(output.array()));
+    conv2.set_training(true);
+    ASSERT_FALSE(conv2.forward(input).array().isApprox(output.array()));
+
+    ASSERT_EQ(Conv2D(8, 2, 3, 2, 1).get_algorithm(), ConvAlgorithm::Gemm);
+    ASSERT_NE(Conv2D(1, 2, 3, 1, 1).get_algorithm(), ConvAlgorithm::Winograd); // Too few channels to pay off
+    ASSERT_THROW(Conv2D(2, 2, 5, 1, 2).set_algorithm(ConvAlgorithm::Winograd), std::invalid_argument);
+}
+
+TEST(ConvLayerTest, DirectKernelsMatchGemm) {
+    for (int kernel_size : {1, 3, 5, 7}) {
+        for (int stride : {1, 2}) {
+            // Padding wider than the kernel gives output rows that only read the border
+            for (int padding : {0, kernel_size / 2, kernel_size}) {
+                Conv2D conv1(3, 4, kernel_size, stride, padding);
+                for (auto* bias : conv1.get_bias()) {
+                    bias->setRandom();
+                }
+                // The taller input is convolved in several strips of rows
+                for (auto [height, width] : {std::pair{11, 10}, std::pair{150, 61}}) {
+                    Tensor input(2, 3, height, width);
+                    input.set_random();
+
+                    conv1.set_algorithm(ConvAlgorithm::Direct);
+                    Tensor output = conv1.forward(input);
+                    conv1.set_algorithm(ConvAlgorithm::Gemm);
+                    Tensor expected = conv1.forward(input);
+                    ASSERT_EQ(output.batch_shape(), expected.batch_shape());
+                    ASSERT_TRUE((output.array() - expected.array()).abs().maxCoeff() < 1e-4f);
+                }
+            }
+        }
+    }
+
+    // Thin layers with small kernels use the compiled kernels, 1x1 layers are a plain GEMM
+    ASSERT_EQ(Conv2D(1, 8, 5, 1, 2).get_algorithm(), ConvAlgorithm::Direct);
+    ASSERT_EQ(Conv2D(1, 8, 5, 2, 2).get_algorithm(), ConvAlgorithm::Gemm);
+    ASSERT_EQ(Conv2D(1, 8, 1).get_algorithm(), ConvAlgorithm::Gemm);
+    ASSERT_EQ(Conv2D(1, 8, 4).get_algorithm(), ConvAlgorithm::Gemm);
+    ASSERT_THROW(Conv2D(1, 8, 3, 3).set_algorithm(ConvAlgorithm::Direct), std::invalid_argument);
+
+    // The pointwise GEMM skips unfolding in both directions
+    Conv2D pointwise(4, 3, 1);
+    Tensor input(2, 4, 5, 5);
+    Tensor delta(2, 4, 5, 5);
+    input.set_random();
+    delta.set_random();
+    Tensor output = pointwise.forward(input);
+    Tensor grad_output(2, 3, 5, 5);
+    grad_output.set_random();
+    Tensor grad_input = pointwise.backward(grad_output);
+    Tensor shifted = pointwise.forward(input + delta);
+    float expected = (grad_output.array() * (shifted.array() - output.array())).sum();
+    float actual = (grad_input.array() * delta.array()).sum();
+    ASSERT_NEAR(actual, expected, 1e-3f * std::max(1.0f, std::abs(expected)));
+}
+
+TEST(ConvLayerTest, ChannelsLastMatchesChannelsFirst) {
+    Conv2D conv1(3, 5, 3, 2, 1); // strided and padded
+    Conv2D conv2(3, 5, 3, 1, 0);
+    Tensor input(2, 3, 9, 9);
+    input.set_random();
+
+    // Same weights, same results in either layout
+    Tensor output = conv1.forward(input);
+    Tensor output_nhwc = conv1.forward(input.to_nhwc());
+    ASSERT_EQ(output_nhwc.layout(), Layout::NHWC);
+    ASSERT_EQ(output_nhwc.batch_shape(), output.batch_shape());
+    ASSERT_TRUE(output_nhwc.to_nchw().array().isApprox(output.array(), 1e-5f));
+
+    // Input, weight and bias gradients agree too, strided and padded or not
+    for (Conv2D* conv : {&conv1, &conv2}) {
+        Tensor output = conv->forward(input);
+        Tensor grad_output(output.batch(), output.depth(), output.rows(), output.cols());
+        grad_output.set_random();
+        Tensor grad_input = conv->backward(grad_output);
+        std::vector<Eigen::MatrixXf> grad_weights;
+        std::vector<Eigen::VectorXf> grad_biases;
+        for (size_t i = 0; i < conv->get_grad_weights().size(); ++i) {
+            grad_weights.push_back(*conv->get_grad_weights()[i]);
+            grad_biases.push_back(*conv->get_grad_bias()[i]);
+        }
+        conv->forward(input.to_nhwc());
+        Tensor grad_input_nhwc = conv->backward(grad_output.to_nhwc());
+        ASSERT_TRUE(grad_input_nhwc.to_nchw().array().isApprox(grad_input.array(), 1e-4f));
+        for (size_t i = 0; i < grad_weights.size(); ++i) {
+            ASSERT_TRUE(conv->get_grad_weights()[i]->isApprox(grad_weights[i], 1e-4f));
+            ASSERT_TRUE(conv->get_grad_bias()[i]->isApprox(grad_biases[i], 1e-4f));
+        }
+    }
+}
+
+TEST(ConvLayerTest, GemmBackwardMatchesFiniteDifferences) {
+    Conv2D conv1(2, 3, 3, 2, 1);
+    Tensor input(2, 2, 7, 6);
+    Tensor delta(2, 2, 7, 6);
+    input.set_random();
+    delta.set_random();
+
+    // The convolution is affine in its input, so <g, f(x + d) - f(x)> = <dL/dx, d> exactly
+    Tensor output = conv1.forward(input);
+    Tensor grad_output(2, 3, 4, 3);
+    grad_output.set_random();
+    Tensor grad_input = conv1.backward(grad_output);
+    Tensor shifted = conv1.forward(input + delta);
+    float expected = (grad_output.array() * (shifted.array() - output.array())).sum();
+    float actual = (grad_input.array() * delta.array()).sum();
+    ASSERT_NEAR(actual, expected, 1e-3f * std::max(1.0f, std::abs(expected)));
+
+    // It is linear in its weights, so moving one weight by h changes the loss by h * dL/dw
+    conv1.forward(input);
+    conv1.backward(grad_output);
+    Eigen::MatrixXf grad_weight = *conv1.get_grad_weights()[1];
+    float grad_bias = (*conv1.get_grad_bias()[1])(0);
+    Eigen::MatrixXf& weight = *conv1.get_weights()[1];
+    for (int k = 0; k < weight.size(); ++k) {
+        weight(k) += 1.0f;
+        float change = (grad_output.array() * (conv1.forward(input).array() - output.array())).sum();
+        weight(k) -= 1.0f;
+        ASSERT_NEAR(change, grad_weight(k), 1e-3f * std::max(1.0f, std::abs(grad_weight(k))));
+    }
+    (*conv1.get_bias()[1])(0) += 1.0f;
+    float change = (grad_output.array() * (conv1.forward(input).array() - output.array())).sum();
+    ASSERT_NEAR(change, grad_bias, 1e-3f * std::max(1.0f, std::abs(grad_bias)));
+}
+
+TEST(ConvLayerTest, ChannelsLastInputGradient) {
+    Conv2D conv1(2, 3, 3, 2, 1);
+    Tensor input(1, 2, 7, 7, Layout::NHWC);
+    Tensor delta(1, 2, 7, 7, Layout::NHWC);
+    input.set_random();
+    delta.set_random();
+
+    // The convolution is affine in its input, so <g, f(x + d) - f(x)> = <dL/dx, d> exactly
+    Tensor output = conv1.forward(input);
+    Tensor grad_output(1, 3, 4, 4, Layout::NHWC);
+    grad_output.set_random();
+    Tensor grad_input = conv1.backward(grad_output);
+    Tensor shifted = conv1.forward(input + delta);
+
+    float expected = (grad_output.array() * (shifted.array() - output.array())).sum();
+    float actual = (grad_input.array() * delta.array()).sum();
+    ASSERT_NEAR(actual, expected, 1e-3f * std::max(1.0f, std::abs(expected)));
+}
+
+TEST(ConvLayerTest, FftMatchesGemm) {
+    // Several tiles along each side, with and without padding
+    Tensor input(2, 3, 40, 37);
+    input.set_random();
+    for (auto [kernel_size, padding] : {std::pair{7, 3}, std::pair{5, 0}, std::pair{9, 1}}) {
+        Conv2D conv(3, 4, kernel_size, 1, padding);
+        conv.set_algorithm(ConvAlgorithm::Gemm);
+        Tensor expected = conv.forward(input);
+        Tensor grad_output = expected;
+        grad_output.set_random();
+        Tensor expected_grad_input = conv.backward(grad_output);
+        std::vector<Eigen::MatrixXf> expected_grad_weights;
+        for (Eigen::MatrixXf* grad : conv.get_grad_weights()) {
+            expected_grad_weights.push_back(*grad);
+        }
+
+        conv.set_algorithm(ConvAlgorithm::Fft);
+        Tensor output = conv.forward(input);
+        Tensor grad_input = conv.backward(grad_output);
+        ASSERT_TRUE(output.array().isApprox(expected.array(), 1e-4f));
+        ASSERT_TRUE(grad_input.array().isApprox(expected_grad_input.array(), 1e-4f));
+        for (size_t c = 0; c < expected_grad_weights.size(); ++c) {
+            ASSERT_TRUE(conv.get_grad_weights()[c]->isApprox(expected_grad_weights[c], 1e-4f));
+        }
+
+        // Inference reuses the filter spectra, and recomputes them for another input size
+        conv.set_training(false);
+        ASSERT_TRUE(conv.forward(input).array().isApprox(expected.array(), 1e-4f));
+        Tensor smaller(1, 3, 20, 22);
+        smaller.set_random();
+        conv.set_algorithm(ConvAlgorithm::Gemm);
+        Tensor expected_smaller = conv.forward(smaller);
+        conv.set_algorithm(ConvAlgorithm::Fft);
+        ASSERT_TRUE(conv.forward(smaller).array().isApprox(expected_smaller.array(), 1e-4f));
+    }
+
+    // Large kernels pick the FFT on large inputs only
+    Conv2D large(1, 2, 7, 1, 3);
+    Tensor image(1, 1, Conv2D::fft_min_size, Conv2D::fft_min_size);
+    image.set_random();
+    large.forward(image);
+    ASSERT_EQ(large.get_algorithm(), ConvAlgorithm::Fft);
+    large.forward(Tensor(1, 1, 16, 16));
+    ASSERT_EQ(large.get_algorithm(), ConvAlgorithm::Gemm);
+    ASSERT_THROW(Conv2D(1, 2, 7, 2).set_algorithm(ConvAlgorithm::Fft), std::invalid_argument);
+}
+
+TEST(ConvLayerTest, TiledMatchesSingleTile) {
+    // Strips, input channel blocks and output channel blocks that do not divide the layer, with
+    // and without groups, for both algorithms that are tiled
+    Tensor input(2, 6, 13, 11);
+    input.set_random();
+    struct Case { ConvAlgorithm algorithm; int stride; int groups; };
+    for (Case layer : {Case{ConvAlgorithm::Gemm, 1, 1}, Case{ConvAlgorithm::Gemm, 2, 2}, Case{ConvAlgorithm::Winograd, 1, 1}}) {
+        Conv2D conv(6, 10, 3, layer.stride, 1, layer.groups);
+        conv.set_algorithm(layer.algorithm);
+        for (auto* bias : conv.get_bias()) {
+            bias->setRandom();
+        }
+        conv.set_tiling({1000, 1000, 1000});
+        Tensor expected = conv.forward(input);
+        Tensor grad_output = expected;
+        grad_output.set_random();
+        Tensor expected_grad_input = conv.backward(grad_output);
+        std::vector<Eigen::MatrixXf> expected_grad_weights;
+        for (Eigen::MatrixXf* grad : conv.get_grad_weights()) {
+            expected_grad_weights.push_back(*grad);
+        }
+
+        conv.set_tiling({3, 2, 4});
+        Tensor output = conv.forward(input);
+        Tensor grad_input = conv.backward(grad_output);
+        ASSERT_TRUE(output.array().isApprox(expected.array(), 1e-5f));
+        ASSERT_TRUE(grad_input.array().isApprox(expected_grad_input.array(), 1e-5f));
+        for (size_t c = 0; c < expected_grad_weights.size(); ++c) {
+            ASSERT_TRUE(conv.get_grad_weights()[c]->isApprox(expected_grad_weights[c], 1e-5f));
+        }
+    }
+
+    // Chosen tiles stay within the layer
+    Conv2D conv(6, 10, 3);
+    conv.forward(input);
+    ASSERT_GE(conv.get_tiling().rows, 1);
+    ASSERT_LE(conv.get_tiling().rows, 11);
+    ASSERT_LE(conv.get_tiling().in_channels, 6);
+    ASSERT_LE(conv.get_tiling().out_channels, 10);
+    ASSERT_THROW(conv.set_tiling({0, 1, 1}), std::invalid_argument);
+}
+
+TEST(ConvLayerTest, Int8MatchesGemm) {
+    // Kernel sizes, strides, padding and groups, and strips of output rows that do not divide the output
+    struct Case { int in; int out; int kernel_size; int stride; int padding; int groups; int rows; };
+    for (Case layer : {Case{3, 8, 3, 1, 1, 1, 0}, Case{8, 6, 5, 2, 2, 2, 0}, Case{16, 12, 1, 1, 0, 1, 0},
+                       Case{6, 10, 3, 1, 1, 1, 2}, Case{4, 4, 7, 1, 3, 4, 3}}) {
+        Conv2D conv(layer.in, layer.out, layer.kernel_size, layer.stride, layer.padding, layer.groups);
+        for (auto* bias : conv.get_bias()) {
+            bias->setRandom();
+        }
+        if (layer.rows > 0) {
+            conv.set_tiling({layer.rows, 1, 1});
+        }
+        Tensor input(2, layer.in, 13, 11);
+        input.set_random();
+
+        conv.set_algorithm(ConvAlgorithm::Gemm);
+        Tensor expected = conv.forward(input);
+        conv.set_algorithm(ConvAlgorithm::Int8);
+        conv.set_training(false);
+        Tensor output = conv.forward(input);
+        ASSERT_EQ(output.batch_shape(), expected.batch_shape());
+
+        // Rounding the inputs and weights to 1/254 of their ranges stays well within 2% of the output range
+        float range = expected.array().abs().maxCoeff();
+        ASSERT_LT((output.array() - expected.array()).abs().maxCoeff(), 0.02f * range);
+
+        // The quantized filters are reused in inference
+        ASSERT_TRUE(conv.forward(input).array().isApprox(output.array()));
+    }
+}
+
+TEST(ConvLayerTest, GroupedMatchesConvolutionPerGroup) {
+    // Two groups of 2 input and 3 output channels, with the algorithms a grouped layer can use
+    Tensor input(2, 4, 9, 9);
+    input.set_random();
+    for (ConvAlgorithm algorithm : {ConvAlgorithm::Gemm, ConvAlgorithm::Direct}) {
+        for (int kernel_size : {1, 3}) {
+            Conv2D grouped(4, 6, kernel_size, 1, kernel_size / 2, 2);
+            grouped.set_algorithm(algorithm);
+            ASSERT_EQ(grouped.get_name(), "GroupedConv2D");
+            ASSERT_EQ(grouped.get_weights()[0]->rows(), 2);
+            ASSERT_THROW(grouped.set_algorithm(ConvAlgorithm::Winograd), std::invalid_argument);
+
+            Tensor output = grouped.forward(input);
+            Tensor grad_output = output;
+            grad_output.set_random();
+            Tensor grad_input = grouped.backward(grad_output);
+
+            for (int g = 0; g < 2; ++g) {
+                Conv2D conv(2, 3, kernel_size, 1, kernel_size / 2);
+                for (int c = 0; c < 3; ++c) {
+                    *conv.get_weights()[c] = *grouped.get_weights()[3 * g + c];
+                    *conv.get_bias()[c] = *grouped.get_bias()[3 * g + c];
+                }
+                Tensor group_input(2, 2, 9, 9);
+                Tensor group_grad(2, 3, 9, 9);
+                for (int n = 0; n < 2; ++n) {
+                    for (int c = 0; c < 2; ++c) {
+                        group_input.channel(n, c) = input.channel(n, 2 * g + c);
+                    }
+                    for (int c = 0; c < 3; ++c) {
+                        group_grad.channel(n, c) = grad_output.channel(n, 3 * g + c);
+                    }
+                }
+                Tensor expected = conv.forward(group_input);
+                Tensor expected_grad_input = conv.backward(group_grad);
+                for (int n = 0; n < 2; ++n) {
+                    for (int c = 0; c < 3; ++c) {
+                        ASSERT_TRUE(output.channel(n, 3 * g + c).isApprox(expected.channel(n, c), 1e-5f));
+                    }
+                    for (int c = 0; c < 2; ++c) {
+                        ASSERT_TRUE(grad_input.channel(n, 2 * g + c).isApprox(expected_grad_input.channel(n, c), 1e-5f));
+                    }
+                }
+                for (int c = 0; c < 3; ++c) {
+                    ASSERT_TRUE(grouped.get_grad_weights()[3 * g + c]->isApprox(*conv.get_grad_weights()[c], 1e-4f));
+                }
+            }
+
+            // The channels-last kernels give the same results
+            Tensor output_nhwc = grouped.forward(input.to_nhwc());
+            Tensor grad_input_nhwc = grouped.backward(grad_output.to_nhwc());
+            ASSERT_TRUE(output_nhwc.to_nchw().array().isApprox(output.array(), 1e-5f));
+            ASSERT_TRUE(grad_input_nhwc.to_nchw().array().isApprox(grad_input.array(), 1e-5f));
+        }
+    }
+    ASSERT_THROW(Conv2D(4, 6, 3, 1, 0, 4), std::invalid_argument);
+}
+
+TEST(ConvLayerTest, DepthwiseKernelsMatchGemm) {
+    Tensor input(2, 5, 12, 12);
+    input.set_random();
+    for (int kernel_size : {3, 5, 7, 4}) {
+        for (int stride : {1, 2}) {
+            DepthwiseConv2D depthwise(5, kernel_size, stride, kernel_size / 2, 2);
+            ASSERT_EQ(depthwise.get_weights().size(), 10u);
+            // Kernel sizes with a compiled kernel use it, the others fall back to GEMM
+            ASSERT_EQ(depthwise.get_algorithm(), kernel_size == 4 ? ConvAlgorithm::Gemm : ConvAlgorithm::Direct);
+            Tensor output = depthwise.forward(input);
+            depthwise.set_algorithm(ConvAlgorithm::Gemm);
+            ASSERT_TRUE(output.array().isApprox(depthwise.forward(input).array(), 1e-5f));
+
+            // Output channels 2c and 2c + 1 only depend on input channel c
+            Tensor shifted = input;
+            shifted.channel(1, 3).array() += 1.0f;
+            Tensor changed = depthwise.forward(shifted) - output;
+            ASSERT_FLOAT_EQ(changed.array().abs().sum(),
+                            changed.channel(1, 6).array().abs().sum() + changed.channel(1, 7).array().abs().sum());
+        }
+    }
+}
+
+TEST(ConvLayerTest, FusedMatchesUnfusedLayers) {
+    Tensor input(3, 4, 10, 10);
+    input.set_random();
+
+    // Overlapping pooling windows after a strided GEMM convolution, then no pooling at all
+    Conv2D conv(4, 6, 3, 2, 1);
+    ReLU relu;
+    Layer& activation = relu;
+    MaxPooling2D pool(3, 2);
+    conv.set_training(false);
+    Tensor reference = pool.forward(activation.forward(conv.forward(input)));
+    FusedConv2D fused(conv, relu, &pool);
+    ASSERT_TRUE(fused.forward(input).array().isApprox(reference.array()));
+
+    FusedConv2D unpooled(conv, relu);
+    ASSERT_TRUE(unpooled.forward(input).array().isApprox(activation.forward(conv.forward(input)).array()));
+
+    // Channels-last inputs run the layers one after the other
+    Tensor output_nhwc = fused.forward(input.to_nhwc());
+    ASSERT_EQ(output_nhwc.layout(), Layout::NHWC);
+    ASSERT_TRUE(output_nhwc.to_nchw().array().isApprox(reference.array()));
+
+    Softmax softmax;
+    ASSERT_THROW(FusedConv2D(conv, softmax), std::invalid_argument);
+}
+
+TEST(PoolingLayerTest, ChannelsLastMatchesChannelsFirst) {
+    MaxPooling2D pool1(3, 2); // Overlapping windows
+    Tensor input(2, 4, 9, 9);
+    input.set_random();
+    Tensor grad_output(2, 4, 4, 4);
+    grad_output.set_random();
+
+    Tensor output = pool1.forward(input);
+    Tensor grad_input = pool1.backward(grad_output);
+
+    Tensor output_nhwc = pool1.forward(input.to_nhwc());
+    Tensor grad_input_nhwc = pool1.backward(grad_output.to_nhwc());
+    ASSERT_EQ(output_nhwc.layout(), Layout::NHWC);
+    ASSERT_TRUE(output_nhwc.to_nchw().array().isApprox(output.array()));
+    ASSERT_TRUE(grad_input_nhwc.to_nchw().array().isApprox(grad_input.array()));
+
+    // The gradient of each window goes to the position of its maximum
+    Tensor single(1, 1, 2, 2);
+    single(0, 0, 1, 0) = 5.0f;
+    MaxPooling2D pool2(2, 2);
+    pool2.forward(single);
+    Tensor routed = pool2.backward(Tensor(1, 1, 1, 1) - 1.0f);
+    ASSERT_FLOAT_EQ(routed(0, 0, 1, 0), -1.0f);
+    ASSERT_FLOAT_EQ(routed(0, 0, 0, 1), 0.0f);
+}
+
+TEST(FlattenLayerTest, ChannelsLastFlattensInChannelOrder) {
+    FlattenLayer flatten;
+    Tensor input(2, 3, 4, 5);
+    input.set_random();
+
+    Eigen::MatrixXf rows = flatten.forward(input).getSingleMatrix();
+    Tensor flattened = flatten.forward(input.to_nhwc());
+    ASSERT_EQ(flattened.layout(), Layout::NCHW);
+    ASSERT_TRUE(flattened.getSingleMatrix().isApprox(rows));
+
+    // The gradient is handed back in the layout of the input
+    Tensor grad_input = flatten.backward(flattened);
+    ASSERT_EQ(grad_input.layout(), Layout::NHWC);
+    ASSERT_TRUE(grad_input.to_nchw().array().isApprox(input.array()));
+}
+
+TEST(ConvLayerTest, SharedParametersAreReadInPlace) {
+    Conv2D owner(2, 4, 3, 1, 1);
+    std::unique_ptr<Layer> copy(owner.clone());
+    ASSERT_TRUE(copy->share_parameters(&owner));
+
+    // Updates of the owner's parameters are seen by the copy without copying them
+    for (Eigen::MatrixXf* weights : owner.get_weights()) {
+        weights->setRandom();
+    }
+    for (Eigen::VectorXf* bias : owner.get_bias()) {
+        bias->setRandom();
+    }
+    Tensor input(2, 2, 6, 6);
+    input.set_random();
+    Tensor expected = owner.forward(input);
+    ASSERT_TRUE(copy->forward(input).array().isApprox(expected.array()));
+
+    Tensor grad_output(2, 4, 6, 6);
+    grad_output.set_random();
+    Tensor expected_grad = owner.backward(grad_output);
+    ASSERT_TRUE(copy->backward(grad_output).array().isApprox(expected_grad.array()));
+    ASSERT_TRUE(copy->get_grad_weights()[0]->isApprox(*owner.get_grad_weights()[0]));
+
+    // Without the owner the copy computes with its own parameters again
+    ASSERT_TRUE(copy->share_parameters(nullptr));
+    ASSERT_FALSE(copy->forward(input).array().isApprox(expected.array()));
+}
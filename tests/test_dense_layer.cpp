@@ -1,6 +1,8 @@
 #include <gtest/gtest.h>
 #include <Eigen/Dense>
 #include "../include/Eidos/layers/dense_layer.h"
+#include "../include/Eidos/layers/conv_layer.h"
+#include "../include/Eidos/optimizer.h"
 
 TEST(DenseLayerTest, ForwardPassCorrectShape) {
     DenseLayer layer(3, 5); // 3 input features, 5 output features
@@ -29,4 +31,81 @@ TEST(DenseLayerTest, BackwardPassCorrectShapes) {
     ASSERT_EQ(layer.get_grad_weights()[0]->rows(), 10); // Matches output features
     ASSERT_EQ(layer.get_grad_weights()[0]->cols(), 5); // Matches input features
     ASSERT_EQ(layer.get_grad_bias()[0]->size(), 5); // Matches output features
-}
\ No newline at end of file
+}
+
+TEST(DenseLayerTest, ReducedPrecisionMatchesFloat) {
+    Eigen::MatrixXf input = Eigen::MatrixXf::Random(8, 300);
+    Eigen::MatrixXf grad = Eigen::MatrixXf::Random(8, 16);
+
+    for (Precision precision : {Precision::FP16, Precision::BF16}) {
+        DenseLayer reference(300, 16);
+        DenseLayer compact(300, 16);
+        *compact.get_weights()[0] = *reference.get_weights()[0];
+        compact.set_precision(precision);
+
+        // Training: fp32 weights, input cached in reduced precision for the weight gradient
+        Tensor expected = reference.forward(Tensor(input));
+        Tensor actual = compact.forward(Tensor(input));
+        ASSERT_TRUE(actual.getSingleMatrix().isApprox(expected.getSingleMatrix(), 1e-5f));
+
+        reference.backward(Tensor(grad));
+        compact.backward(Tensor(grad));
+        float tolerance = precision == Precision::FP16 ? 1e-3f : 1e-2f;
+        ASSERT_TRUE(compact.get_grad_weights()[0]->isApprox(*reference.get_grad_weights()[0], tolerance));
+
+        // Inference: weights streamed in reduced precision and accumulated in fp32
+        reference.set_training(false);
+        compact.set_training(false);
+        expected = reference.forward(Tensor(input));
+        actual = compact.forward(Tensor(input));
+        ASSERT_TRUE(actual.getSingleMatrix().isApprox(expected.getSingleMatrix(), tolerance));
+    }
+
+    CompactMatrix stored(Precision::BF16);
+    stored.store(input);
+    ASSERT_EQ(stored.bytes(), input.size() * 2);
+    ASSERT_TRUE(stored.load().isApprox(input, 1e-2f));
+}
+
+TEST(DenseLayerTest, SGDUpdateSkipsRowsOfZeroInputs) {
+    DenseLayer shared(6, 4);
+    DenseLayer worker(6, 4);
+
+    // Inputs 1 and 4 are zero in every sample, so their rows of the weight gradient are zero
+    Eigen::MatrixXf input = Eigen::MatrixXf::Random(5, 6);
+    input.col(1).setZero();
+    input.col(4).setZero();
+    worker.forward(Tensor(input));
+    worker.backward(Tensor(Eigen::MatrixXf::Random(5, 4)));
+
+    Eigen::MatrixXf before = *shared.get_weights()[0];
+    Eigen::VectorXf bias_before = *shared.get_bias()[0];
+    SGD optimizer(0.1f);
+    optimizer.update(shared, worker);
+
+    Eigen::MatrixXf expected = before - 0.1f * *worker.get_grad_weights()[0];
+    ASSERT_TRUE(shared.get_weights()[0]->isApprox(expected));
+    ASSERT_EQ(shared.get_weights()[0]->row(1), before.row(1));
+    ASSERT_EQ(shared.get_weights()[0]->row(4), before.row(4));
+    ASSERT_TRUE(shared.get_bias()[0]->isApprox(bias_before - 0.1f * *worker.get_grad_bias()[0]));
+}
+
+TEST(DenseLayerTest, SharedParametersAreReadInPlace) {
+    DenseLayer owner(6, 4);
+    DenseLayer copy(6, 4);
+    ASSERT_TRUE(copy.share_parameters(&owner));
+
+    Eigen::MatrixXf input = Eigen::MatrixXf::Random(5, 6);
+    owner.get_bias()[0]->setRandom();
+    Tensor expected = owner.forward(Tensor(input));
+    ASSERT_TRUE(copy.forward(Tensor(input)).getSingleMatrix().isApprox(expected.getSingleMatrix()));
+
+    Eigen::MatrixXf grad_output = Eigen::MatrixXf::Random(5, 4);
+    Tensor expected_grad = owner.backward(Tensor(grad_output));
+    ASSERT_TRUE(copy.backward(Tensor(grad_output)).getSingleMatrix().isApprox(expected_grad.getSingleMatrix()));
+
+    // Layers of another type are refused, and the copy reads its own parameters again
+    Conv2D conv(1, 1, 3, 1, 1);
+    ASSERT_FALSE(copy.share_parameters(&conv));
+    ASSERT_FALSE(copy.forward(Tensor(input)).getSingleMatrix().isApprox(expected.getSingleMatrix()));
+}
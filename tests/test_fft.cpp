@@ -0,0 +1,40 @@
+#include <gtest/gtest.h>
+#include <Eigen/Dense>
+#include <cmath>
+#include "../include/Eidos/fft.h"
+
+TEST(FFTTest, MatchesDiscreteFourierTransform) {
+    const int height = 8;
+    const int width = 16;
+    FFT2D fft(height, width);
+    Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> plane =
+        Eigen::MatrixXf::Random(height, width);
+    plane.bottomRows(3).setZero(); // Only the first rows are read
+
+    std::vector<FFT2D::Complex> spectrum(fft.spectrum_size());
+    fft.forward(plane.data(), height - 3, spectrum.data());
+    for (int u = 0; u < height; ++u) {
+        for (int v = 0; v < fft.spectrum_cols(); ++v) {
+            std::complex<double> expected = 0.0;
+            for (int r = 0; r < height; ++r) {
+                for (int c = 0; c < width; ++c) {
+                    double angle = -2.0 * M_PI * (double(u * r) / height + double(v * c) / width);
+                    expected += double(plane(r, c)) * std::complex<double>(std::cos(angle), std::sin(angle));
+                }
+            }
+            FFT2D::Complex value = spectrum[u * fft.spectrum_cols() + v];
+            ASSERT_NEAR(value.real(), expected.real(), 1e-4);
+            ASSERT_NEAR(value.imag(), expected.imag(), 1e-4);
+        }
+    }
+
+    // The inverse gives the plane back
+    Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> restored(height, width);
+    fft.inverse(spectrum.data(), height, restored.data());
+    ASSERT_TRUE(restored.isApprox(plane, 1e-5f));
+
+    ASSERT_EQ(FFT2D::next_power_of_two(33), 64);
+    ASSERT_THROW(FFT2D(8, 12), std::invalid_argument);
+    ASSERT_THROW(FFT2D(-4, 8), std::invalid_argument);
+    ASSERT_THROW(FFT2D(8, 0), std::invalid_argument);
+}
@@ -0,0 +1,389 @@
+#include <gtest/gtest.h>
+#include <Eigen/Dense>
+#include <filesystem>
+#include "../include/Eidos/model.h"
+#include "../include/Eidos/layers.h"
+#include "../include/Eidos/activation_fns.h"
+#include "../include/Eidos/loss_fns.h"
+#include "../include/Eidos/optimizer.h"
+
+TEST(ModelTest, StepTensorsComeFromTheArena) {
+    Model model;
+    model.Add(new DenseLayer(4, 8));
+    model.Add(new ReLU());
+    model.Add(new DenseLayer(8, 2));
+
+    MSELoss loss_fn;
+    SGD optimizer(0.01f);
+    model.set_loss_function(loss_fn);
+    model.set_optimizer(optimizer);
+    model.set_train();
+
+    Tensor inputs(Eigen::MatrixXf::Random(16, 4));
+    Tensor targets(Eigen::MatrixXf::Random(16, 2));
+
+    size_t first_step_bytes = 0;
+    for (int step = 0; step < 3; ++step) {
+        Tensor outputs = model.forward(inputs);
+
+        // The output handed back to the caller does not live in the arena
+        ASSERT_FALSE(outputs.is_arena_backed());
+        ASSERT_EQ(outputs.getSingleMatrix().rows(), 16);
+
+        loss_fn.forward(outputs, targets);
+        model.backward();
+        model.optimize();
+
+        // Every step carves the same amount from the arena
+        ASSERT_GT(model.bytes_per_step(), 0);
+        if (step == 0) {
+            first_step_bytes = model.bytes_per_step();
+        }
+        ASSERT_EQ(model.bytes_per_step(), first_step_bytes);
+    }
+}
+
+TEST(ModelTest, LaterStepsRunOutOfThePlannedSlab) {
+    Model model;
+    model.Add(new DenseLayer(6, 32));
+    model.Add(new ReLU());
+    model.Add(new DenseLayer(32, 32));
+    model.Add(new ReLU());
+    model.Add(new DenseLayer(32, 3));
+
+    MSELoss loss_fn;
+    SGD optimizer(0.01f);
+    Tensor inputs(Eigen::MatrixXf::Random(8, 6));
+    Tensor targets(Eigen::MatrixXf::Random(8, 3));
+
+    // One step to record the tensor lifetimes
+    model.Train(inputs, targets, 1, &loss_fn, &optimizer);
+    size_t slab = model.planned_bytes();
+    ASSERT_GT(slab, 0);
+
+    // Buffers with disjoint lifetimes share memory, so the slab is smaller than a step's total
+    ASSERT_LT(slab, model.bytes_per_step());
+
+    // Later steps keep using the same slab and produce the same results as a fresh plan
+    model.Train(inputs, targets, 5, &loss_fn, &optimizer);
+    ASSERT_EQ(model.planned_bytes(), slab);
+    Tensor outputs = model.forward(inputs);
+    ASSERT_TRUE(outputs.getSingleMatrix().allFinite());
+}
+
+TEST(ModelTest, InPlaceLayersReuseTheirInputBuffer) {
+    Tensor input(Eigen::MatrixXf::Random(4, 5));
+    const float* buffer = input.data();
+
+    // Element-wise activations and BatchNorm write their output over an rvalue input
+    ReLU relu;
+    Tensor activated = static_cast<Layer&>(relu).forward(std::move(input));
+    ASSERT_EQ(activated.data(), buffer);
+    ASSERT_TRUE((activated.array() >= 0.0f).all());
+
+    BatchNorm norm(5);
+    Tensor normalized = static_cast<Layer&>(norm).forward(std::move(activated));
+    ASSERT_EQ(normalized.data(), buffer);
+
+    Tensor grad = static_cast<Layer&>(relu).backward(std::move(normalized));
+    ASSERT_EQ(grad.data(), buffer);
+
+    // Views are never written through, the model's input stays untouched
+    Model model;
+    model.Add(new Dropout(0.5f));
+    model.Add(new Sigmoid());
+    model.set_train();
+    Tensor data(Eigen::MatrixXf::Constant(3, 3, -2.0f));
+    Tensor output = model.forward(data);
+    ASSERT_TRUE(data.getSingleMatrix().isApproxToConstant(-2.0f));
+    ASSERT_NE(output.data(), data.data());
+}
+
+TEST(ModelTest, PicksLayoutPerNetwork) {
+    // A first convolution over few channels carries most of the weights, NCHW is kept
+    Model narrow;
+    narrow.Add(new Conv2D(1, 4, 3));
+    narrow.Add(new ReLU());
+    narrow.Add(new FlattenLayer());
+    ASSERT_EQ(narrow.get_layout(), Layout::NCHW);
+
+    // Convolutions that reduce over many channels run channels last
+    Model wide;
+    wide.Add(new Conv2D(16, 8, 3, 1, 1));
+    wide.Add(new ReLU());
+    wide.Add(new MaxPooling2D(2, 2));
+    wide.Add(new FlattenLayer());
+    wide.Add(new DenseLayer(8 * 3 * 3, 2));
+    wide.Add(new Softmax());
+    ASSERT_EQ(wide.get_layout(), Layout::NHWC);
+
+    // A layer without an NHWC kernel before the Flatten keeps the network in NCHW
+    Model mixed;
+    mixed.Add(new Conv2D(16, 8, 3));
+    mixed.Add(new AveragePooling2D(2, 2));
+    mixed.Add(new FlattenLayer());
+    ASSERT_EQ(mixed.get_layout(), Layout::NCHW);
+    mixed.set_layout(Layout::NHWC);
+    ASSERT_EQ(mixed.get_layout(), Layout::NCHW);
+
+    // Results do not depend on the layout, and the output is always NCHW
+    Tensor input(2, 16, 6, 6);
+    input.set_random();
+    Tensor output = wide.forward(input);
+    wide.set_layout(Layout::NCHW);
+    Tensor reference = wide.forward(input);
+    ASSERT_EQ(output.layout(), Layout::NCHW);
+    ASSERT_TRUE(output.getSingleMatrix().isApprox(reference.getSingleMatrix(), 1e-5f));
+
+    // Training runs end to end in NHWC
+    wide.set_layout(Layout::NHWC);
+    CategoricalCrossEntropyLoss loss_fn;
+    SGD optimizer(0.01f);
+    wide.set_loss_function(loss_fn);
+    wide.set_optimizer(optimizer);
+    Tensor targets(Eigen::MatrixXf::Identity(2, 2));
+    for (int step = 0; step < 2; ++step) {
+        loss_fn.forward(wide.forward(input), targets);
+        wide.backward();
+        wide.optimize();
+    }
+}
+
+TEST(ModelTest, InferenceFusesConvolutionBlocks) {
+    // Conv -> LeakyReLU -> MaxPool and Conv -> Tanh (Winograd) are fused, the Softmax is not
+    Model model;
+    model.Add(new Conv2D(3, 8, 3, 1, 1));
+    model.Add(new LeakyReLU(0.1f));
+    model.Add(new MaxPooling2D(2, 2));
+    model.Add(new Conv2D(8, 8, 3, 1, 1));
+    model.Add(new Tanh());
+    model.Add(new FlattenLayer());
+    model.Add(new DenseLayer(8 * 5 * 5, 4));
+    model.Add(new Softmax());
+    model.set_layout(Layout::NCHW);
+
+    Tensor input(3, 3, 11, 11);
+    input.set_random();
+    Tensor reference = model.forward(input);
+
+    model.set_inference();
+    Tensor fused = model.forward(input);
+    ASSERT_EQ(fused.batch(), reference.batch());
+    ASSERT_TRUE(fused.getSingleMatrix().isApprox(reference.getSingleMatrix(), 1e-5f));
+
+    // The model is back to the unfused layers for training, and fuses again afterwards
+    model.set_train();
+    ASSERT_TRUE(model.forward(input).getSingleMatrix().isApprox(reference.getSingleMatrix(), 1e-5f));
+    model.set_inference();
+    ASSERT_TRUE(model.forward(input).getSingleMatrix().isApprox(reference.getSingleMatrix(), 1e-5f));
+}
+
+TEST(ModelTest, GroupedConvolutionsRoundTripThroughSerialization) {
+    Model model;
+    model.Add(new Conv2D(4, 8, 3, 1, 1, 2));
+    model.Add(new ReLU());
+    model.Add(new DepthwiseConv2D(8, 3, 2, 1, 2));
+    model.Add(new Conv2D(16, 4, 1));
+    model.Add(new FlattenLayer());
+
+    Tensor input(2, 4, 8, 8);
+    input.set_random();
+    Tensor expected = model.forward(input);
+
+    std::string path = testing::TempDir() + "grouped_model.bin";
+    model.Serialize(path, false, true, false);
+    Model restored;
+    restored.Deserialize(path);
+    std::filesystem::remove(path);
+    ASSERT_EQ(restored.num_layers(), 5u);
+    ASSERT_EQ(restored.get_layer(0)->get_name(), "GroupedConv2D");
+    ASSERT_EQ(restored.get_layer(2)->get_name(), "DepthwiseConv2D");
+    ASSERT_TRUE(restored.forward(input).getSingleMatrix().isApprox(expected.getSingleMatrix()));
+}
+
+TEST(ModelTest, DataParallelTrainingMatchesOneReplica) {
+    auto copy_parameters = [](Model& from, Model& to) {
+        for (size_t l = 0; l < from.num_layers(); ++l) {
+            auto weights = from.get_layer(l)->get_weights();
+            auto copy = to.get_layer(l)->get_weights();
+            for (size_t i = 0; i < weights.size(); ++i) {
+                *copy[i] = *weights[i];
+            }
+            auto bias = from.get_layer(l)->get_bias();
+            auto copy_bias = to.get_layer(l)->get_bias();
+            for (size_t i = 0; i < bias.size(); ++i) {
+                *copy_bias[i] = *bias[i];
+            }
+        }
+    };
+    auto expect_same_parameters = [](Model& expected_model, Model& model) {
+        for (size_t l = 0; l < expected_model.num_layers(); ++l) {
+            auto expected = expected_model.get_layer(l)->get_weights();
+            auto weights = model.get_layer(l)->get_weights();
+            for (size_t i = 0; i < expected.size(); ++i) {
+                EXPECT_TRUE(weights[i]->isApprox(*expected[i], 1e-4f)) << "weights of layer " << l;
+            }
+            auto expected_bias = expected_model.get_layer(l)->get_bias();
+            auto bias = model.get_layer(l)->get_bias();
+            for (size_t i = 0; i < expected_bias.size(); ++i) {
+                EXPECT_TRUE(bias[i]->isApprox(*expected_bias[i], 1e-4f)) << "bias of layer " << l;
+            }
+        }
+    };
+
+    // Two models with the same weights, one trained on 3 replicas with uneven shares of each batch
+    Model serial;
+    Model parallel;
+    for (Model* model : {&serial, &parallel}) {
+        model->Add(new DenseLayer(5, 16));
+        model->Add(new Tanh());
+        model->Add(new DenseLayer(16, 3));
+    }
+    copy_parameters(serial, parallel);
+
+    // 2 batches of 10 rows
+    Tensor inputs(2, 10, 5);
+    inputs.set_random();
+    Tensor targets(2, 10, 3);
+    targets.set_random();
+    MSELoss loss_fn;
+    SGD optimizer(0.05f);
+    serial.Train(inputs, targets, 3, &loss_fn, &optimizer);
+    parallel.Train(inputs, targets, 3, &loss_fn, &optimizer, {}, 3);
+    expect_same_parameters(serial, parallel);
+
+    // Convolutions train on replicas through the image overload, one image of each batch per replica
+    ImageInputData data(3 * 6 * 6, 2);
+    for (int i = 0; i < 8; ++i) {
+        Tensor image(1, 3, 6, 6);
+        image.set_random();
+        data.training.inputs.push_back(image);
+        data.training.targets.push_back(Tensor(Eigen::MatrixXf::Identity(2, 2).row(i % 2)));
+    }
+    Model serial_conv;
+    Model parallel_conv;
+    for (Model* model : {&serial_conv, &parallel_conv}) {
+        model->Add(new Conv2D(3, 4, 3, 1, 1));
+        model->Add(new ReLU());
+        model->Add(new MaxPooling2D(2, 2));
+        model->Add(new FlattenLayer());
+        model->Add(new DenseLayer(4 * 3 * 3, 2));
+    }
+    copy_parameters(serial_conv, parallel_conv);
+    CrossEntropyLoss cross_entropy;
+    Tensor before = serial_conv.forward(data.training.inputs[0]);
+    serial_conv.Train(data, 2, &cross_entropy, &optimizer, {}, 4);
+    parallel_conv.Train(data, 2, &cross_entropy, &optimizer, {}, 4, 4);
+    ASSERT_FALSE(serial_conv.forward(data.training.inputs[0]).getSingleMatrix().isApprox(before.getSingleMatrix()));
+    expect_same_parameters(serial_conv, parallel_conv);
+}
+
+TEST(ModelTest, AsynchronousTrainingUpdatesSharedWeights) {
+    Model serial;
+    Model async;
+    for (Model* model : {&serial, &async}) {
+        model->Add(new DenseLayer(8, 16));
+        model->Add(new ReLU());
+        model->Add(new DenseLayer(16, 2));
+    }
+    for (size_t l = 0; l < serial.num_layers(); ++l) {
+        auto weights = serial.get_layer(l)->get_weights();
+        auto copy = async.get_layer(l)->get_weights();
+        for (size_t i = 0; i < weights.size(); ++i) {
+            *copy[i] = *weights[i];
+        }
+    }
+
+    // Sparse inputs: most features are zero in every batch
+    Tensor inputs(8, 16, 8);
+    inputs.array() = (Eigen::ArrayXf::Random(inputs.size()) > 0.6f).cast<float>();
+    Tensor targets(8, 16, 2);
+    targets.set_random();
+    MSELoss loss_fn;
+    SGD optimizer(0.05f);
+
+    // A single worker applies the same updates as synchronous training
+    serial.Train(inputs, targets, 2, &loss_fn, &optimizer);
+    async.TrainAsync(inputs, targets, 2, &loss_fn, &optimizer, {}, 1);
+    for (size_t l = 0; l < serial.num_layers(); ++l) {
+        auto expected = serial.get_layer(l)->get_weights();
+        auto weights = async.get_layer(l)->get_weights();
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_TRUE(weights[i]->isApprox(*expected[i], 1e-5f));
+        }
+    }
+
+    // Several workers keep lowering the loss
+    auto loss = [&](Model& model) {
+        float total = 0.0f;
+        for (int i = 0; i < 8; ++i) {
+            total += loss_fn.forward(model.forward(inputs.slice(i)), targets.slice(i));
+        }
+        return total;
+    };
+    float before = loss(async);
+    async.TrainAsync(inputs, targets, 20, &loss_fn, &optimizer, {}, 4);
+    float after = loss(async);
+    ASSERT_LT(after, before);
+
+    // Only SGD updates can be applied without locking, training is aborted with another optimizer
+    Adam adam(0.01f);
+    async.set_optimizer(adam);
+    async.TrainAsync(inputs, targets, 1, &loss_fn, nullptr, {}, 4);
+    ASSERT_FLOAT_EQ(loss(async), after);
+}
+
+TEST(ModelTest, PipelineStepMatchesOneStepOnTheBatch) {
+    Model serial;
+    Model pipelined;
+    for (Model* model : {&serial, &pipelined}) {
+        model->Add(new DenseLayer(6, 24));
+        model->Add(new Tanh());
+        model->Add(new DenseLayer(24, 24));
+        model->Add(new ReLU());
+        model->Add(new DenseLayer(24, 3));
+    }
+    for (size_t l = 0; l < serial.num_layers(); ++l) {
+        auto weights = serial.get_layer(l)->get_weights();
+        auto copy = pipelined.get_layer(l)->get_weights();
+        for (size_t i = 0; i < weights.size(); ++i) {
+            *copy[i] = *weights[i];
+        }
+    }
+
+    // 2 batches of 16 rows, each split into micro-batches of 5, 5 and 6 rows
+    Tensor inputs(1, 2, 16, 6);
+    inputs.set_random();
+    Tensor targets(1, 2, 16, 3);
+    targets.set_random();
+
+    MSELoss loss_fn;
+    SGD optimizer(0.05f);
+    serial.Train(inputs, targets, 3, &loss_fn, &optimizer);
+    pipelined.TrainPipeline(inputs, targets, 3, &loss_fn, &optimizer, {}, 3, 3);
+    for (size_t l = 0; l < serial.num_layers(); ++l) {
+        auto expected = serial.get_layer(l)->get_weights();
+        auto weights = pipelined.get_layer(l)->get_weights();
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_TRUE(weights[i]->isApprox(*expected[i], 1e-4f));
+        }
+        auto expected_bias = serial.get_layer(l)->get_bias();
+        auto bias = pipelined.get_layer(l)->get_bias();
+        for (size_t i = 0; i < expected_bias.size(); ++i) {
+            ASSERT_TRUE(bias[i]->isApprox(*expected_bias[i], 1e-4f));
+        }
+    }
+
+    // A GRU + Dense stack, one sequence per micro-batch, 3 sequences per step and one layer per stage
+    Sigmoid gates;
+    Tanh candidate;
+    Model recurrent;
+    recurrent.Add(new GRULayer(3, 8, 8, &gates, &candidate));
+    recurrent.Add(new DenseLayer(8, 2));
+    Tensor sequences(6, 5, 3);
+    sequences.set_random();
+    Tensor labels(6, 5, 2);
+    labels.set_random();
+    recurrent.TrainPipeline(sequences, labels, 2, &loss_fn, &optimizer, {}, 2, 3);
+    ASSERT_TRUE(recurrent.forward(sequences.slice(0)).getSingleMatrix().allFinite());
+}
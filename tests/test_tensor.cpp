@@ -0,0 +1,247 @@
+#include <gtest/gtest.h>
+#include <Eigen/Dense>
+#include <type_traits>
+#include "../include/Eidos/tensor.hpp"
+#include "../include/Eidos/activation_fns.h"
+
+TEST(TensorTest, ChannelsShareOneContiguousBuffer) {
+    Tensor tensor(3, 4, 5);
+    tensor.set_random();
+
+    // Channel views point straight into the buffer in row-major order
+    for (size_t d = 0; d < 3; ++d) {
+        ASSERT_EQ(tensor[d].data(), tensor.data() + d * 4 * 5);
+        for (size_t r = 0; r < 4; ++r) {
+            for (size_t c = 0; c < 5; ++c) {
+                ASSERT_EQ(tensor(d, r, c), tensor[d](r, c));
+            }
+        }
+    }
+
+    // Writing through a channel view updates the tensor
+    tensor[1] = Eigen::MatrixXf::Constant(4, 5, 2.0f);
+    ASSERT_FLOAT_EQ(tensor(1, 3, 4), 2.0f);
+}
+
+TEST(TensorTest, PushBackAndFlattenKeepChannelOrder) {
+    Eigen::MatrixXf a(2, 2), b(2, 2);
+    a << 1, 2, 3, 4;
+    b << 5, 6, 7, 8;
+
+    Tensor tensor;
+    tensor.push_back(a);
+    tensor.push_back(b);
+    ASSERT_EQ(tensor.depth(), 2);
+    ASSERT_THROW(tensor.push_back(Eigen::MatrixXf::Zero(3, 2)), std::invalid_argument);
+
+    Eigen::MatrixXf expected(4, 2);
+    expected << 1, 2, 3, 4, 5, 6, 7, 8;
+    ASSERT_TRUE(tensor.flatten().isApprox(expected));
+
+    size_t count = 0;
+    for (auto channel : tensor) {
+        ASSERT_TRUE(channel.isApprox(count == 0 ? a : b));
+        ++count;
+    }
+    ASSERT_EQ(count, 2);
+}
+
+TEST(TensorTest, ElementwiseActivationMatchesPerChannel) {
+    Tensor input(4, 3, 3);
+    input.set_random();
+
+    LeakyReLU activation(0.1f);
+    Tensor output = activation.Activation::forward(input);
+
+    LeakyReLU reference(0.1f);
+    for (size_t d = 0; d < input.depth(); ++d) {
+        Eigen::MatrixXf channel = input[d];
+        ASSERT_TRUE(output[d].isApprox(reference.forward(channel)));
+    }
+}
+
+TEST(TensorTest, SliceAndViewBorrowTheBuffer) {
+    Tensor tensor(3, 4, 2);
+    tensor.set_random();
+
+    // Slices and views point into the parent buffer without copying
+    Tensor slice = tensor.slice(1);
+    ASSERT_TRUE(slice.is_view());
+    ASSERT_EQ(slice.data(), tensor[1].data());
+    ASSERT_EQ(tensor.flatten().data(), tensor.data());
+
+    Tensor view = tensor.view();
+    view.reshape(1, 1, 12, 2);
+    ASSERT_EQ(view.getSingleMatrix().data(), tensor.data());
+
+    // Views of a const tensor are read-only
+    const Tensor& parent = tensor;
+    static_assert(std::is_const_v<decltype(parent.view())>);
+    const Tensor stacked = parent.view(1, 1, 12, 2);
+    ASSERT_TRUE(stacked.is_view());
+    ASSERT_EQ(stacked.data(), tensor.data());
+
+    // Writes through a view land in the parent
+    slice *= 0.0f;
+    ASSERT_TRUE(tensor[1].isZero());
+
+    // Copies of a view own their data
+    Tensor copy = tensor.slice(2);
+    Tensor owned = copy;
+    ASSERT_FALSE(owned.is_view());
+    ASSERT_NE(owned.data(), tensor[2].data());
+    ASSERT_TRUE(owned.getSingleMatrix().isApprox(tensor[2]));
+}
+
+TEST(TensorTest, ArenaBacksTensorsCreatedInScope) {
+    Arena arena(256);
+    Tensor heap(2, 2, 2);
+    ASSERT_FALSE(heap.is_arena_backed());
+
+    {
+        Arena::Scope scope(arena);
+        Tensor a(2, 4, 4);
+        Tensor b = a * 2.0f;
+        ASSERT_TRUE(a.is_arena_backed());
+        ASSERT_TRUE(b.is_arena_backed());
+        ASSERT_TRUE(a.array().isZero());
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(b.data()) % Arena::alignment, 0);
+
+        // Copy-assigning into a long-lived tensor keeps it on the heap
+        heap = b;
+        ASSERT_FALSE(heap.is_arena_backed());
+
+        // Overflowing the first block adds another one
+        Tensor big(4, 16, 16);
+        ASSERT_GT(arena.capacity(), 256);
+    }
+    ASSERT_EQ(arena.bytes_allocated(), 2 * 128 + 4 * 16 * 16 * sizeof(float));
+
+    // Reset coalesces the blocks into one and frees everything
+    size_t capacity = arena.capacity();
+    arena.reset();
+    ASSERT_EQ(arena.bytes_allocated(), 0);
+    ASSERT_EQ(arena.capacity(), capacity);
+    ASSERT_EQ(heap.size(), 32);
+    ASSERT_TRUE(heap.array().isZero());
+}
+
+TEST(TensorTest, PlannedArenaReusesBuffersWithDisjointLifetimes) {
+    Arena arena(Arena::default_block_size, true);
+    auto step = [&]() {
+        Arena::Scope scope(arena);
+        Tensor a(1, 16, 16);
+        Tensor b = a * 2.0f;      // a and b alive together
+        a = Tensor(1, 16, 16);    // the first a is released here
+        Tensor c(1, 16, 16);
+        return std::vector<const float*>{a.data(), b.data(), c.data()};
+    };
+
+    step();
+    ASSERT_FALSE(arena.is_planned());
+    arena.reset();
+    ASSERT_TRUE(arena.is_planned());
+
+    // The first buffer dies before the others are allocated, so only three are live at once
+    ASSERT_EQ(arena.slab_size(), 3 * 16 * 16 * sizeof(float));
+    std::vector<const float*> first = step();
+    arena.reset();
+    std::vector<const float*> second = step();
+    ASSERT_EQ(first, second);
+    ASSERT_EQ(arena.capacity(), arena.slab_size());
+}
+
+TEST(TensorTest, LayoutConversion) {
+    Tensor tensor(2, 3, 4, 5);
+    tensor.set_random();
+
+    Tensor nhwc = tensor.to_nhwc();
+    ASSERT_EQ(nhwc.layout(), Layout::NHWC);
+    ASSERT_EQ(nhwc.batch_shape(), tensor.batch_shape());
+
+    // Elements keep their logical position, the channels of a pixel become contiguous
+    ASSERT_FLOAT_EQ(nhwc(1, 2, 3, 4), tensor(1, 2, 3, 4));
+    ASSERT_FLOAT_EQ(nhwc.pixel(1, 3, 4)(2), tensor.channel(1, 2)(3, 4));
+    ASSERT_EQ(nhwc.pixel(0, 0, 1).data(), nhwc.data() + 3);
+    ASSERT_EQ(std::get<0>(nhwc.strides()), 1);
+
+    Tensor back = nhwc.to_nchw();
+    ASSERT_EQ(back.layout(), Layout::NCHW);
+    ASSERT_TRUE(back.array().isApprox(tensor.array()));
+
+    // Channel access needs channels-first data
+    ASSERT_THROW(nhwc[0], std::logic_error);
+}
+
+TEST(TensorTest, ExpressionsEvaluateInOnePass) {
+    Tensor a(2, 3, 4, 8);
+    Tensor b(2, 3, 4, 8);
+    a.set_random();
+    b.set_random();
+
+    Arena arena;
+    {
+        Arena::Scope scope(arena);
+        // The whole expression is evaluated into a single new buffer
+        Tensor result = a * 2.0f + b - 1.0f;
+        ASSERT_EQ(arena.bytes_allocated(), a.size() * sizeof(float));
+        ASSERT_EQ(result.batch_shape(), a.batch_shape());
+        ASSERT_TRUE(result.array().isApprox(a.array() * 2.0f + b.array() - 1.0f));
+
+        // Accumulating an expression does not allocate
+        result += 0.5f * a - b / 2.0f;
+        result -= -a;
+        ASSERT_EQ(arena.bytes_allocated(), a.size() * sizeof(float));
+        ASSERT_TRUE(result.array().isApprox(a.array() * 3.5f + b.array() * 0.5f - 1.0f));
+    }
+
+    // An expression may read the tensor it is assigned to
+    Tensor expected(a.array().matrix() * 3.0f);
+    a = a * 2.0f + a;
+    ASSERT_TRUE(a.array().isApprox(expected.array()));
+
+    ASSERT_THROW(a + Tensor(3, 4, 8), std::invalid_argument);
+    ASSERT_THROW(a / 0.0f, std::invalid_argument);
+}
+
+TEST(TensorTest, AllocatorAlignsAndCounts) {
+    AllocationStats before = Allocator::stats();
+    {
+        Tensor tensor(3, 7, 5);
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(tensor.data()) % Allocator::alignment, 0);
+
+        AllocationStats during = Allocator::stats();
+        ASSERT_EQ(during.allocations, before.allocations + 1);
+        ASSERT_EQ(during.bytes_allocated, before.bytes_allocated + tensor.size() * sizeof(float));
+        ASSERT_GT(during.bytes_in_use, before.bytes_in_use);
+        ASSERT_GE(during.peak_bytes_in_use, during.bytes_in_use);
+    }
+    AllocationStats after = Allocator::stats();
+    ASSERT_EQ(after.deallocations, before.deallocations + 1);
+    ASSERT_EQ(after.bytes_in_use, before.bytes_in_use);
+
+    // Large buffers are aligned to whole huge pages once opted in. Turn them off again even if an
+    // assertion returns early, so later tests allocate as usual.
+    struct HugePagesScope {
+        HugePagesScope() { Allocator::enable_huge_pages(1 << 20); }
+        ~HugePagesScope() { Allocator::disable_huge_pages(); }
+    };
+    {
+        HugePagesScope huge_pages;
+        Tensor large(1, 1024, 1024);
+        uintptr_t address = reinterpret_cast<uintptr_t>(large.data());
+        ASSERT_EQ(address % Allocator::huge_page_size, 0);
+
+        // A 4MB buffer takes exactly two huge pages, its bookkeeping is kept elsewhere
+        AllocationStats during = Allocator::stats();
+        ASSERT_EQ(during.bytes_in_use, after.bytes_in_use + 2 * Allocator::huge_page_size);
+        if (during.huge_page_allocations > after.huge_page_allocations) {
+            // madvise is supported by this kernel
+            ASSERT_EQ(during.huge_page_allocations, after.huge_page_allocations + 1);
+            ASSERT_EQ(during.huge_page_bytes % Allocator::huge_page_size, 0);
+        }
+    }
+    ASSERT_FALSE(Allocator::huge_pages_enabled());
+    ASSERT_EQ(Allocator::stats().huge_page_bytes, after.huge_page_bytes);
+    ASSERT_EQ(Allocator::stats().bytes_in_use, after.bytes_in_use);
+}
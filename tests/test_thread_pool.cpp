@@ -0,0 +1,191 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdlib>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "../include/Eidos/bounded_queue.h"
+#include "../include/Eidos/thread_pool.h"
+#include "../include/Eidos/threading.h"
+
+TEST(ThreadPoolTest, ParallelForVisitsEveryIndexOnce) {
+    ThreadPool pool(4);
+    for (int grain : {1, 3, 1000}) {
+        std::vector<std::atomic<int>> visits(1000);
+        pool.parallel_for(0, 1000, [&](int i) { ++visits[i]; }, grain);
+        for (int i = 0; i < 1000; ++i) {
+            ASSERT_EQ(visits[i], 1) << "index " << i << ", grain " << grain;
+        }
+    }
+
+    // Offset and empty ranges
+    std::atomic<int> sum{0};
+    pool.parallel_for(10, 20, [&](int i) { sum += i; });
+    pool.parallel_for(5, 5, [&](int) { sum += 1000; });
+    ASSERT_EQ(sum, 145);
+}
+
+TEST(ThreadPoolTest, NestedLoopsDoNotDeadlock) {
+    // More outer tasks than threads, each waiting on an inner loop, only completes if waiting
+    // threads run queued tasks themselves
+    ThreadPool pool(2);
+    std::atomic<int> count{0};
+    pool.parallel_for(0, 16, [&](int) {
+        pool.parallel_for(0, 16, [&](int) {
+            pool.parallel_for(0, 4, [&](int) { ++count; });
+        });
+    });
+    ASSERT_EQ(count, 16 * 16 * 4);
+}
+
+TEST(ThreadPoolTest, WaitRunsOnlyTheTasksOfItsGroup) {
+    ThreadPool pool(2);
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::atomic<bool> blocked{false};
+    std::future<void> blocker = pool.submit([&] {
+        blocked = true;
+        released.wait();
+    });
+    while (!blocked) {
+        std::this_thread::yield();
+    }
+
+    // The only worker is busy, so the other group's task stays queued while this group is waited for
+    std::atomic<bool> other_ran{false};
+    ThreadPool::TaskGroup other(pool);
+    other.run([&] { other_ran = true; });
+    std::atomic<int> mine{0};
+    ThreadPool::TaskGroup group(pool);
+    for (int i = 0; i < 4; ++i) {
+        group.run([&] { ++mine; });
+    }
+    group.wait();
+    EXPECT_EQ(mine, 4);
+    EXPECT_FALSE(other_ran);
+
+    release.set_value();
+    blocker.get();
+    other.wait();
+    EXPECT_TRUE(other_ran);
+}
+
+TEST(ThreadPoolTest, TaskGroupRethrowsFirstException) {
+    ThreadPool pool(3);
+    std::atomic<int> done{0};
+    ThreadPool::TaskGroup group(pool);
+    for (int i = 0; i < 8; ++i) {
+        group.run([&done, i] {
+            if (i == 5) {
+                throw std::runtime_error("task failed");
+            }
+            ++done;
+        });
+    }
+    ASSERT_THROW(group.wait(), std::runtime_error);
+    ASSERT_EQ(done, 7); // The other tasks still ran
+
+    ASSERT_THROW(pool.parallel_for(0, 100, [](int i) {
+        if (i == 42) {
+            throw std::invalid_argument("bad index");
+        }
+    }), std::invalid_argument);
+}
+
+TEST(ThreadPoolTest, SubmitReturnsResult) {
+    for (int threads : {1, 4}) {
+        ThreadPool pool(threads);
+        ASSERT_EQ(pool.num_threads(), threads);
+        std::vector<std::future<int>> results;
+        for (int i = 0; i < 20; ++i) {
+            results.push_back(pool.submit([i] { return i * i; }));
+        }
+        for (int i = 0; i < 20; ++i) {
+            ASSERT_EQ(results[i].get(), i * i);
+        }
+    }
+}
+
+TEST(ThreadPoolTest, ResizeKeepsPoolUsable) {
+    ThreadPool pool(2);
+    for (int threads : {4, 1, 3}) {
+        pool.resize(threads);
+        ASSERT_EQ(pool.num_threads(), threads);
+        std::atomic<int> sum{0};
+        pool.parallel_for(0, 100, [&](int i) { sum += i; });
+        ASSERT_EQ(sum, 4950);
+    }
+
+    // Resizing from a task would join the thread running it
+    ThreadPool::TaskGroup group(pool);
+    group.run([&pool] { pool.resize(2); });
+    ASSERT_THROW(group.wait(), std::logic_error);
+}
+
+TEST(ThreadPoolTest, SerialNestingRunsInnerLoopsInline) {
+    ThreadPool pool(4);
+    pool.set_nesting(NestedParallelism::Serial);
+    std::atomic<int> moved{0};
+    pool.parallel_for(0, 8, [&](int) {
+        ASSERT_TRUE(ThreadPool::in_task());
+        std::thread::id outer = std::this_thread::get_id();
+        pool.parallel_for(0, 64, [&](int) {
+            if (std::this_thread::get_id() != outer) {
+                ++moved;
+            }
+        });
+    });
+    ASSERT_EQ(moved, 0);
+    ASSERT_FALSE(ThreadPool::in_task());
+}
+
+TEST(ThreadPoolTest, SetNumThreadsResizesGlobalPool) {
+    Eidos::set_num_threads(3);
+    ASSERT_EQ(Eidos::num_threads(), 3);
+    ASSERT_EQ(ThreadPool::global().num_threads(), 3);
+
+    setenv("EIDOS_NUM_THREADS", "2", 1);
+    ASSERT_EQ(Eidos::default_num_threads(), 2);
+    Eidos::set_num_threads(0);
+    ASSERT_EQ(Eidos::num_threads(), 2);
+
+    // Invalid values fall back to the hardware threads
+    setenv("EIDOS_NUM_THREADS", "many", 1);
+    ASSERT_GE(Eidos::default_num_threads(), 1);
+    unsetenv("EIDOS_NUM_THREADS");
+    Eidos::set_num_threads(0);
+    ASSERT_EQ(Eidos::num_threads(), Eidos::default_num_threads());
+
+    Eidos::set_nested_parallelism(NestedParallelism::Serial);
+    ASSERT_EQ(Eidos::nested_parallelism(), NestedParallelism::Serial);
+    Eidos::set_nested_parallelism(NestedParallelism::Shared);
+}
+
+TEST(BoundedQueueTest, HandsItemsOverInOrderAndCloses) {
+    BoundedQueue<int> queue(2);
+    std::vector<int> received;
+    std::thread consumer([&] {
+        int item;
+        while (queue.pop(item)) {
+            received.push_back(item);
+        }
+    });
+    // The producer waits whenever the consumer is two items behind. EXPECT, so a failure still joins the consumer.
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_TRUE(queue.push(i));
+    }
+    queue.close();
+    consumer.join();
+    ASSERT_EQ(received.size(), 100u);
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_EQ(received[i], i);
+    }
+
+    // Closing wakes a waiting producer, which gives up
+    BoundedQueue<int> full(1);
+    EXPECT_TRUE(full.push(0));
+    std::thread producer([&] { EXPECT_FALSE(full.push(1)); });
+    full.close();
+    producer.join();
+}